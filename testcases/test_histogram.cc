@@ -0,0 +1,92 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdint.h>
+#include "tinyrpc/comm/metrics.h"
+
+//
+// bucket math of LatencyHistogram: every value falls in the bucket whose range contains it,
+// and quantile and le count never underestimate
+// run it like this: ./test_histogram
+//
+
+typedef tinyrpc::LatencyHistogram Histogram;
+
+// every bucket starts right after the last one ends, and values in it map back to it
+static void testBucketRange() {
+  uint64_t min = 0;
+  for (int i = 0; i < Histogram::BUCKET_COUNT - 1; ++i) {
+    uint64_t max = Histogram::getBucketMax(i);
+    assert(max >= min);
+    assert(Histogram::getBucketIndex(min) == i);
+    assert(Histogram::getBucketIndex(max) == i);
+    assert(Histogram::getBucketIndex((min + max) / 2) == i);
+
+    // width is at most 1/8 of min, that's the max error
+    assert(i < Histogram::SUB_BUCKET_COUNT || (max - min + 1) * Histogram::SUB_BUCKET_COUNT <= min);
+    min = max + 1;
+  }
+
+  // last bucket counts all the rest, including values too big
+  assert(Histogram::getBucketIndex(min) == Histogram::BUCKET_COUNT - 1);
+  assert(Histogram::getBucketIndex(1ULL << Histogram::MAX_EXPONENT) == Histogram::BUCKET_COUNT - 1);
+  assert(Histogram::getBucketIndex(UINT64_MAX) == Histogram::BUCKET_COUNT - 1);
+  assert(Histogram::getBucketMax(Histogram::BUCKET_COUNT - 1) == UINT64_MAX);
+  printf("bucket range succ\n");
+}
+
+static void testSnapshot() {
+  Histogram histogram;
+  // 7, 8, 9 are in buckets of width 1, 100 is in bucket [96, 103] and 105 in [104, 111]
+  int64_t values[] = {-5, 0, 7, 8, 9, 100, 105, 1000, 1000000};
+  int count = sizeof(values) / sizeof(values[0]);
+  for (int i = 0; i < count; ++i) {
+    histogram.record(values[i]);
+  }
+
+  tinyrpc::HistogramSnapshot snapshot;
+  snapshot.merge(histogram);
+  snapshot.merge(histogram);
+  assert(snapshot.m_count == (uint64_t)count * 2);
+  assert(snapshot.m_sum == 2 * (0 + 0 + 7 + 8 + 9 + 100 + 105 + 1000 + 1000000ULL));
+
+  // negative value is counted as 0
+  assert(snapshot.getCountBelow(0) == 4);
+  assert(snapshot.getCountBelow(8) == 8);
+  assert(snapshot.getCountBelow(UINT64_MAX) == (uint64_t)count * 2);
+
+  // 100 is not a bucket edge, its whole bucket is counted, but not next one
+  assert(snapshot.getCountBelow(100) == 12);
+  assert(snapshot.getCountBelow(99) == 12);
+  assert(snapshot.getCountBelow(104) == 14);
+
+  // never less than exact count
+  for (uint64_t v = 0; v < 2000000; v = v * 2 + 1) {
+    uint64_t exact = 0;
+    for (int i = 0; i < count; ++i) {
+      if (values[i] <= (int64_t)v) {
+        exact += 2;
+      }
+    }
+    assert(snapshot.getCountBelow(v) >= exact);
+  }
+
+  // quantile is max of bucket, so it's never less than exact one and at most 12.5% more
+  assert(snapshot.getQuantile(0) == 0);
+  assert(snapshot.getQuantile(0.5) == 9);
+  uint64_t p99 = snapshot.getQuantile(0.99);
+  assert(p99 >= 1000000 && p99 <= 1000000 + 1000000 / 8);
+  assert(snapshot.getQuantile(1) == p99);
+
+  tinyrpc::HistogramSnapshot empty;
+  assert(empty.getQuantile(0.99) == 0);
+  assert(empty.getCountBelow(UINT64_MAX) == 0);
+  printf("snapshot succ\n");
+}
+
+int main(int argc, char* argv[]) {
+  testBucketRange();
+  testSnapshot();
+
+  printf("test_histogram succ\n");
+  return 0;
+}
@@ -232,6 +232,8 @@ int main(int argc, char* argv[]) {
   tinyrpc::GetServer()->registerHttpServlet("/user", std::make_shared<RootHttpServlet>());
   tinyrpc::GetServer()->registerHttpServlet("/another", std::make_shared<AnotherHttpServlet>());
   tinyrpc::GetServer()->registerHttpServlet("/async", std::make_shared<AsyncRPCTestServlet>());
+  tinyrpc::GetServer()->registerHttpServlet("/metrics", std::make_shared<tinyrpc::MetricsHttpServlet>());
+  tinyrpc::GetServer()->registerHttpServlet("/reactor", std::make_shared<tinyrpc::ReactorStatsHttpServlet>());
 
   tinyrpc::StartRpcServer();
 
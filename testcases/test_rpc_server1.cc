@@ -43,7 +43,9 @@ class QueryServiceImpl : public QueryService {
     #ifdef DECLARE_MYSQL_PLUGIN
 
     AppDebugLog << "install mysql pulgin, begin to query mysql";
-    tinyrpc::MySQLInstase::ptr instase =  tinyrpc::MySQLInstaseFactroy::GetThreadMySQLFactory()->GetMySQLInstase("test_db_key1");
+    // connection goes back to pool when instase is released
+    tinyrpc::MySQLInstasePool::ptr pool = tinyrpc::MySQLInstaseFactroy::GetThreadMySQLFactory()->GetMySQLInstasePool("test_db_key1");
+    tinyrpc::MySQLInstase::ptr instase = pool ? pool->getInstase() : NULL;
     if (!instase || !instase->isInitSuccess()) {
       response->set_ret_code(-1);
       response->set_res_info("faild to init mysql");
@@ -51,33 +53,33 @@ class QueryServiceImpl : public QueryService {
       return;
     }
 
-    int n = 1000000;
-    // while(n--) {
-    char query_sql[512];
-    sprintf(query_sql, "select user_id, user_name, user_gender from user_db.t_user_information where user_id = '%s';", std::to_string(request->id()).c_str());
-
-    int rt = instase->query(std::string(query_sql));
-    if (rt != 0) {
+    // prepared once by this connection, later requests only send id
+    tinyrpc::MySQLStatement::ptr stmt = instase->prepare("select user_id, user_name, user_gender from user_db.t_user_information where user_id = ?;");
+    if (!stmt) {
       response->set_ret_code(-1);
       response->set_res_info(instase->getMySQLErrorInfo());
-      AppErrorLog << "failed to excute sql" << std::string(query_sql);
+      AppErrorLog << "failed to prepare sql";
       return;
     }
+    stmt->bindInt64(0, request->id());
 
-    MYSQL_RES* res = instase->storeResult();
+    int rt = instase->execute(stmt);
+    if (rt != 0) {
+      response->set_ret_code(-1);
+      response->set_res_info(stmt->getErrorInfo());
+      AppErrorLog << "failed to excute sql" << stmt->getSql();
+      return;
+    }
 
-    MYSQL_ROW row = instase->fetchRow(res);
-    if (row) {
-      int i = 0;
+    if (stmt->fetch()) {
       AppDebugLog << "query success";
-      response->set_id(std::atoi(row[i++]));
-      response->set_name(std::string(row[i++]));
+      response->set_id(stmt->getInt64(0));
+      response->set_name(stmt->getString(1));
     } else {
       AppDebugLog << "query empty";
       response->set_ret_code(-1);
       response->set_res_info("this user not exist");
     }
-    instase->freeResult(res);
 
     #else
 
@@ -0,0 +1,118 @@
+#include <assert.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "tinyrpc/net/task_queue.h"
+
+//
+// TaskQueue falls back to overflow list when ring is full, tasks still run once and in order of pushing
+// run it like this: ./test_task_queue
+//
+
+static const int PRODUCER_COUNT = 4;
+static const int TASK_COUNT = 100000;
+
+static void testOverflow() {
+  tinyrpc::TaskQueue queue(4);
+  std::vector<int> re;
+  assert(queue.empty());
+
+  for (int i = 0; i < 10; ++i) {
+    queue.push([&re, i]() {
+      re.push_back(i);
+    });
+  }
+  assert(!queue.empty());
+
+  std::vector<tinyrpc::Task> tasks;
+  assert(queue.popAll(tasks) == 10);
+  assert(queue.empty());
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i]();
+  }
+  for (int i = 0; i < 10; ++i) {
+    assert(re[i] == i);
+  }
+
+  // ring is used again after overflow is drained
+  re.clear();
+  tasks.clear();
+  for (int i = 0; i < 3; ++i) {
+    queue.push([&re, i]() {
+      re.push_back(i);
+    });
+  }
+  assert(queue.popAll(tasks) == 3);
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tasks[i]();
+  }
+  assert(re == std::vector<int>({0, 1, 2}));
+  printf("overflow succ\n");
+}
+
+struct Producer {
+  tinyrpc::TaskQueue* queue {nullptr};
+  int id {0};
+  std::vector<int>* re {nullptr};     // seq of tasks run by consumer, of every producer
+};
+
+static std::atomic<int> g_done_producers {0};
+
+static void* producerFunc(void* arg) {
+  Producer* producer = reinterpret_cast<Producer*>(arg);
+  for (int i = 0; i < TASK_COUNT; ++i) {
+    std::vector<int>* re = producer->re;
+    int id = producer->id;
+    producer->queue->push([re, id, i]() {
+      re[id].push_back(i);
+    });
+  }
+  g_done_producers++;
+  return nullptr;
+}
+
+// ring is small, so producers overflow from time to time while consumer is popping
+static void testConcurrent() {
+  tinyrpc::TaskQueue queue(64);
+  std::vector<int> re[PRODUCER_COUNT];
+  Producer producers[PRODUCER_COUNT];
+  pthread_t threads[PRODUCER_COUNT];
+
+  for (int i = 0; i < PRODUCER_COUNT; ++i) {
+    producers[i].queue = &queue;
+    producers[i].id = i;
+    producers[i].re = re;
+    pthread_create(&threads[i], nullptr, producerFunc, &producers[i]);
+  }
+
+  std::vector<tinyrpc::Task> tasks;
+  while (true) {
+    bool done = g_done_producers == PRODUCER_COUNT;
+    tasks.clear();
+    queue.popAll(tasks);
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      tasks[i]();
+    }
+    if (done && queue.empty()) {
+      break;
+    }
+  }
+
+  for (int i = 0; i < PRODUCER_COUNT; ++i) {
+    pthread_join(threads[i], nullptr);
+    assert((int)re[i].size() == TASK_COUNT);
+    for (int j = 0; j < TASK_COUNT; ++j) {
+      assert(re[i][j] == j);
+    }
+  }
+  printf("concurrent succ\n");
+}
+
+int main(int argc, char* argv[]) {
+  testOverflow();
+  testConcurrent();
+
+  printf("test_task_queue succ\n");
+  return 0;
+}
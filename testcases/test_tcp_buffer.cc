@@ -0,0 +1,136 @@
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "tinyrpc/net/tcp/tcp_buffer.h"
+
+//
+// block chain of TcpBuffer: bytes written across blocks are read back in order,
+// pullUp makes them contiguous without losing or reordering any byte
+// run it like this: ./test_tcp_buffer
+//
+
+static std::string makeData(int size, int seed) {
+  std::string re(size, 0);
+  for (int i = 0; i < size; ++i) {
+    re[i] = (char)((i * 31 + seed) & 0xff);
+  }
+  return re;
+}
+
+static void testWriteAndRead() {
+  tinyrpc::TcpBuffer buffer;
+  std::string data = makeData(3 * tinyrpc::TcpBuffer::BLOCK_SIZE + 100, 1);
+  buffer.writeToBuffer(data.c_str(), data.size());
+  assert(buffer.readAble() == (int)data.size());
+  assert(buffer.getBufferString() == data);
+
+  struct iovec iov[8];
+  assert(buffer.getReadIovec(iov, 8) == 4);
+  assert(buffer.getReadIovec(iov, 2) == 2);
+
+  std::vector<char> re;
+  buffer.readFromBuffer(re, 5000);
+  assert(std::string(re.begin(), re.end()) == data.substr(0, 5000));
+  assert(buffer.readAble() == (int)data.size() - 5000);
+  assert(buffer.getBufferString() == data.substr(5000));
+
+  buffer.readFromBuffer(re, data.size());
+  assert(std::string(re.begin(), re.end()) == data.substr(5000));
+  assert(buffer.readAble() == 0);
+
+  // last block is reused
+  buffer.writeToBuffer("abc", 3);
+  assert(buffer.getBufferString() == "abc");
+  printf("write and read succ\n");
+}
+
+static void testPullUp() {
+  tinyrpc::TcpBuffer buffer;
+  std::string data = makeData(2 * tinyrpc::TcpBuffer::BLOCK_SIZE + 10, 2);
+  buffer.writeToBuffer(data.c_str(), data.size());
+
+  // in first block, no copy
+  const char* p = buffer.pullUp(100);
+  assert(p != nullptr && memcmp(p, data.c_str(), 100) == 0);
+  assert(buffer.pullUp(100) == p);
+
+  std::vector<char> re;
+  buffer.readFromBuffer(re, 4000);
+
+  // cross three blocks
+  int size = tinyrpc::TcpBuffer::BLOCK_SIZE + 100;
+  p = buffer.pullUp(size);
+  assert(p != nullptr && memcmp(p, data.c_str() + 4000, size) == 0);
+  assert(buffer.readAble() == (int)data.size() - 4000);
+  assert(buffer.getBufferString() == data.substr(4000));
+
+  // pulled up bytes are in one block now
+  assert(buffer.pullUp(size) == p);
+
+  assert(buffer.pullUp(buffer.readAble() + 1) == nullptr);
+  assert(buffer.pullUp(0) == nullptr);
+
+  // bytes written after pullUp follow the rest
+  std::string more = makeData(5000, 3);
+  buffer.writeToBuffer(more.c_str(), more.size());
+  assert(buffer.getBufferString() == data.substr(4000) + more);
+
+  // skipRead doesn't drop blocks, so pulled up bytes are still valid
+  buffer.skipRead(size);
+  assert(memcmp(p, data.c_str() + 4000, size) == 0);
+  buffer.adjustBuffer();
+  assert(buffer.getBufferString() == data.substr(4000 + size) + more);
+  printf("pullUp succ\n");
+}
+
+static void testDirectWrite() {
+  tinyrpc::TcpBuffer buffer;
+  buffer.writeToBuffer("head", 4);
+
+  // bigger than a block, it gets its own block
+  std::string data = makeData(3 * tinyrpc::TcpBuffer::BLOCK_SIZE, 4);
+  char* p = buffer.beginWrite(data.size());
+  memcpy(p, data.c_str(), data.size());
+  buffer.recycleWrite(data.size());
+  assert(buffer.getBufferString() == "head" + data);
+
+  // like readv, only part of iovec is filled
+  struct iovec iov[8];
+  int count = buffer.getWriteIovec(iov, 8, 6000);
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    total += iov[i].iov_len;
+  }
+  assert(total >= 6000);
+
+  std::string tail = makeData(5000, 5);
+  int n = 0;
+  for (int i = 0; i < count && n < (int)tail.size(); ++i) {
+    int c = std::min((int)iov[i].iov_len, (int)tail.size() - n);
+    memcpy(iov[i].iov_base, tail.c_str() + n, c);
+    n += c;
+  }
+  buffer.recycleWrite(n);
+  assert(buffer.getBufferString() == "head" + data + tail);
+
+  buffer.recycleRead(4 + data.size());
+  assert(buffer.getBufferString() == tail);
+
+  buffer.clearBuffer();
+  assert(buffer.readAble() == 0);
+  assert(buffer.getBufferString().empty());
+  printf("direct write succ\n");
+}
+
+int main(int argc, char* argv[]) {
+  testWriteAndRead();
+  testPullUp();
+  testDirectWrite();
+
+  printf("test_tcp_buffer succ\n");
+  return 0;
+}
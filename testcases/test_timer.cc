@@ -0,0 +1,125 @@
+#include <assert.h>
+#include <stdio.h>
+#include <vector>
+#include "tinyrpc/comm/config.h"
+#include "tinyrpc/net/reactor.h"
+#include "tinyrpc/net/timer.h"
+
+//
+// drive timing wheel with fake time by Timer::expire, every event must fire at exactly its arrive time
+// run it like this: ./test_timer ../conf/test_rpc_server1.xml
+//
+
+namespace tinyrpc {
+extern tinyrpc::Config::ptr gRpcConfig;
+}
+
+static std::vector<int> g_fired;
+
+static tinyrpc::TimerEvent::ptr addEvent(tinyrpc::Timer& timer, int64_t arrive_time, int id) {
+  tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(0, false, [id]() {
+    g_fired.push_back(id);
+  });
+  event->m_arrive_time = arrive_time;
+  timer.addTimerEvent(event);
+  return event;
+}
+
+// expire to arrive_time - 1 and to arrive_time, events must fire at the second one
+static void checkFireAt(tinyrpc::Timer& timer, int64_t arrive_time, const std::vector<int>& ids) {
+  g_fired.clear();
+  timer.expire(arrive_time - 1);
+  assert(g_fired.empty());
+  timer.expire(arrive_time);
+  assert(g_fired == ids);
+}
+
+// events of every level, they are cascaded down when their slot expires
+static void testCascade(tinyrpc::Timer& timer, int64_t base) {
+  int64_t deltas[] = {1, 255, 256, 257, 300, 1 << 14, (1 << 14) + 1, 1000000, (1 << 20) + 3};
+  int count = sizeof(deltas) / sizeof(deltas[0]);
+
+  // add later ones first, order of adding must not matter
+  for (int i = count - 1; i >= 0; --i) {
+    addEvent(timer, base + deltas[i], i);
+  }
+  for (int i = 0; i < count; ++i) {
+    checkFireAt(timer, base + deltas[i], {i});
+  }
+  printf("cascade succ\n");
+}
+
+// events of one tick fire in one batch, a cancelled one doesn't fire even it has expired in this batch
+static void testDelete(tinyrpc::Timer& timer, int64_t base) {
+  int64_t arrive_time = base + 5000;
+
+  // each one cancels the other, so only the one runs first fires
+  tinyrpc::TimerEvent::ptr events[2];
+  for (int i = 0; i < 2; ++i) {
+    events[i] = std::make_shared<tinyrpc::TimerEvent>(0, false, [&timer, &events, i]() {
+      g_fired.push_back(i);
+      timer.delTimerEvent(events[1 - i]);
+    });
+    events[i]->m_arrive_time = arrive_time;
+    timer.addTimerEvent(events[i]);
+  }
+
+  tinyrpc::TimerEvent::ptr deleted = addEvent(timer, arrive_time - 100, 2);
+  timer.delTimerEvent(deleted);
+
+  g_fired.clear();
+  timer.expire(arrive_time);
+  assert(g_fired.size() == 1);
+  printf("delete succ\n");
+}
+
+// events beyond MAX_TICKS are parked at the end of wheel and moved again until they arrive
+static void testMaxTicks(tinyrpc::Timer& timer, int64_t base) {
+  int64_t max_ticks = tinyrpc::Timer::MAX_TICKS;
+  addEvent(timer, base + 3 * max_ticks + 7, 2);
+  addEvent(timer, base + max_ticks - 1, 1);
+
+  checkFireAt(timer, base + max_ticks - 1, {1});
+  checkFireAt(timer, base + 3 * max_ticks + 7, {2});
+  printf("max ticks succ\n");
+}
+
+// event which has expired when it's added fires at next expire
+static void testExpired(tinyrpc::Timer& timer, int64_t base) {
+  addEvent(timer, base - 1000, 1);
+  g_fired.clear();
+  timer.expire(base);
+  assert(g_fired == std::vector<int>{1});
+  printf("expired succ\n");
+}
+
+int main(int argc, char* argv[]) {
+  if (argc != 2) {
+    printf("Start test_timer error, input argc is not 2!");
+    printf("Start test_timer like this: \n");
+    printf("./test_timer a.xml\n");
+    return 0;
+  }
+
+  // log needs config only, don't start server
+  tinyrpc::gRpcConfig = std::make_shared<tinyrpc::Config>(argv[1]);
+  tinyrpc::gRpcConfig->m_log_level = tinyrpc::LogLevel::ERROR;
+
+  tinyrpc::Timer timer(tinyrpc::Reactor::GetReactor());
+
+  // wheel is at its creating time, every test starts from where the last one stopped
+  int64_t base = tinyrpc::getNowMs() + 1;
+  testCascade(timer, base);
+
+  base += (1 << 20) + 4;
+  testDelete(timer, base);
+
+  base += 5001;
+  testMaxTicks(timer, base);
+
+  base += 3 * tinyrpc::Timer::MAX_TICKS + 8;
+  testExpired(timer, base);
+
+  printf("test_timer succ\n");
+  return 0;
+}
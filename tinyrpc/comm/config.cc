@@ -127,11 +127,38 @@ void Config::readDBConfig(TiXmlElement* node) {
     if (char_set_e && char_set_e->GetText()) {
       option.m_char_set = std::string(char_set_e->GetText());
     }
+
+    TiXmlElement *pool_size_e = element->FirstChildElement("pool_size");
+    if (pool_size_e && pool_size_e->GetText()) {
+      option.m_pool_size = std::atoi(pool_size_e->GetText());
+    }
+
+    TiXmlElement *query_timeout_e = element->FirstChildElement("query_timeout");
+    if (query_timeout_e && query_timeout_e->GetText()) {
+      option.m_query_timeout = std::atoi(query_timeout_e->GetText());
+    }
+
+    TiXmlElement *ping_inteval_e = element->FirstChildElement("ping_inteval");
+    if (ping_inteval_e && ping_inteval_e->GetText()) {
+      option.m_ping_inteval = std::atoi(ping_inteval_e->GetText()) * 1000;
+    }
+
+    TiXmlElement *stmt_cache_size_e = element->FirstChildElement("stmt_cache_size");
+    if (stmt_cache_size_e && stmt_cache_size_e->GetText()) {
+      option.m_stmt_cache_size = std::atoi(stmt_cache_size_e->GetText());
+    }
+
+    if (option.m_pool_size <= 0 || option.m_query_timeout < 0 || option.m_ping_inteval <= 0 || option.m_stmt_cache_size < 0) {
+      printf("start tinyrpc server error! read config file [%s] error, [db_key.pool_size] and [db_key.ping_inteval] must be greater than 0, [db_key.query_timeout] and [db_key.stmt_cache_size] can't be negative\n", m_file_path.c_str());
+      exit(0);
+    }
+
     m_mysql_options.insert(std::make_pair(key, option));
     char buf[512];
-    sprintf(buf, "read config from file [%s], key:%s {addr: %s, user: %s, passwd: %s, select_db: %s, charset: %s}\n",
+    sprintf(buf, "read config from file [%s], key:%s {addr: %s, user: %s, passwd: %s, select_db: %s, charset: %s, pool_size: %d, query_timeout: %d ms, ping_inteval: %d s, stmt_cache_size: %d}\n",
       m_file_path.c_str(), key.c_str(), option.m_addr.toString().c_str(), option.m_user.c_str(),
-      option.m_passwd.c_str(), option.m_select_db.c_str(), option.m_char_set.c_str());
+      option.m_passwd.c_str(), option.m_select_db.c_str(), option.m_char_set.c_str(),
+      option.m_pool_size, option.m_query_timeout, option.m_ping_inteval / 1000, option.m_stmt_cache_size);
     std::string s(buf); 
     InfoLog << s;
 
@@ -142,6 +169,73 @@ void Config::readDBConfig(TiXmlElement* node) {
 }
 
 
+void Config::readClientConfig(TiXmlElement* node) {
+  TiXmlElement* pool_size_node = node->FirstChildElement("pool_size");
+  if (pool_size_node && pool_size_node->GetText()) {
+    m_client_pool_size = std::atoi(pool_size_node->GetText());
+  }
+  TiXmlElement* max_inflight_node = node->FirstChildElement("max_inflight");
+  if (max_inflight_node && max_inflight_node->GetText()) {
+    m_client_max_inflight = std::atoi(max_inflight_node->GetText());
+  }
+  TiXmlElement* max_idle_time_node = node->FirstChildElement("max_idle_time");
+  if (max_idle_time_node && max_idle_time_node->GetText()) {
+    m_client_max_idle_time = 1000 * std::atoi(max_idle_time_node->GetText());
+  }
+
+  if (m_client_pool_size <= 0 || m_client_max_inflight <= 0 || m_client_max_idle_time <= 0) {
+    printf("start tinyrpc server error! read config file [%s] error, [rpc_client.pool_size], [rpc_client.max_inflight] and [rpc_client.max_idle_time] must be greater than 0\n", m_file_path.c_str());
+    exit(0);
+  }
+
+  char buff[256];
+  sprintf(buff, "read rpc_client config: [pool_size: %d], [max_inflight: %d], [max_idle_time: %d s]\n",
+      m_client_pool_size, m_client_max_inflight, m_client_max_idle_time / 1000);
+  std::string s(buff);
+  InfoLog << s;
+}
+
+void Config::readReactorConfig(TiXmlElement* node) {
+  TiXmlElement* epoll_et_node = node->FirstChildElement("epoll_et");
+  if (epoll_et_node && epoll_et_node->GetText()) {
+    m_epoll_et = (std::atoi(epoll_et_node->GetText()) != 0);
+  }
+
+  TiXmlElement* backend_node = node->FirstChildElement("backend");
+  if (backend_node && backend_node->GetText()) {
+    m_reactor_backend = std::string(backend_node->GetText());
+    std::transform(m_reactor_backend.begin(), m_reactor_backend.end(), m_reactor_backend.begin(), tolower);
+  }
+  if (m_reactor_backend != "epoll" && m_reactor_backend != "io_uring") {
+    printf("start tinyrpc server error! read config file [%s] error, [reactor.backend] must be epoll or io_uring\n", m_file_path.c_str());
+    exit(0);
+  }
+
+  TiXmlElement* budget_node = node->FirstChildElement("schedule_budget");
+  if (budget_node && budget_node->GetText()) {
+    m_reactor_schedule_budget = std::atoi(budget_node->GetText());
+  }
+  if (m_reactor_schedule_budget <= 0) {
+    printf("start tinyrpc server error! read config file [%s] error, [reactor.schedule_budget] must be greater than 0\n", m_file_path.c_str());
+    exit(0);
+  }
+
+  TiXmlElement* slow_loop_node = node->FirstChildElement("slow_loop_threshold");
+  if (slow_loop_node && slow_loop_node->GetText()) {
+    m_reactor_slow_loop_threshold = std::atoi(slow_loop_node->GetText());
+  }
+  if (m_reactor_slow_loop_threshold < 0) {
+    printf("start tinyrpc server error! read config file [%s] error, [reactor.slow_loop_threshold] can't be negative\n", m_file_path.c_str());
+    exit(0);
+  }
+
+  char buff[256];
+  sprintf(buff, "read reactor config: [backend: %s], [epoll_et: %d], [schedule_budget: %d], [slow_loop_threshold: %d ms]\n",
+      m_reactor_backend.c_str(), m_epoll_et, m_reactor_schedule_budget, m_reactor_slow_loop_threshold);
+  std::string s(buff);
+  InfoLog << s;
+}
+
 void Config::readConf() {
   TiXmlElement* root = m_xml_file->RootElement();
   TiXmlElement* log_node = root->FirstChildElement("log");
@@ -178,6 +272,12 @@ void Config::readConf() {
   m_cor_stack_size = 1024 * cor_stack_size;
   m_cor_pool_size = std::atoi(coroutine_node->FirstChildElement("coroutine_pool_size")->GetText());
 
+  // optional, 0 means every coroutine has its own stack
+  TiXmlElement* share_stack_node = coroutine_node->FirstChildElement("share_stack_count");
+  if (share_stack_node && share_stack_node->GetText()) {
+    m_cor_share_stack_count = std::atoi(share_stack_node->GetText());
+  }
+
   if (!root->FirstChildElement("msg_req_len") || !root->FirstChildElement("msg_req_len")->GetText()) {
     printf("start tinyrpc server error! read config file [%s] error, cannot read [msg_req_len] xml node\n", m_file_path.c_str());
     exit(0);
@@ -212,6 +312,11 @@ void Config::readConf() {
   m_timewheel_bucket_num = std::atoi(time_wheel_node->FirstChildElement("bucket_num")->GetText());
   m_timewheel_inteval = std::atoi(time_wheel_node->FirstChildElement("inteval")->GetText());
 
+  TiXmlElement* reactor_node = root->FirstChildElement("reactor");
+  if (reactor_node) {
+    readReactorConfig(reactor_node);
+  }
+
   TiXmlElement* net_node = root->FirstChildElement("server");
   if (!net_node) {
     printf("start tinyrpc server error! read config file [%s] error, cannot read [server] xml node\n", m_file_path.c_str());
@@ -234,6 +339,20 @@ void Config::readConf() {
   std::string protocal = std::string(net_node->FirstChildElement("protocal")->GetText());
   std::transform(protocal.begin(), protocal.end(), protocal.begin(), toupper);
 
+  if (net_node->FirstChildElement("max_concurrent_requests") && net_node->FirstChildElement("max_concurrent_requests")->GetText()) {
+    m_server_max_concurrent_requests = std::atoi(net_node->FirstChildElement("max_concurrent_requests")->GetText());
+  }
+  if (net_node->FirstChildElement("reuse_port") && net_node->FirstChildElement("reuse_port")->GetText()) {
+    m_server_reuse_port = std::atoi(net_node->FirstChildElement("reuse_port")->GetText()) != 0;
+  }
+  if (net_node->FirstChildElement("listen_backlog") && net_node->FirstChildElement("listen_backlog")->GetText()) {
+    m_server_listen_backlog = std::atoi(net_node->FirstChildElement("listen_backlog")->GetText());
+    if (m_server_listen_backlog <= 0) {
+      printf("start tinyrpc server error! read config file [%s] error, [server.listen_backlog] must be greater than 0\n", m_file_path.c_str());
+      exit(0);
+    }
+  }
+
   tinyrpc::IPAddress::ptr addr = std::make_shared<tinyrpc::IPAddress>(ip, port);
 
   if (protocal == "HTTP") {
@@ -242,18 +361,25 @@ void Config::readConf() {
     gRpcServer = std::make_shared<TcpServer>(addr, TinyPb_Protocal);
   }
 
-  char buff[512];
+  char buff[1024];
   sprintf(buff, "read config from file [%s]: [log_path: %s], [log_prefix: %s], [log_max_size: %d MB], [log_level: %s], " 
-      "[coroutine_stack_size: %d KB], [coroutine_pool_size: %d], "
+      "[coroutine_stack_size: %d KB], [coroutine_pool_size: %d], [coroutine_share_stack_count: %d], "
       "[msg_req_len: %d], [max_connect_timeout: %d s], "
-      "[iothread_num:%d], [timewheel_bucket_num: %d], [timewheel_inteval: %d s], [server_ip: %s], [server_Port: %d], [server_protocal: %s]\n",
+      "[iothread_num:%d], [timewheel_bucket_num: %d], [timewheel_inteval: %d s], [server_ip: %s], [server_Port: %d], [server_protocal: %s], "
+      "[server_max_concurrent_requests: %d], [server_reuse_port: %d], [server_listen_backlog: %d]\n",
       m_file_path.c_str(), m_log_path.c_str(), m_log_prefix.c_str(), m_log_max_size / 1024 / 1024, 
-      levelToString(m_log_level).c_str(), cor_stack_size, m_cor_pool_size, m_msg_req_len,
-      max_connect_timeout, m_iothread_num, m_timewheel_bucket_num, m_timewheel_inteval, ip.c_str(), port, protocal.c_str());
+      levelToString(m_log_level).c_str(), cor_stack_size, m_cor_pool_size, m_cor_share_stack_count, m_msg_req_len,
+      max_connect_timeout, m_iothread_num, m_timewheel_bucket_num, m_timewheel_inteval, ip.c_str(), port, protocal.c_str(),
+      m_server_max_concurrent_requests, m_server_reuse_port, m_server_listen_backlog);
 
   std::string s(buff);
   InfoLog << s;
 
+  TiXmlElement* client_node = root->FirstChildElement("rpc_client");
+  if (client_node) {
+    readClientConfig(client_node);
+  }
+
   TiXmlElement* database_node = root->FirstChildElement("database");
 
   if (database_node) {
@@ -33,6 +33,10 @@ class Config {
 
   void readLogConfig(TiXmlElement* node);
 
+  void readClientConfig(TiXmlElement* node);
+
+  void readReactorConfig(TiXmlElement* node);
+
  public:
 
   // log params
@@ -46,6 +50,7 @@ class Config {
   // coroutine params
   int m_cor_stack_size {0};
   int m_cor_pool_size {0};
+  int m_cor_share_stack_count {0};    // shared stacks of every thread, coroutines of pool run on them if it's not 0
 
   int m_msg_req_len {0};
 
@@ -55,6 +60,30 @@ class Config {
   int m_timewheel_bucket_num {0};
   int m_timewheel_inteval {0};
 
+  // register hooked sockets once with EPOLLET instead of epoll_ctl on every EAGAIN
+  bool m_epoll_et {false};
+
+  // "epoll" or "io_uring", io_uring backend submits io of hooks to ring instead of waiting fd ready
+  std::string m_reactor_backend {"epoll"};
+
+  // max coroutines resumed by reactor in one loop, higher priority first
+  int m_reactor_schedule_budget {256};
+
+  // loop which runs longer than it (ms, waiting excluded) is logged, 0 -- don't log
+  int m_reactor_slow_loop_threshold {100};
+
+  // rpc client connection pool params
+  int m_client_pool_size {4};         // max connections to one peer addr of every io thread
+  int m_client_max_inflight {64};     // max rpc calls on one connection at the same time
+  int m_client_max_idle_time {60000}; // ms
+
+  // max requests of one server connection handled at the same time, 0 -- handle one by one
+  int m_server_max_concurrent_requests {0};
+
+  // every io thread listens on its own SO_REUSEPORT socket and accepts by itself
+  bool m_server_reuse_port {false};
+  int m_server_listen_backlog {1024};
+
   #ifdef DECLARE_MYSQL_PLUGIN 
   std::map<std::string, MySQLOption> m_mysql_options;
   #endif
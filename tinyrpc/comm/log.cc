@@ -10,6 +10,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <signal.h>
+#include <string.h>
+#include <algorithm>
 
 #ifdef DECLARE_MYSQL_PLUGIN 
 #include <mysql/mysql.h>
@@ -61,18 +63,6 @@ void setLogLevel(LogLevel level) {
 }
 
 
-LogEvent::LogEvent(LogLevel level, const char* file_name, int line, const char* func_name, LogType type)
-  : m_level(level),
-    m_file_name(file_name),
-    m_line(line),
-    m_func_name(func_name),
-    m_type(type) {
-}
-
-LogEvent::~LogEvent() {
-
-}
-
 std::string levelToString(LogLevel level) {
   std::string re = "DEBUG";
   switch(level) {
@@ -126,80 +116,398 @@ std::string LogTypeToString(LogType logtype) {
 }
 
 
-std::stringstream& LogEvent::getStringStream() {
+// format time at most once per ms in every thread
+static thread_local int64_t t_time_str_ms = -1;
+static thread_local time_t t_time_str_sec = -1;
+static thread_local char t_time_str[64];
+static thread_local size_t t_time_str_sec_len = 0;
 
-  // time_t now_time = m_timestamp;
-  
-  gettimeofday(&m_timeval, nullptr);
+// read for every line, so lines of a long reactor loop get their own time. coarse clock is cheap enough
+static int64_t getLogNowMs() {
+  timespec ts;
+  clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-  struct tm time; 
-  localtime_r(&(m_timeval.tv_sec), &time);
+static const char* getTimeString(int64_t now_ms) {
+  if (now_ms == t_time_str_ms) {
+    return t_time_str;
+  }
+  time_t sec = now_ms / 1000;
+  if (sec != t_time_str_sec) {
+    struct tm time; 
+    localtime_r(&sec, &time);
+    t_time_str_sec_len = strftime(t_time_str, sizeof(t_time_str), "%Y-%m-%d %H:%M:%S", &time);
+    t_time_str_sec = sec;
+  }
+  snprintf(t_time_str + t_time_str_sec_len, sizeof(t_time_str) - t_time_str_sec_len, ".%03d", (int)(now_ms % 1000));
+  t_time_str_ms = now_ms;
+  return t_time_str;
+}
 
-  const char* format = "%Y-%m-%d %H:%M:%S";
-  char buf[128];
-  strftime(buf, sizeof(buf), format, &time);
+static const char* levelToCString(LogLevel level) {
+  switch(level) {
+    case INFO:
+      return "INFO";
+    case WARN:
+      return "WARN";
+    case ERROR:
+      return "ERROR";
+    default:
+      return "DEBUG";
+  }
+}
 
-  m_ss << "[" << buf << "." << m_timeval.tv_usec << "]\t"; 
+// "[pid]\t[tid]\t" of this thread, it never changes
+static thread_local char t_id_str[64];
+static thread_local size_t t_id_str_len = 0;
+
+static const char* getIdString(size_t& len) {
+  if (t_id_str_len == 0) {
+    if (g_pid == 0) {
+      g_pid = getpid();
+    }
+    t_id_str_len = snprintf(t_id_str, sizeof(t_id_str), "[%d]\t[%d]\t", g_pid, gettid());
+  }
+  len = t_id_str_len;
+  return t_id_str;
+}
 
-  std::string s_level = levelToString(m_level);
-  m_ss << "[" << s_level << "]\t";
 
-  if (g_pid == 0) {
-    g_pid = getpid();
+static Mutex g_log_rings_mutex;
+static std::vector<LogRing*> g_log_rings[2];     // rings of all threads, index is RPC_LOG - 1 or APP_LOG - 1
+static LogRing* g_exited_log_rings[2] = {nullptr, nullptr};   // shared by lines logged after thread's rings are retired
+
+// rings of this thread are retired when it exits, logger thread deletes them after they're drained
+struct ThreadLogRings {
+  ~ThreadLogRings() {
+    for (int i = 0; i < 2; ++i) {
+      if (rings[i]) {
+        rings[i]->retire();
+        rings[i] = nullptr;
+      }
+    }
+    t_is_retired = true;
   }
-  m_pid = g_pid;  
 
-  if (t_thread_id == 0) {
-    t_thread_id = gettid();
+  LogRing* rings[2] {nullptr, nullptr};
+  // trivial, so it can still be read by thread_local destructors which run after ours
+  static thread_local bool t_is_retired;
+};
+
+thread_local bool ThreadLogRings::t_is_retired = false;
+static thread_local ThreadLogRings t_log_rings;
+
+// return true if AsyncLogger should be notified to write it now
+static bool pushToLogRing(LogType type, const char* data, size_t len) {
+  int i = type == APP_LOG ? 1 : 0;
+  if (ThreadLogRings::t_is_retired) {
+    // rare, such as a line logged by destructor of other thread_local. ring is shared, so lock it
+    Mutex::Lock lock(g_log_rings_mutex);
+    if (g_exited_log_rings[i] == nullptr) {
+      g_exited_log_rings[i] = new LogRing(Logger::THREAD_RING_SIZE);
+      g_log_rings[i].push_back(g_exited_log_rings[i]);
+    }
+    return g_exited_log_rings[i]->push(data, len);
   }
-  m_tid = t_thread_id;
-
-  m_cor_id = Coroutine::GetCurrentCoroutine()->getCorId();
-  
-  m_ss << "[" << m_pid << "]\t" 
-		<< "[" << m_tid << "]\t"
-		<< "[" << m_cor_id << "]\t"
-    << "[" << m_file_name << ":" << m_line << "]\t";
-    // << "[" << m_func_name << "]\t";
-  RunTime* runtime = getCurrentRunTime();
-  if (runtime) {
-    std::string msgno = runtime->m_msg_no;
-    if (!msgno.empty()) {
-      m_ss << "[" << msgno << "]\t";
+  if (t_log_rings.rings[i] == nullptr) {
+    t_log_rings.rings[i] = new LogRing(Logger::THREAD_RING_SIZE);
+    Mutex::Lock lock(g_log_rings_mutex);
+    g_log_rings[i].push_back(t_log_rings.rings[i]);
+  }
+  return t_log_rings.rings[i]->push(data, len);
+}
+
+static std::vector<LogRing*> getAllLogRings(LogType type) {
+  Mutex::Lock lock(g_log_rings_mutex);
+  return g_log_rings[type == APP_LOG ? 1 : 0];
+}
+
+// called by logger thread after rings are drained
+static void deleteLogRings(LogType type, const std::vector<LogRing*>& rings) {
+  if (rings.empty()) {
+    return;
+  }
+  std::vector<LogRing*>& all = g_log_rings[type == APP_LOG ? 1 : 0];
+  Mutex::Lock lock(g_log_rings_mutex);
+  for (size_t i = 0; i < rings.size(); ++i) {
+    all.erase(std::remove(all.begin(), all.end(), rings[i]), all.end());
+  }
+  lock.unlock();
+
+  for (size_t i = 0; i < rings.size(); ++i) {
+    delete rings[i];
+  }
+}
+
+
+LogRing::LogRing(size_t capacity) : m_capacity(capacity), m_mask(capacity - 1) {
+  m_data = new char[capacity];
+}
+
+LogRing::~LogRing() {
+  delete[] m_data;
+}
+
+bool LogRing::push(const char* data, size_t len) {
+  uint64_t write_pos = m_write_pos.load(std::memory_order_relaxed);
+  size_t used = write_pos - m_read_pos.load(std::memory_order_acquire);
+
+  // lines after overflow must go to overflow too, or they are written before it
+  if (m_overflow_size.load(std::memory_order_acquire) == 0 && len <= m_capacity - used) {
+    size_t offset = write_pos & m_mask;
+    size_t first = std::min(len, m_capacity - offset);
+    memcpy(m_data + offset, data, first);
+    memcpy(m_data, data + first, len - first);
+    m_write_pos.store(write_pos + len, std::memory_order_release);
+    used += len;
+  } else {
+    Mutex::Lock lock(m_overflow_mutex);
+    m_overflow.push_back(std::string(data, len));
+    m_overflow_size.store(m_overflow.size(), std::memory_order_release);
+    used = m_capacity;
+  }
+
+  if (used < m_capacity / 2) {
+    return false;
+  }
+  return !m_is_drain_requested.exchange(true, std::memory_order_relaxed);
+}
+
+size_t LogRing::writeTo(FILE* file) {
+  // all lines in ring are pushed before lines in overflow, so overflow is taken only if it's seen before ring
+  bool has_overflow = m_overflow_size.load(std::memory_order_acquire) > 0;
+
+  uint64_t read_pos = m_read_pos.load(std::memory_order_relaxed);
+  uint64_t write_pos = m_write_pos.load(std::memory_order_acquire);
+  size_t len = write_pos - read_pos;
+  if (len > 0 && file) {
+    size_t offset = read_pos & m_mask;
+    size_t first = std::min(len, m_capacity - offset);
+    fwrite(m_data + offset, 1, first, file);
+    if (len > first) {
+      fwrite(m_data, 1, len - first, file);
     }
+  }
+  m_read_pos.store(write_pos, std::memory_order_release);
 
-    std::string interface_name = runtime->m_interface_name;
-    if (!interface_name.empty()) {
-      m_ss << "[" << interface_name << "]\t";
+  if (has_overflow) {
+    std::vector<std::string> tmp;
+    Mutex::Lock lock(m_overflow_mutex);
+    tmp.swap(m_overflow);
+    m_overflow_size.store(0, std::memory_order_release);
+    lock.unlock();
+
+    for (size_t i = 0; i < tmp.size(); ++i) {
+      if (file) {
+        fwrite(tmp[i].c_str(), 1, tmp[i].length(), file);
+      }
+      len += tmp[i].length();
     }
+  }
+  m_is_drain_requested.store(false, std::memory_order_relaxed);
+  return len;
+}
+
+bool LogRing::empty() const {
+  return m_write_pos.load(std::memory_order_acquire) == m_read_pos.load(std::memory_order_relaxed)
+    && m_overflow_size.load(std::memory_order_acquire) == 0;
+}
+
+void LogRing::retire() {
+  m_is_retired.store(true, std::memory_order_release);
+}
+
+bool LogRing::isRetired() const {
+  return m_is_retired.load(std::memory_order_acquire);
+}
+
+
+LogStreamBuf::LogStreamBuf() : m_buffer(1024) {
+  reset();
+}
+
+void LogStreamBuf::reset() {
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
+
+void LogStreamBuf::grow(size_t need) {
+  size_t len = size();
+  size_t capacity = m_buffer.size();
+  while (capacity < len + need) {
+    capacity *= 2;
+  }
+  m_buffer.resize(capacity);
+  setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+  pbump(len);
+}
 
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c) {
+  if (traits_type::eq_int_type(c, traits_type::eof())) {
+    return traits_type::not_eof(c);
+  }
+  grow(1);
+  *pptr() = traits_type::to_char_type(c);
+  pbump(1);
+  return c;
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* s, std::streamsize n) {
+  if (epptr() - pptr() < n) {
+    grow(n);
+  }
+  memcpy(pptr(), s, n);
+  pbump(n);
+  return n;
+}
+
+
+static void appendInt(LogStreamBuf& buf, int value) {
+  char tmp[16];
+  char* end = tmp + sizeof(tmp);
+  char* p = end;
+  unsigned int v = value < 0 ? -(unsigned int)value : value;
+  do {
+    *--p = '0' + v % 10;
+    v /= 10;
+  } while (v);
+  if (value < 0) {
+    *--p = '-';
+  }
+  buf.sputn(p, end - p);
+}
+
+
+LogEvent::LogEvent() : m_ss(&m_buf) {
+  m_flags = m_ss.flags();
+}
+
+LogEvent::~LogEvent() {
+
+}
+
+std::ostream& LogEvent::begin(LogLevel level, const char* file_name, int line, const char* func_name, LogType type) {
+  m_level = level;
+  m_type = type;
+  m_buf.reset();
+  // last line may change format of stream
+  m_ss.clear();
+  m_ss.flags(m_flags);
+  m_ss.precision(6);
+  m_ss.fill(' ');
+
+  m_buf.sputc('[');
+  const char* time_str = getTimeString(getLogNowMs());
+  m_buf.sputn(time_str, strlen(time_str));
+  m_buf.sputn("]\t[", 3);
+  const char* level_str = levelToCString(level);
+  m_buf.sputn(level_str, strlen(level_str));
+  m_buf.sputn("]\t", 2);
+
+  size_t id_len = 0;
+  const char* id_str = getIdString(id_len);
+  m_buf.sputn(id_str, id_len);
+
+  // prefix is appended to buffer directly, it's much cheaper than formatting of stream
+  m_buf.sputc('[');
+  appendInt(m_buf, Coroutine::GetCurrentCoroutine()->getCorId());
+  m_buf.sputn("]\t[", 3);
+  m_buf.sputn(file_name, strlen(file_name));
+  m_buf.sputc(':');
+  appendInt(m_buf, line);
+  m_buf.sputn("]\t", 2);
+  // << "[" << func_name << "]\t";
+  RunTime* runtime = getCurrentRunTime();
+  if (runtime) {
+    if (!runtime->m_msg_no.empty()) {
+      m_buf.sputc('[');
+      m_buf.sputn(runtime->m_msg_no.c_str(), runtime->m_msg_no.length());
+      m_buf.sputn("]\t", 2);
+    }
+    if (!runtime->m_interface_name.empty()) {
+      m_buf.sputc('[');
+      m_buf.sputn(runtime->m_interface_name.c_str(), runtime->m_interface_name.length());
+      m_buf.sputn("]\t", 2);
+    }
   }
   return m_ss;
 }
 
+std::ostream& LogEvent::getStringStream() {
+  return m_ss;
+}
+
 void LogEvent::log() {
   if (m_level >= gRpcConfig->m_log_level) {
-    m_ss << "\n";
-    // printf("%s", m_ss.str().c_str());
-    if (m_type == RPC_LOG) {
-      gRpcLogger->pushRpcLog(m_ss.str());
-    } else if (m_type == APP_LOG) {
-      gRpcLogger->pushAppLog(m_ss.str());
+    m_buf.sputc('\n');
+    if (!pushToLogRing(m_type, m_buf.data(), m_buf.size())) {
+      return;
+    }
+    // ring is filling up, don't wait for sync inteval
+    AsyncLogger::ptr logger;
+    if (gRpcLogger) {
+      logger = m_type == APP_LOG ? gRpcLogger->getAsyncAppLogger() : gRpcLogger->getAsyncLogger();
+    }
+    if (logger) {
+      logger->notify();
     }
   }
 }
 
 
-LogTmp::LogTmp(LogEvent::ptr event) : m_event(event) {
+// events of this thread, a line which is logged while formatting another line
+// (or in other coroutine when the line yields) takes next one
+static const int THREAD_LOG_EVENT_COUNT = 4;
 
+// events of this thread are freed when it exits
+struct ThreadLogEvents {
+  ~ThreadLogEvents() {
+    for (int i = 0; i < THREAD_LOG_EVENT_COUNT; ++i) {
+      // one may be held by a coroutine which never resumes, leave it
+      if (events[i] && !events[i]->m_is_using) {
+        delete events[i];
+      }
+      events[i] = nullptr;
+    }
+    t_is_destroyed = true;
+  }
+
+  LogEvent* events[THREAD_LOG_EVENT_COUNT] {nullptr};
+  // trivial, so lines logged by thread_local destructors which run after ours can still check it
+  static thread_local bool t_is_destroyed;
+};
+
+thread_local bool ThreadLogEvents::t_is_destroyed = false;
+static thread_local ThreadLogEvents t_log_events;
+
+LogTmp::LogTmp(LogLevel level, const char* file_name, int line, const char* func_name, LogType type) {
+  for (int i = 0; i < THREAD_LOG_EVENT_COUNT && !ThreadLogEvents::t_is_destroyed; ++i) {
+    if (t_log_events.events[i] == nullptr) {
+      t_log_events.events[i] = new LogEvent();
+    }
+    if (!t_log_events.events[i]->m_is_using) {
+      m_event = t_log_events.events[i];
+      break;
+    }
+  }
+  if (m_event == nullptr) {
+    m_event = new LogEvent();
+    m_is_owned = true;
+  }
+  m_event->m_is_using = true;
+  m_event->begin(level, file_name, line, func_name, type);
 }
 
-std::stringstream& LogTmp::getStringStream() {
+std::ostream& LogTmp::getStringStream() {
   return m_event->getStringStream();
 }
 
 LogTmp::~LogTmp() {
   m_event->log(); 
+  m_event->m_is_using = false;
+  if (m_is_owned) {
+    delete m_event;
+  }
 }
 
 Logger::Logger() {
@@ -215,10 +523,9 @@ Logger::~Logger() {
 
 void Logger::init(const char* file_name, const char* file_path, int max_size, int sync_inteval) {
   if (!m_is_init) {
-    TimerEvent::ptr event = std::make_shared<TimerEvent>(sync_inteval, true, std::bind(&Logger::loopFunc, this));
-    Reactor::GetReactor()->getTimer()->addTimerEvent(event);
-    m_async_rpc_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, RPC_LOG);
-    m_async_app_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, APP_LOG);
+    // every thread pushes lines to its own ring, async loggers take them away every sync_inteval
+    m_async_rpc_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, RPC_LOG, sync_inteval);
+    m_async_app_logger = std::make_shared<AsyncLogger>(file_name, file_path, max_size, APP_LOG, sync_inteval);
 
     signal(SIGSEGV, CoredumpHandler);
     signal(SIGABRT, CoredumpHandler);
@@ -232,33 +539,8 @@ void Logger::init(const char* file_name, const char* file_path, int max_size, in
     m_is_init = true;
   }
 }
-	
-void Logger::loopFunc() {
-  std::vector<std::string> tmp;
-  std::vector<std::string> app_tmp;
-  Mutex::Lock lock(m_mutex);
-  tmp.swap(m_buffer);
-  app_tmp.swap(m_app_buffer);
-  lock.unlock();
-
-  m_async_rpc_logger->push(tmp);
-  m_async_app_logger->push(app_tmp);
-}
-
-void Logger::pushRpcLog(const std::string& msg) {
-  Mutex::Lock lock(m_mutex);
-  m_buffer.push_back(msg);
-  lock.unlock();
-}
-
-void Logger::pushAppLog(const std::string& msg) {
-  Mutex::Lock lock(m_mutex);
-  m_app_buffer.push_back(msg);
-  lock.unlock();
-}
 
 void Logger::flush() {
-  loopFunc();
   m_async_rpc_logger->stop();
   m_async_rpc_logger->flush();
 
@@ -266,9 +548,13 @@ void Logger::flush() {
   m_async_app_logger->flush();
 }
 
-AsyncLogger::AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logtype)
-  : m_file_name(file_name), m_file_path(file_path), m_max_size(max_size), m_log_type(logtype) {
+AsyncLogger::AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logtype, int sync_inteval)
+  : m_file_name(file_name), m_file_path(file_path), m_max_size(max_size), m_log_type(logtype), m_sync_inteval(sync_inteval) {
 
+  if (m_sync_inteval <= 0) {
+    m_sync_inteval = 1000;
+  }
+  pthread_cond_init(&m_condition, NULL);
   pthread_create(&m_thread, nullptr, &AsyncLogger::excute, this);
 }
 
@@ -278,20 +564,37 @@ AsyncLogger::~AsyncLogger() {
 
 void* AsyncLogger::excute(void* arg) {
   AsyncLogger* ptr = reinterpret_cast<AsyncLogger*>(arg);
-  pthread_cond_init(&ptr->m_condition, NULL);
 
   while (1) {
     Mutex::Lock lock(ptr->m_mutex);
 
-    while (ptr->m_tasks.empty()) {
-      pthread_cond_wait(&(ptr->m_condition), ptr->m_mutex.getMutex());
+    if (!ptr->m_stop && !ptr->m_is_notified) {
+      timespec abstime;
+      clock_gettime(CLOCK_REALTIME, &abstime);
+      int64_t nsec = abstime.tv_nsec + (int64_t)ptr->m_sync_inteval * 1000000;
+      abstime.tv_sec += nsec / 1000000000;
+      abstime.tv_nsec = nsec % 1000000000;
+      pthread_cond_timedwait(&(ptr->m_condition), ptr->m_mutex.getMutex(), &abstime);
     }
-    std::vector<std::string> tmp;
-    tmp.swap(ptr->m_tasks.front());
-    ptr->m_tasks.pop();
+    ptr->m_is_notified = false;
     bool is_stop = ptr->m_stop;
     lock.unlock();
 
+    std::vector<LogRing*> rings = getAllLogRings(ptr->m_log_type);
+    bool has_log = false;
+    for (size_t i = 0; i < rings.size(); ++i) {
+      if (!rings[i]->empty() || rings[i]->isRetired()) {
+        has_log = true;
+        break;
+      }
+    }
+    if (!has_log) {
+      if (is_stop) {
+        break;
+      }
+      continue;
+    }
+
     timeval now;
     gettimeofday(&now, nullptr);
 
@@ -326,7 +629,7 @@ void* AsyncLogger::excute(void* arg) {
       ptr->m_need_reopen = false;
     }
 
-    if (ftell(ptr->m_file_handle) > ptr->m_max_size) {
+    if (ptr->m_file_handle && ftell(ptr->m_file_handle) > ptr->m_max_size) {
       fclose(ptr->m_file_handle);
 
       // single log file over max size
@@ -344,46 +647,52 @@ void* AsyncLogger::excute(void* arg) {
       printf("open log file %s error!", full_file_name.c_str());
     }
 
-    for(auto i : tmp) {
-      fwrite(i.c_str(), 1, i.length(), ptr->m_file_handle);
-      // printf("succ write rt %d bytes ,[%s] to file[%s]", rt, i.c_str(), full_file_name.c_str());
+    // lines are consumed even if file can't be opened, or rings will be full
+    std::vector<LogRing*> retired_rings;
+    for (size_t i = 0; i < rings.size(); ++i) {
+      // all lines of a retired ring are pushed before it's retired, so it's empty after this write
+      bool is_retired = rings[i]->isRetired();
+      rings[i]->writeTo(ptr->m_file_handle);
+      if (is_retired) {
+        retired_rings.push_back(rings[i]);
+      }
+    }
+    deleteLogRings(ptr->m_log_type, retired_rings);
+    if (ptr->m_file_handle) {
+      fflush(ptr->m_file_handle);
     }
-    fflush(ptr->m_file_handle);
     if (is_stop) {
       break;
     }
 
   }
-  if (!ptr->m_file_handle) {
+  if (ptr->m_file_handle) {
     fclose(ptr->m_file_handle);
+    ptr->m_file_handle = nullptr;
   }
 
   return nullptr;
 
 }
 
-
-
-void AsyncLogger::push(std::vector<std::string>& buffer) {
-  if (!buffer.empty()) {
-    Mutex::Lock lock(m_mutex);
-    m_tasks.push(buffer);
-    lock.unlock();
-    pthread_cond_signal(&m_condition);
-  }
+void AsyncLogger::notify() {
+  Mutex::Lock lock(m_mutex);
+  m_is_notified = true;
+  lock.unlock();
+  pthread_cond_signal(&m_condition);
 }
 
 void AsyncLogger::flush() {
-  if (m_file_handle) {
-    fflush(m_file_handle);
-  }
+  // file is only touched by logger thread, let it write all lines now
+  notify();
 }
 
 
 void AsyncLogger::stop() {
-  if (!m_stop) {
-    m_stop = true;
-  }
+  Mutex::Lock lock(m_mutex);
+  m_stop = true;
+  lock.unlock();
+  pthread_cond_signal(&m_condition);
 }
 
 void Exit(int code) {
@@ -2,7 +2,10 @@
 #define TINYRPC_COMM_LOG_H
 
 #include <sstream>
-#include <sstream>
+#include <ostream>
+#include <atomic>
+#include <stdio.h>
+#include <stdint.h>
 #include <time.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -11,7 +14,7 @@
 #include <unistd.h>
 #include <memory>
 #include <vector>
-#include <queue>
+#include <string>
 #include "tinyrpc/net/mutex.h"
 #include "tinyrpc/comm/config.h"
 
@@ -27,71 +30,141 @@ enum LogType {
 
 #define DebugLog \
 	if (tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG).getStringStream()
 
 #define InfoLog \
 	if (tinyrpc::LogLevel::INFO >= tinyrpc::gRpcConfig->m_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG).getStringStream()
 
 #define WarnLog \
 	if (tinyrpc::LogLevel::WARN >= tinyrpc::gRpcConfig->m_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG).getStringStream()
 
 #define ErrorLog \
 	if (tinyrpc::LogLevel::ERROR >= tinyrpc::gRpcConfig->m_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, tinyrpc::LogType::RPC_LOG).getStringStream()
 
 
 #define AppDebugLog \
 	if (tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_app_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::DEBUG, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).getStringStream()
 
 #define AppInfoLog \
 	if (tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_app_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::INFO, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).getStringStream()
 
 #define AppWarnLog \
 	if (tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_app_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::WARN, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).getStringStream()
 
 #define AppErrorLog \
 	if (tinyrpc::LogLevel::DEBUG >= tinyrpc::gRpcConfig->m_app_log_level) \
-		tinyrpc::LogTmp(tinyrpc::LogEvent::ptr(new tinyrpc::LogEvent(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG))).getStringStream()
+		tinyrpc::LogTmp(tinyrpc::LogLevel::ERROR, __FILE__, __LINE__, __func__, tinyrpc::LogType::APP_LOG).getStringStream()
 
 pid_t gettid();
 
 LogLevel stringToLevel(const std::string& str);
 std::string levelToString(LogLevel level);
 
+//
+// Lines of one thread for one log type. Only the thread writes, only AsyncLogger thread reads.
+// When ring is full, lines go to an overflow list under mutex, so push never fails
+//
+class LogRing {
+ public:
+	// capacity must be power of 2
+	explicit LogRing(size_t capacity);
+
+	~LogRing();
+
+	// return true if AsyncLogger should be notified to write it now
+	bool push(const char* data, size_t len);
+
+	// write all lines to file and consume them, file can be nullptr
+	size_t writeTo(FILE* file);
+
+	bool empty() const;
+
+	// called when its thread exits, no line is pushed after it
+	void retire();
+
+	bool isRetired() const;
+
+ private:
+	char* m_data {nullptr};
+	size_t m_capacity {0};
+	size_t m_mask {0};
+
+	// keep writer and reader away from each other's cache line
+	char m_pad0[64];
+	std::atomic<uint64_t> m_write_pos {0};
+	char m_pad1[64];
+	std::atomic<uint64_t> m_read_pos {0};
+	char m_pad2[64];
+
+	std::atomic<bool> m_is_drain_requested {false};
+	std::atomic<bool> m_is_retired {false};
+	std::atomic<size_t> m_overflow_size {0};
+	Mutex m_overflow_mutex;
+	std::vector<std::string> m_overflow;
+
+};
+
+
+// Buffer of one line. It's reused by all lines of a thread, and only grows when a line is longer than any before
+class LogStreamBuf : public std::streambuf {
+ public:
+	LogStreamBuf();
+
+	void reset();
+
+	const char* data() const {
+		return pbase();
+	}
+
+	size_t size() const {
+		return pptr() - pbase();
+	}
+
+ protected:
+	int_type overflow(int_type c) override;
+
+	std::streamsize xsputn(const char* s, std::streamsize n) override;
+
+ private:
+	void grow(size_t need);
+
+ private:
+	std::vector<char> m_buffer;
+
+};
+
+
+// One line being formatted. Every thread keeps a few of them, so a line allocates nothing
 class LogEvent {
 
  public:
- 	
-	typedef std::shared_ptr<LogEvent> ptr;
-	LogEvent(LogLevel level, const char* file_name, int line, const char* func_name, LogType type);
+	LogEvent();
 
 	~LogEvent();
 
-	std::stringstream& getStringStream();
+	// write prefix of a new line
+	std::ostream& begin(LogLevel level, const char* file_name, int line, const char* func_name, LogType type);
+
+	std::ostream& getStringStream();
 
+	// end this line and push it to ring of this thread
 	void log();
 
+ public:
+	bool m_is_using {false};
 
  private:
-		
-	// uint64_t m_timestamp;
-	timeval m_timeval;
-	LogLevel m_level;
-	pid_t m_pid {0};
-	pid_t m_tid {0};
-	int m_cor_id {0};
-
-	const char* m_file_name;
-	int m_line {0};
-	const char* m_func_name;
-	LogType m_type;
-	std::string m_msg_no;
-	std::stringstream m_ss;
+	LogLevel m_level {DEBUG};
+	LogType m_type {RPC_LOG};
+	LogStreamBuf m_buf;
+	std::ostream m_ss;
+	std::ios_base::fmtflags m_flags;
 
 };
 
@@ -99,14 +172,15 @@ class LogEvent {
 class LogTmp {
  
  public:
-	explicit LogTmp(LogEvent::ptr event);
+	LogTmp(LogLevel level, const char* file_name, int line, const char* func_name, LogType type);
 
 	~LogTmp();
 
-	std::stringstream& getStringStream();
+	std::ostream& getStringStream();
 
  private:
-	LogEvent::ptr m_event;
+	LogEvent* m_event {nullptr};
+	bool m_is_owned {false};     // all events of this thread are being used, so m_event is new one
 
 };
 
@@ -114,10 +188,11 @@ class AsyncLogger {
  public:
   typedef std::shared_ptr<AsyncLogger> ptr;
 
-	AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logtype);
+	AsyncLogger(const char* file_name, const char* file_path, int max_size, LogType logtype, int sync_inteval);
 	~AsyncLogger();
 
-	void push(std::vector<std::string>& buffer);
+	// write logs of all threads now instead of waiting for sync inteval
+	void notify();
 
 	void flush();
 
@@ -125,14 +200,12 @@ class AsyncLogger {
 
 	void stop();
 
- public:
-	std::queue<std::vector<std::string>> m_tasks;
-
  private:
 	const char* m_file_name;
 	const char* m_file_path;
 	int m_max_size {0};
 	LogType m_log_type;
+	int m_sync_inteval {0};       // ms
 	int m_no {0};
 	bool m_need_reopen {false};
 	FILE* m_file_handle {nullptr};
@@ -141,6 +214,7 @@ class AsyncLogger {
  	Mutex m_mutex;
   pthread_cond_t m_condition;
 	bool m_stop {false};
+	bool m_is_notified {false};
 
  public:
   pthread_t m_thread;
@@ -151,14 +225,13 @@ class Logger {
  public:
   typedef std::shared_ptr<Logger> ptr;
 
+	// capacity of ring of every thread for every log type
+	static const size_t THREAD_RING_SIZE = 1 << 20;
+
 	Logger();
 	~Logger();
 
 	void init(const char* file_name, const char* file_path, int max_size, int sync_inteval);
-	void log();
-	void pushRpcLog(const std::string& log_msg);
-	void pushAppLog(const std::string& log_msg);
-	void loopFunc();
 
 	void flush();
 
@@ -170,12 +243,7 @@ class Logger {
 		return m_async_app_logger;
 	}
 
- public:
-	std::vector<std::string> m_buffer;
-	std::vector<std::string> m_app_buffer;
-
  private:
- 	Mutex m_mutex;
 	bool m_is_init {false};
 	AsyncLogger::ptr m_async_rpc_logger;
 	AsyncLogger::ptr m_async_app_logger;
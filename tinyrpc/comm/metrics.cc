@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include "tinyrpc/comm/metrics.h"
+
+
+namespace tinyrpc {
+
+static Mutex g_metrics_mutex;
+static std::vector<MetricsRegistry::ThreadMetrics*>* g_thread_metrics = nullptr;
+
+// upper bounds of prometheus histogram, us
+static const uint64_t g_histogram_bounds[] = {100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000, 10000000};
+
+static const double g_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+
+LatencyHistogram::LatencyHistogram() {
+  for (int i = 0; i < BUCKET_COUNT; ++i) {
+    m_buckets[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+uint64_t LatencyHistogram::getBucketMax(int index) {
+  if (index < SUB_BUCKET_COUNT) {
+    return index;
+  }
+  if (index >= BUCKET_COUNT - 1) {
+    return UINT64_MAX;
+  }
+  int shift = index / SUB_BUCKET_COUNT - 1;
+  uint64_t min = (uint64_t)(SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+  return min + (1ULL << shift) - 1;
+}
+
+
+HistogramSnapshot::HistogramSnapshot() : m_buckets(LatencyHistogram::BUCKET_COUNT, 0) {}
+
+void HistogramSnapshot::merge(const LatencyHistogram& histogram) {
+  for (int i = 0; i < LatencyHistogram::BUCKET_COUNT; ++i) {
+    m_buckets[i] += histogram.m_buckets[i].load(std::memory_order_relaxed);
+  }
+  m_count += histogram.m_count.load(std::memory_order_relaxed);
+  m_sum += histogram.m_sum.load(std::memory_order_relaxed);
+}
+
+uint64_t HistogramSnapshot::getQuantile(double q) const {
+  // buckets and count are read at different time, so count them again
+  uint64_t total = 0;
+  for (size_t i = 0; i < m_buckets.size(); ++i) {
+    total += m_buckets[i];
+  }
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t rank = std::max<uint64_t>(1, (uint64_t)ceil(q * total));
+  uint64_t count = 0;
+  for (size_t i = 0; i < m_buckets.size(); ++i) {
+    count += m_buckets[i];
+    if (count >= rank) {
+      return LatencyHistogram::getBucketMax(i);
+    }
+  }
+  return LatencyHistogram::getBucketMax(m_buckets.size() - 1);
+}
+
+uint64_t HistogramSnapshot::getCountBelow(uint64_t value) const {
+  uint64_t count = 0;
+  for (size_t i = 0; i < m_buckets.size(); ++i) {
+    // bucket which contains value is counted too, min of bucket i is max of bucket i - 1 plus 1
+    if (i > 0 && LatencyHistogram::getBucketMax(i - 1) >= value) {
+      break;
+    }
+    count += m_buckets[i];
+  }
+  return count;
+}
+
+
+void InterfaceMetrics::addError(int32_t err_code) {
+  // only this thread inserts, so find without lock
+  auto it = m_errors.find(err_code);
+  if (it == m_errors.end()) {
+    Mutex::Lock lock(m_mutex);
+    it = m_errors.insert(std::make_pair(err_code, std::unique_ptr<std::atomic<uint64_t>>(new std::atomic<uint64_t>(0)))).first;
+  }
+  add(*(it->second), 1);
+}
+
+
+MetricsRegistry::ThreadMetrics* MetricsRegistry::GetThreadMetrics() {
+  // it's never freed, registry may read it after thread exit
+  static thread_local ThreadMetrics* t_metrics = nullptr;
+  if (t_metrics) {
+    return t_metrics;
+  }
+  t_metrics = new ThreadMetrics();
+  Mutex::Lock lock(g_metrics_mutex);
+  if (!g_thread_metrics) {
+    g_thread_metrics = new std::vector<ThreadMetrics*>();
+  }
+  g_thread_metrics->push_back(t_metrics);
+  return t_metrics;
+}
+
+InterfaceMetrics* MetricsRegistry::GetInterfaceMetrics(const std::string& name) {
+  ThreadMetrics* thread_metrics = GetThreadMetrics();
+  auto it = thread_metrics->interfaces.find(name);
+  if (it != thread_metrics->interfaces.end()) {
+    return it->second.get();
+  }
+  Mutex::Lock lock(thread_metrics->mutex);
+  it = thread_metrics->interfaces.insert(std::make_pair(name, std::unique_ptr<InterfaceMetrics>(new InterfaceMetrics()))).first;
+  return it->second.get();
+}
+
+namespace {
+
+struct MergedMetrics {
+  uint64_t requests {0};
+  uint64_t request_bytes {0};
+  uint64_t response_bytes {0};
+  int64_t inflight {0};
+  HistogramSnapshot queue_time;
+  HistogramSnapshot handler_time;
+  std::map<int32_t, uint64_t> errors;
+};
+
+std::string escapeLabel(const std::string& value) {
+  std::string re;
+  for (size_t i = 0; i < value.size(); ++i) {
+    if (value[i] == '\\' || value[i] == '"') {
+      re += '\\';
+      re += value[i];
+    } else if (value[i] == '\n') {
+      re += "\\n";
+    } else {
+      re += value[i];
+    }
+  }
+  return re;
+}
+
+std::string formatSeconds(uint64_t us) {
+  char buf[64];
+  if (us % 1000000 == 0) {
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)(us / 1000000));
+  } else {
+    snprintf(buf, sizeof(buf), "%lu.%06lu", (unsigned long)(us / 1000000), (unsigned long)(us % 1000000));
+    // trailing zeros are useless, 0.000100 -> 0.0001
+    char* p = buf + strlen(buf) - 1;
+    while (*p == '0') {
+      *p-- = '\0';
+    }
+  }
+  return buf;
+}
+
+void writeHistogram(std::stringstream& ss, const std::string& name, const std::string& help,
+    const std::map<std::string, MergedMetrics>& metrics, HistogramSnapshot MergedMetrics::*member) {
+
+  ss << "# HELP " << name << "_seconds " << help << ", a bucket may count values up to 12.5% above its le\n";
+  ss << "# TYPE " << name << "_seconds histogram\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    const HistogramSnapshot& snapshot = it->second.*member;
+    std::string label = "interface=\"" + escapeLabel(it->first) + "\"";
+    uint64_t total = snapshot.getCountBelow(UINT64_MAX);
+    for (size_t i = 0; i < sizeof(g_histogram_bounds) / sizeof(g_histogram_bounds[0]); ++i) {
+      ss << name << "_seconds_bucket{" << label << ",le=\"" << formatSeconds(g_histogram_bounds[i]) << "\"} "
+        << snapshot.getCountBelow(g_histogram_bounds[i]) << "\n";
+    }
+    ss << name << "_seconds_bucket{" << label << ",le=\"+Inf\"} " << total << "\n";
+    ss << name << "_seconds_sum{" << label << "} " << formatSeconds(snapshot.m_sum) << "\n";
+    ss << name << "_seconds_count{" << label << "} " << total << "\n";
+  }
+
+  ss << "# HELP " << name << "_quantile_seconds estimated quantile of " << name << "_seconds\n";
+  ss << "# TYPE " << name << "_quantile_seconds gauge\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    const HistogramSnapshot& snapshot = it->second.*member;
+    std::string label = "interface=\"" + escapeLabel(it->first) + "\"";
+    for (size_t i = 0; i < sizeof(g_quantiles) / sizeof(g_quantiles[0]); ++i) {
+      ss << name << "_quantile_seconds{" << label << ",quantile=\"" << g_quantiles[i] << "\"} "
+        << formatSeconds(snapshot.getQuantile(g_quantiles[i])) << "\n";
+    }
+  }
+}
+
+}
+
+std::string MetricsRegistry::ToPrometheusText() {
+  std::map<std::string, MergedMetrics> metrics;
+
+  Mutex::Lock lock(g_metrics_mutex);
+  std::vector<ThreadMetrics*> threads;
+  if (g_thread_metrics) {
+    threads = *g_thread_metrics;
+  }
+  lock.unlock();
+
+  for (size_t i = 0; i < threads.size(); ++i) {
+    ThreadMetrics* thread_metrics = threads[i];
+    Mutex::Lock thread_lock(thread_metrics->mutex);
+    for (auto it = thread_metrics->interfaces.begin(); it != thread_metrics->interfaces.end(); ++it) {
+      InterfaceMetrics* im = it->second.get();
+      MergedMetrics& merged = metrics[it->first];
+      merged.requests += im->m_requests.load(std::memory_order_relaxed);
+      merged.request_bytes += im->m_request_bytes.load(std::memory_order_relaxed);
+      merged.response_bytes += im->m_response_bytes.load(std::memory_order_relaxed);
+      merged.inflight += im->m_inflight.load(std::memory_order_relaxed);
+      merged.queue_time.merge(im->m_queue_time);
+      merged.handler_time.merge(im->m_handler_time);
+
+      Mutex::Lock error_lock(im->m_mutex);
+      for (auto err = im->m_errors.begin(); err != im->m_errors.end(); ++err) {
+        merged.errors[err->first] += err->second->load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  std::stringstream ss;
+  ss << "# HELP tinyrpc_requests_total requests dispatched to handler\n";
+  ss << "# TYPE tinyrpc_requests_total counter\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    ss << "tinyrpc_requests_total{interface=\"" << escapeLabel(it->first) << "\"} " << it->second.requests << "\n";
+  }
+
+  ss << "# HELP tinyrpc_errors_total requests failed, by err_code of TinyPb or status code of Http\n";
+  ss << "# TYPE tinyrpc_errors_total counter\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    for (auto err = it->second.errors.begin(); err != it->second.errors.end(); ++err) {
+      ss << "tinyrpc_errors_total{interface=\"" << escapeLabel(it->first) << "\",code=\"" << err->first << "\"} "
+        << err->second << "\n";
+    }
+  }
+
+  ss << "# HELP tinyrpc_request_bytes_total bytes of decoded requests\n";
+  ss << "# TYPE tinyrpc_request_bytes_total counter\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    ss << "tinyrpc_request_bytes_total{interface=\"" << escapeLabel(it->first) << "\"} " << it->second.request_bytes << "\n";
+  }
+
+  ss << "# HELP tinyrpc_response_bytes_total bytes of encoded responses\n";
+  ss << "# TYPE tinyrpc_response_bytes_total counter\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    ss << "tinyrpc_response_bytes_total{interface=\"" << escapeLabel(it->first) << "\"} " << it->second.response_bytes << "\n";
+  }
+
+  ss << "# HELP tinyrpc_inflight_requests requests being handled\n";
+  ss << "# TYPE tinyrpc_inflight_requests gauge\n";
+  for (auto it = metrics.begin(); it != metrics.end(); ++it) {
+    ss << "tinyrpc_inflight_requests{interface=\"" << escapeLabel(it->first) << "\"} " << it->second.inflight << "\n";
+  }
+
+  writeHistogram(ss, "tinyrpc_queue_time", "time from request decoded to handler started",
+      metrics, &MergedMetrics::queue_time);
+  writeHistogram(ss, "tinyrpc_handler_time", "time spent in handler",
+      metrics, &MergedMetrics::handler_time);
+
+  return ss.str();
+}
+
+}
@@ -0,0 +1,160 @@
+#ifndef TINYRPC_COMM_METRICS_H
+#define TINYRPC_COMM_METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <map>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "tinyrpc/net/mutex.h"
+
+namespace tinyrpc {
+
+//
+// Latency histogram of us in log-linear buckets like HdrHistogram.
+// Every power of 2 is split into 8 sub buckets, so a value is kept with at most 12.5% error.
+// Only the owner thread records, others can read it at any time
+//
+class LatencyHistogram {
+ public:
+  static const int SUB_BUCKET_BITS = 3;
+  static const int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+  static const int MAX_EXPONENT = 40;       // values >= 2^40 us are counted in last bucket
+  static const int BUCKET_COUNT = (MAX_EXPONENT - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+  LatencyHistogram();
+
+  void record(int64_t value) {
+    uint64_t v = value > 0 ? value : 0;
+    int index = getBucketIndex(v);
+    // single writer, so load and store is enough and cheaper than fetch_add
+    m_buckets[index].store(m_buckets[index].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_count.store(m_count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    m_sum.store(m_sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+  }
+
+  static int getBucketIndex(uint64_t value) {
+    if (value < (uint64_t)SUB_BUCKET_COUNT) {
+      return value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    if (exponent >= MAX_EXPONENT) {
+      return BUCKET_COUNT - 1;
+    }
+    int shift = exponent - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+  }
+
+  // max value which is counted in bucket of index
+  static uint64_t getBucketMax(int index);
+
+ private:
+  friend class HistogramSnapshot;
+
+  std::atomic<uint64_t> m_buckets[BUCKET_COUNT];
+  std::atomic<uint64_t> m_count {0};
+  std::atomic<uint64_t> m_sum {0};
+
+};
+
+
+// merged copy of LatencyHistograms
+class HistogramSnapshot {
+ public:
+  HistogramSnapshot();
+
+  void merge(const LatencyHistogram& histogram);
+
+  // estimated value at quantile q (0 - 1), it's max value of bucket
+  uint64_t getQuantile(double q) const;
+
+  // count of values <= value, and of values in the same bucket as value.
+  // so it's never less than exact count, and may count values up to 12.5% greater than value
+  uint64_t getCountBelow(uint64_t value) const;
+
+ public:
+  std::vector<uint64_t> m_buckets;
+  uint64_t m_count {0};
+  uint64_t m_sum {0};
+
+};
+
+
+//
+// Metrics of one interface (service_full_name of TinyPb, servlet name of Http) in one thread
+//
+class InterfaceMetrics {
+ public:
+  InterfaceMetrics() = default;
+
+  // handler of a request starts, queue_time is from it's decoded to now
+  void begin(int64_t queue_time, int64_t request_bytes) {
+    add(m_requests, 1);
+    add(m_request_bytes, request_bytes);
+    add(m_inflight, 1);
+    m_queue_time.record(queue_time);
+  }
+
+  void end(int64_t handler_time, int32_t err_code, int64_t response_bytes) {
+    add(m_response_bytes, response_bytes);
+    add(m_inflight, -1);
+    m_handler_time.record(handler_time);
+    if (err_code != 0) {
+      addError(err_code);
+    }
+  }
+
+ private:
+  friend class MetricsRegistry;
+
+  template <typename T>
+  static void add(std::atomic<T>& counter, int64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+
+  void addError(int32_t err_code);
+
+ private:
+  std::atomic<uint64_t> m_requests {0};
+  std::atomic<uint64_t> m_request_bytes {0};
+  std::atomic<uint64_t> m_response_bytes {0};
+  std::atomic<int64_t> m_inflight {0};
+  LatencyHistogram m_queue_time;
+  LatencyHistogram m_handler_time;
+
+  // err_code -> count, a new code is inserted with lock because registry may be reading it
+  Mutex m_mutex;
+  std::map<int32_t, std::unique_ptr<std::atomic<uint64_t>>> m_errors;
+
+};
+
+
+//
+// Every thread records requests to its own metrics without lock,
+// registry merges metrics of all threads when they are read, such as by MetricsHttpServlet
+//
+class MetricsRegistry {
+ public:
+  // metrics of interface in current thread, it's created at first call
+  static InterfaceMetrics* GetInterfaceMetrics(const std::string& name);
+
+  // merged metrics of all threads in prometheus text format
+  static std::string ToPrometheusText();
+
+ public:
+  struct ThreadMetrics {
+    // insertion is locked, lookup by owner thread isn't
+    Mutex mutex;
+    std::unordered_map<std::string, std::unique_ptr<InterfaceMetrics>> interfaces;
+  };
+
+ private:
+  static ThreadMetrics* GetThreadMetrics();
+
+};
+
+}
+
+#endif
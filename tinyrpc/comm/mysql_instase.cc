@@ -4,12 +4,20 @@
 #include <mysql/errmsg.h>
 #endif
 
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 #include "tinyrpc/comm/mysql_instase.h"
 #include "tinyrpc/comm/config.h"
 #include "tinyrpc/comm/log.h"
 #include "tinyrpc/coroutine/coroutine_hook.h"
+#include "tinyrpc/coroutine/coroutine_pool.h"
+#include "tinyrpc/net/reactor.h"
+#include "tinyrpc/net/timer.h"
 
 extern tinyrpc::Config::ptr gRpcConfig;
+extern poll_fun_ptr_t g_sys_poll_fun;
 
 namespace tinyrpc {
 
@@ -17,6 +25,43 @@ namespace tinyrpc {
 
 static thread_local MySQLInstaseFactroy* t_mysql_factory = NULL;
 
+#ifdef TINYRPC_MYSQL_NONBLOCKING
+
+// a pending call is woken up by this inteval even if socket isn't ready, ms.
+// libmysqlclient doesn't tell whether it waits to read or to write
+static const int MYSQL_WAIT_SLICE = 10;
+
+// yield until socket of mysql may make progress
+static void waitMySQLSocket(MYSQL* handler) {
+  struct pollfd pfd;
+  pfd.fd = handler->net.fd;
+  pfd.events = POLLIN;
+  pfd.revents = 0;
+  // send buffer is full, request is still being sent
+  struct pollfd out = pfd;
+  out.events = POLLOUT;
+  if (g_sys_poll_fun(&out, 1, 0) == 0) {
+    pfd.events |= POLLOUT;
+  }
+  tinyrpc::poll_hook(&pfd, 1, MYSQL_WAIT_SLICE);
+}
+
+// call func until it's done, return NET_ASYNC_NOT_READY if deadline is reached first
+template <typename Func>
+static net_async_status callNonBlocking(MYSQL* handler, const ScopedDeadline& deadline, Func func) {
+  net_async_status status = func();
+  while (status == NET_ASYNC_NOT_READY) {
+    if (deadline.isExpired()) {
+      return status;
+    }
+    waitMySQLSocket(handler);
+    status = func();
+  }
+  return status;
+}
+
+#endif
+
 
 MySQLThreadInit::MySQLThreadInit() {
   DebugLog << "<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<<< call mysql_thread_init";
@@ -48,15 +93,25 @@ MySQLInstase::ptr MySQLInstaseFactroy::GetMySQLInstase(const std::string& key) {
   return instase;
 }
 
-
-MySQLInstase::MySQLInstase(const MySQLOption& option) : m_option(option) {
-  int ret = reconnect();
-  if (ret != 0) {
-    return;
+MySQLInstasePool::ptr MySQLInstaseFactroy::GetMySQLInstasePool(const std::string& key) {
+  auto it = m_pools.find(key);
+  if (it != m_pools.end()) {
+    return it->second;
+  }
+  auto it2 = gRpcConfig->m_mysql_options.find(key);
+  if (it2 == gRpcConfig->m_mysql_options.end()) {
+    ErrorLog << "get MySQLInstasePool error, not this key[" << key << "] exist";
+    return NULL;
   }
+  DebugLog << "create MySQLInstasePool of key " << key;
+  MySQLInstasePool::ptr pool = std::make_shared<MySQLInstasePool>(key, it2->second);
+  m_pools.insert(std::make_pair(key, pool));
+  return pool;
+}
 
-  m_init_succ = true;
 
+MySQLInstase::MySQLInstase(const MySQLOption& option) : m_option(option) {
+  reconnect();
 }
 
 int MySQLInstase::reconnect() {
@@ -68,6 +123,7 @@ int MySQLInstase::reconnect() {
   if (m_sql_handler) {
     mysql_close(m_sql_handler);
     m_sql_handler = NULL;
+    clearStatements();
   }
 
   Mutex::Lock lock(m_mutex);
@@ -87,24 +143,67 @@ int MySQLInstase::reconnect() {
     << ", user:" << m_option.m_user << ", passwd:" << m_option.m_passwd << ", select_db: "<< m_option.m_select_db << "charset:" << m_option.m_char_set << "}";
   // mysql_real_connect(m_sql_handler, m_option.m_addr.getIP().c_str(), m_option.m_user.c_str(), 
   //     m_option.m_passwd.c_str(), m_option.m_select_db.c_str(), m_option.m_addr.getPort(), NULL, 0);
+#ifdef TINYRPC_MYSQL_NONBLOCKING
+  ScopedDeadline deadline(gRpcConfig->m_max_connect_timeout);
+  net_async_status status = callNonBlocking(m_sql_handler, deadline, [this]() {
+    return mysql_real_connect_nonblocking(m_sql_handler, m_option.m_addr.getIP().c_str(), m_option.m_user.c_str(),
+        m_option.m_passwd.c_str(), m_option.m_select_db.c_str(), m_option.m_addr.getPort(), NULL, 0);
+  });
+  if (status != NET_ASYNC_COMPLETE) {
+    std::string err_info = status == NET_ASYNC_NOT_READY ? "connect timeout" : mysql_error(m_sql_handler);
+#else
   if (!mysql_real_connect(m_sql_handler, m_option.m_addr.getIP().c_str(), m_option.m_user.c_str(), 
       m_option.m_passwd.c_str(), m_option.m_select_db.c_str(), m_option.m_addr.getPort(), NULL, 0)) {
+    std::string err_info = mysql_error(m_sql_handler);
+#endif
 
-    ErrorLog << "faild to call mysql_real_connect, peer addr[ " << m_option.m_addr.getIP() << ":" << m_option.m_addr.getPort() << "], mysql sys errinfo[" << mysql_error(m_sql_handler) << "]";
+    ErrorLog << "faild to call mysql_real_connect, peer addr[ " << m_option.m_addr.getIP() << ":" << m_option.m_addr.getPort() << "], mysql sys errinfo[" << err_info << "]";
+    closeHandler(err_info, CR_SERVER_LOST);
+    m_init_succ = false;
     return -1;
   }
   DebugLog << "mysql_handler connect succ";
+  m_init_succ = true;
+  m_in_trans = false;
+  m_last_active_time = getNowMs();
   return 0;
 }
 
+void MySQLInstase::closeHandler(const std::string& err_info, int err_no) {
+  m_err_info = err_info;
+  m_errno = err_no;
+  if (m_sql_handler) {
+    mysql_close(m_sql_handler);
+    m_sql_handler = NULL;
+    clearStatements();
+  }
+}
+
 bool MySQLInstase::isInitSuccess() {
   return m_init_succ;
 }
 
+bool MySQLInstase::isBroken() {
+  return m_sql_handler == NULL;
+}
+
+bool MySQLInstase::isInTrans() {
+  return m_in_trans;
+}
+
+void MySQLInstase::setAutoReconnect(bool value) {
+  m_auto_reconnect = value;
+}
+
+int64_t MySQLInstase::getLastActiveTime() {
+  return m_last_active_time;
+}
+
 MySQLInstase::~MySQLInstase() {
   if (m_sql_handler) {
     mysql_close(m_sql_handler);
     m_sql_handler = NULL;
+    clearStatements();
   }
 }
 
@@ -133,30 +232,51 @@ int MySQLInstase::rollBack() {
 }
 
 int MySQLInstase::query(const std::string& sql) {
-  if (!m_init_succ) {
-    ErrorLog << "query error, mysql_handler init faild";
-    return -1;
-  }
-  if (!m_sql_handler) {
+  if (!m_sql_handler && m_auto_reconnect) {
     DebugLog << "*************** will reconnect mysql ";
     reconnect();
   }
   if (!m_sql_handler) {
-    DebugLog << "reconnect error, query return -1";
+    ErrorLog << "query error, mysql_handler isn't connected";
     return -1;
   }
 
   DebugLog << "begin to excute sql[" << sql << "]";
+#ifdef TINYRPC_MYSQL_NONBLOCKING
+  ScopedDeadline deadline(m_option.m_query_timeout);
+  net_async_status status = callNonBlocking(m_sql_handler, deadline, [this, &sql]() {
+    return mysql_real_query_nonblocking(m_sql_handler, sql.c_str(), sql.length());
+  });
+  if (status == NET_ASYNC_NOT_READY) {
+    // result of query will come later, this connection can't be used any more
+    ErrorLog << "excute mysql_real_query timeout, sql[" << sql << "], over " << m_option.m_query_timeout << " ms";
+    closeHandler("query timeout", CR_SERVER_LOST);
+    m_in_trans = false;
+    return -1;
+  }
+  int rt = status == NET_ASYNC_COMPLETE ? 0 : -1;
+#else
   int rt = mysql_real_query(m_sql_handler, sql.c_str(), sql.length());
+#endif
+  m_last_active_time = getNowMs();
   if (rt != 0) {
     ErrorLog << "excute mysql_real_query error, sql[" << sql << "], mysql sys errinfo[" << mysql_error(m_sql_handler) << "]"; 
     // if connect error, begin to reconnect
     if (mysql_errno(m_sql_handler) == CR_SERVER_GONE_ERROR || mysql_errno(m_sql_handler) == CR_SERVER_LOST) {
+      bool in_trans = m_in_trans;
+      if (!m_auto_reconnect) {
+        // reconnected by its owner later
+        closeHandler(mysql_error(m_sql_handler), mysql_errno(m_sql_handler));
+        m_in_trans = false;
+        return rt;
+      }
       
-      rt = reconnect();
-      if (rt != 0 && !m_in_trans) {
+      int ret = reconnect();
+      if (ret == 0 && !in_trans) {
         // if reconnect succ, and current is not a trans, can do query sql again 
-        rt = mysql_real_query(m_sql_handler, sql.c_str(), sql.length());
+        m_auto_reconnect = false;
+        rt = query(sql);
+        m_auto_reconnect = true;
         return rt;
       }
     }
@@ -166,14 +286,123 @@ int MySQLInstase::query(const std::string& sql) {
   return rt;
 }
 
+int MySQLInstase::ping() {
+  int rt = query("SELECT 1;");
+  if (rt != 0) {
+    return rt;
+  }
+  MYSQL_RES* res = storeResult();
+  freeResult(res);
+  return m_sql_handler ? 0 : -1;
+}
+
+MySQLStatement::ptr MySQLInstase::prepare(const std::string& sql) {
+  auto it = m_stmts.find(sql);
+  if (it != m_stmts.end()) {
+    m_stmt_lru.splice(m_stmt_lru.begin(), m_stmt_lru, it->second.second);
+    return it->second.first;
+  }
+
+  if (!m_sql_handler && m_auto_reconnect) {
+    DebugLog << "*************** will reconnect mysql ";
+    reconnect();
+  }
+  if (!m_sql_handler) {
+    ErrorLog << "prepare error, mysql_handler isn't connected";
+    return NULL;
+  }
+
+  MYSQL_STMT* stmt = mysql_stmt_init(m_sql_handler);
+  if (!stmt) {
+    ErrorLog << "faild to call mysql_stmt_init, mysql sys errinfo[" << mysql_error(m_sql_handler) << "]";
+    return NULL;
+  }
+  // stmt api has no nonblocking version, it yields in hooks of recv and send
+  ScopedDeadline deadline(m_option.m_query_timeout);
+  if (mysql_stmt_prepare(stmt, sql.c_str(), sql.length()) != 0) {
+    ErrorLog << "excute mysql_stmt_prepare error, sql[" << sql << "], mysql sys errinfo[" << mysql_stmt_error(stmt) << "]";
+    int err_no = mysql_stmt_errno(stmt);
+    std::string err_info = mysql_stmt_error(stmt);
+    mysql_stmt_close(stmt);
+    if (err_no == CR_SERVER_GONE_ERROR || err_no == CR_SERVER_LOST) {
+      closeHandler(err_info, err_no);
+      m_in_trans = false;
+    }
+    return NULL;
+  }
+  m_last_active_time = getNowMs();
+
+  MySQLStatement::ptr tmp = std::make_shared<MySQLStatement>(stmt, sql);
+  if (!tmp->bindResult()) {
+    return NULL;
+  }
+  m_stmt_lru.push_front(sql);
+  m_stmts[sql] = std::make_pair(tmp, m_stmt_lru.begin());
+  while ((int)m_stmt_lru.size() > m_option.m_stmt_cache_size) {
+    // it's closed when its last user releases it
+    m_stmts.erase(m_stmt_lru.back());
+    m_stmt_lru.pop_back();
+  }
+  DebugLog << "prepare sql[" << sql << "] success";
+  return tmp;
+}
+
+int MySQLInstase::execute(MySQLStatement::ptr stmt) {
+  if (!stmt || stmt->isClosed()) {
+    ErrorLog << "execute error, statement has been closed";
+    return -1;
+  }
+
+  ScopedDeadline deadline(m_option.m_query_timeout);
+  int rt = stmt->execute();
+  m_last_active_time = getNowMs();
+  if (rt != 0) {
+    ErrorLog << "excute mysql_stmt_execute error, sql[" << stmt->getSql() << "], mysql sys errinfo[" << stmt->getErrorInfo() << "]";
+    if (stmt->getErrno() == CR_SERVER_GONE_ERROR || stmt->getErrno() == CR_SERVER_LOST) {
+      // statements are lost with connection, it's reconnected when next query if auto reconnect
+      closeHandler(stmt->getErrorInfo(), stmt->getErrno());
+      m_in_trans = false;
+    }
+    return rt;
+  }
+  DebugLog << "excute mysql_stmt_execute success, sql[" << stmt->getSql() << "]";
+  return 0;
+}
+
+void MySQLInstase::clearStatements() {
+  for (auto it = m_stmts.begin(); it != m_stmts.end(); ++it) {
+    it->second.first->close();
+  }
+  m_stmts.clear();
+  m_stmt_lru.clear();
+}
+
 MYSQL_RES* MySQLInstase::storeResult() {
   if (!m_init_succ) {
     ErrorLog << "query error, mysql_handler init faild";
     return NULL;
   }
+  if (!m_sql_handler) {
+    ErrorLog << "store result error, mysql_handler isn't connected";
+    return NULL;
+  }
   int count = mysql_field_count(m_sql_handler);
   if (count != 0) {
+#ifdef TINYRPC_MYSQL_NONBLOCKING
+    MYSQL_RES* res = NULL;
+    ScopedDeadline deadline(m_option.m_query_timeout);
+    net_async_status status = callNonBlocking(m_sql_handler, deadline, [this, &res]() {
+      return mysql_store_result_nonblocking(m_sql_handler, &res);
+    });
+    if (status == NET_ASYNC_NOT_READY) {
+      ErrorLog << "excute mysql_store_result timeout, over " << m_option.m_query_timeout << " ms";
+      closeHandler("store result timeout", CR_SERVER_LOST);
+      m_in_trans = false;
+      return NULL;
+    }
+#else
     MYSQL_RES* res = mysql_store_result(m_sql_handler);
+#endif
     if (!res) {
       ErrorLog << "excute mysql_store_result error, mysql sys errinfo[" << mysql_error(m_sql_handler) << "]";
     } else {
@@ -222,19 +451,515 @@ long long MySQLInstase::affectedRows() {
     ErrorLog << "query error, mysql_handler init faild";
     return -1;
   }
+  if (!m_sql_handler) {
+    return -1;
+  }
   return mysql_affected_rows(m_sql_handler);
 
 }
 
 
 std::string MySQLInstase::getMySQLErrorInfo() {
+  if (!m_sql_handler) {
+    return m_err_info;
+  }
   return std::string(mysql_error(m_sql_handler));
 }
 
 int MySQLInstase::getMySQLErrno() {
+  if (!m_sql_handler) {
+    return m_errno;
+  }
   return mysql_errno(m_sql_handler);
 }
 
+
+MySQLStatement::MySQLStatement(MYSQL_STMT* stmt, const std::string& sql) : m_stmt(stmt), m_sql(sql) {
+  m_params.resize(mysql_stmt_param_count(m_stmt));
+  m_param_binds.resize(m_params.size());
+}
+
+MySQLStatement::~MySQLStatement() {
+  close();
+}
+
+void MySQLStatement::close() {
+  if (m_stmt) {
+    mysql_stmt_close(m_stmt);
+    m_stmt = NULL;
+  }
+}
+
+const std::string& MySQLStatement::getSql() {
+  return m_sql;
+}
+
+bool MySQLStatement::isClosed() {
+  return m_stmt == NULL;
+}
+
+MySQLStatement::Param* MySQLStatement::getParam(int idx) {
+  if (idx < 0 || idx >= (int)m_params.size()) {
+    ErrorLog << "bind param error, sql[" << m_sql << "] has " << m_params.size() << " params, index " << idx << " is out of range";
+    return NULL;
+  }
+  return &m_params[idx];
+}
+
+void MySQLStatement::bindNull(int idx) {
+  Param* param = getParam(idx);
+  if (param) {
+    param->type = MYSQL_TYPE_NULL;
+  }
+}
+
+void MySQLStatement::bindInt64(int idx, int64_t value) {
+  Param* param = getParam(idx);
+  if (param) {
+    param->type = MYSQL_TYPE_LONGLONG;
+    param->is_unsigned = false;
+    param->int_value = value;
+  }
+}
+
+void MySQLStatement::bindUint64(int idx, uint64_t value) {
+  Param* param = getParam(idx);
+  if (param) {
+    param->type = MYSQL_TYPE_LONGLONG;
+    param->is_unsigned = true;
+    param->int_value = static_cast<int64_t>(value);
+  }
+}
+
+void MySQLStatement::bindDouble(int idx, double value) {
+  Param* param = getParam(idx);
+  if (param) {
+    param->type = MYSQL_TYPE_DOUBLE;
+    param->double_value = value;
+  }
+}
+
+void MySQLStatement::bindString(int idx, const std::string& value) {
+  Param* param = getParam(idx);
+  if (param) {
+    param->type = MYSQL_TYPE_STRING;
+    param->str_value = value;
+  }
+}
+
+bool MySQLStatement::bindResult() {
+  if (m_columns.empty()) {
+    MYSQL_RES* meta = mysql_stmt_result_metadata(m_stmt);
+    if (!meta) {
+      // not a select
+      return true;
+    }
+    unsigned int count = mysql_num_fields(meta);
+    MYSQL_FIELD* fields = mysql_fetch_fields(meta);
+    m_columns.resize(count);
+    m_column_binds.resize(count);
+    for (unsigned int i = 0; i < count; ++i) {
+      Column& column = m_columns[i];
+      switch (fields[i].type) {
+        case MYSQL_TYPE_TINY:
+        case MYSQL_TYPE_SHORT:
+        case MYSQL_TYPE_INT24:
+        case MYSQL_TYPE_LONG:
+        case MYSQL_TYPE_LONGLONG:
+        case MYSQL_TYPE_YEAR:
+          column.type = MYSQL_TYPE_LONGLONG;
+          column.is_unsigned = fields[i].flags & UNSIGNED_FLAG;
+          break;
+        case MYSQL_TYPE_FLOAT:
+        case MYSQL_TYPE_DOUBLE:
+          column.type = MYSQL_TYPE_DOUBLE;
+          break;
+        default:
+          // decimal, time and others are got as string
+          column.type = MYSQL_TYPE_STRING;
+          column.str_value.resize(64);
+          break;
+      }
+    }
+    mysql_free_result(meta);
+  }
+
+  for (size_t i = 0; i < m_columns.size(); ++i) {
+    Column& column = m_columns[i];
+    MYSQL_BIND& bind = m_column_binds[i];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = column.type;
+    bind.is_unsigned = column.is_unsigned;
+    bind.length = &column.length;
+    bind.is_null = &column.is_null;
+    bind.error = &column.error;
+    if (column.type == MYSQL_TYPE_LONGLONG) {
+      bind.buffer = &column.int_value;
+    } else if (column.type == MYSQL_TYPE_DOUBLE) {
+      bind.buffer = &column.double_value;
+    } else {
+      bind.buffer = column.str_value.data();
+      bind.buffer_length = column.str_value.size();
+    }
+  }
+  if (!m_column_binds.empty() && mysql_stmt_bind_result(m_stmt, m_column_binds.data())) {
+    ErrorLog << "faild to call mysql_stmt_bind_result, sql[" << m_sql << "], mysql sys errinfo[" << mysql_stmt_error(m_stmt) << "]";
+    return false;
+  }
+  return true;
+}
+
+int MySQLStatement::execute() {
+  if (m_has_result) {
+    mysql_stmt_free_result(m_stmt);
+    m_has_result = false;
+  }
+
+  for (size_t i = 0; i < m_params.size(); ++i) {
+    Param& param = m_params[i];
+    MYSQL_BIND& bind = m_param_binds[i];
+    memset(&bind, 0, sizeof(bind));
+    bind.buffer_type = param.type;
+    bind.is_unsigned = param.is_unsigned;
+    if (param.type == MYSQL_TYPE_LONGLONG) {
+      bind.buffer = &param.int_value;
+    } else if (param.type == MYSQL_TYPE_DOUBLE) {
+      bind.buffer = &param.double_value;
+    } else if (param.type == MYSQL_TYPE_STRING) {
+      param.length = param.str_value.length();
+      bind.buffer = const_cast<char*>(param.str_value.data());
+      bind.buffer_length = param.length;
+      bind.length = &param.length;
+    }
+  }
+  if (!m_param_binds.empty() && mysql_stmt_bind_param(m_stmt, m_param_binds.data())) {
+    return -1;
+  }
+
+  if (mysql_stmt_execute(m_stmt) != 0) {
+    return -1;
+  }
+  if (!m_columns.empty()) {
+    if (mysql_stmt_store_result(m_stmt) != 0) {
+      return -1;
+    }
+    m_has_result = true;
+  }
+  return 0;
+}
+
+bool MySQLStatement::fetch() {
+  if (!m_has_result) {
+    return false;
+  }
+  int rt = mysql_stmt_fetch(m_stmt);
+  if (rt == MYSQL_NO_DATA) {
+    return false;
+  }
+  if (rt == 1) {
+    ErrorLog << "excute mysql_stmt_fetch error, sql[" << m_sql << "], mysql sys errinfo[" << mysql_stmt_error(m_stmt) << "]";
+    return false;
+  }
+  if (rt == MYSQL_DATA_TRUNCATED) {
+    bool is_grown = false;
+    for (size_t i = 0; i < m_columns.size(); ++i) {
+      Column& column = m_columns[i];
+      if (!column.error || column.type != MYSQL_TYPE_STRING) {
+        continue;
+      }
+      // buffer is too small, get this column again with a larger one
+      column.str_value.resize(column.length);
+      MYSQL_BIND& bind = m_column_binds[i];
+      bind.buffer = column.str_value.data();
+      bind.buffer_length = column.str_value.size();
+      mysql_stmt_fetch_column(m_stmt, &bind, i, 0);
+      is_grown = true;
+    }
+    if (is_grown) {
+      bindResult();
+    }
+  }
+  return true;
+}
+
+int MySQLStatement::getColumnCount() {
+  return m_columns.size();
+}
+
+MySQLStatement::Column* MySQLStatement::getColumn(int idx) {
+  if (idx < 0 || idx >= (int)m_columns.size()) {
+    ErrorLog << "get column error, sql[" << m_sql << "] has " << m_columns.size() << " columns, index " << idx << " is out of range";
+    return NULL;
+  }
+  return &m_columns[idx];
+}
+
+bool MySQLStatement::isNull(int idx) {
+  Column* column = getColumn(idx);
+  return !column || column->is_null;
+}
+
+int64_t MySQLStatement::getInt64(int idx) {
+  Column* column = getColumn(idx);
+  if (!column || column->is_null) {
+    return 0;
+  }
+  if (column->type == MYSQL_TYPE_LONGLONG) {
+    return column->int_value;
+  }
+  if (column->type == MYSQL_TYPE_DOUBLE) {
+    return static_cast<int64_t>(column->double_value);
+  }
+  return std::strtoll(getString(idx).c_str(), NULL, 10);
+}
+
+uint64_t MySQLStatement::getUint64(int idx) {
+  Column* column = getColumn(idx);
+  if (!column || column->is_null) {
+    return 0;
+  }
+  if (column->type == MYSQL_TYPE_STRING) {
+    return std::strtoull(getString(idx).c_str(), NULL, 10);
+  }
+  return static_cast<uint64_t>(getInt64(idx));
+}
+
+double MySQLStatement::getDouble(int idx) {
+  Column* column = getColumn(idx);
+  if (!column || column->is_null) {
+    return 0;
+  }
+  if (column->type == MYSQL_TYPE_DOUBLE) {
+    return column->double_value;
+  }
+  if (column->type == MYSQL_TYPE_LONGLONG) {
+    return column->is_unsigned ? static_cast<double>(static_cast<uint64_t>(column->int_value)) : static_cast<double>(column->int_value);
+  }
+  return std::strtod(getString(idx).c_str(), NULL);
+}
+
+std::string MySQLStatement::getString(int idx) {
+  Column* column = getColumn(idx);
+  if (!column || column->is_null) {
+    return "";
+  }
+  if (column->type == MYSQL_TYPE_LONGLONG) {
+    return column->is_unsigned ? std::to_string(static_cast<uint64_t>(column->int_value)) : std::to_string(column->int_value);
+  }
+  if (column->type == MYSQL_TYPE_DOUBLE) {
+    return std::to_string(column->double_value);
+  }
+  return std::string(column->str_value.data(), std::min<size_t>(column->length, column->str_value.size()));
+}
+
+long long MySQLStatement::affectedRows() {
+  if (!m_stmt) {
+    return -1;
+  }
+  return mysql_stmt_affected_rows(m_stmt);
+}
+
+long long MySQLStatement::lastInsertId() {
+  if (!m_stmt) {
+    return -1;
+  }
+  return mysql_stmt_insert_id(m_stmt);
+}
+
+std::string MySQLStatement::getErrorInfo() {
+  if (!m_stmt) {
+    return "statement has been closed";
+  }
+  return std::string(mysql_stmt_error(m_stmt));
+}
+
+int MySQLStatement::getErrno() {
+  if (!m_stmt) {
+    return CR_SERVER_LOST;
+  }
+  return mysql_stmt_errno(m_stmt);
+}
+
+
+MySQLInstasePool::MySQLInstasePool(const std::string& key, const MySQLOption& option)
+  : m_key(key), m_option(option) {
+
+  m_reactor = Reactor::GetReactor();
+  m_event = std::make_shared<TimerEvent>(std::max(m_option.m_ping_inteval, 1000), true, std::bind(&MySQLInstasePool::loopFunc, this));
+  m_reactor->getTimer()->addTimerEvent(m_event);
+}
+
+MySQLInstasePool::~MySQLInstasePool() {
+  m_reactor->getTimer()->delTimerEvent(m_event);
+}
+
+MySQLInstase::ptr MySQLInstasePool::getInstase(int64_t timeout /*= -1*/) {
+  ScopedDeadline deadline(timeout);
+  MySQLInstase::ptr instase;
+
+  while (!instase) {
+    if (!m_idle_instases.empty()) {
+      // the latest returned one first, others keep idle and can be closed by server
+      instase = m_idle_instases.back();
+      m_idle_instases.pop_back();
+      // lost after it's checked, such as closed by server
+      if (instase->isBroken() && instase->reconnect() != 0) {
+        ErrorLog << "MySQLInstasePool of [" << m_key << "] reconnect error: " << instase->getMySQLErrorInfo();
+        instase.reset();
+        m_count--;
+        continue;
+      }
+      break;
+    }
+
+    if (m_count < m_option.m_pool_size) {
+      m_count++;
+      MySQLInstase::ptr tmp = std::make_shared<MySQLInstase>(m_option);
+      tmp->setAutoReconnect(false);
+      if (tmp->isBroken()) {
+        m_count--;
+        // let other waiter try to connect again
+        wakeupWaiter();
+        ErrorLog << "MySQLInstasePool of [" << m_key << "] connect error: " << tmp->getMySQLErrorInfo();
+        return NULL;
+      }
+      InfoLog << "MySQLInstasePool of [" << m_key << "] create new connection";
+      instase = tmp;
+      break;
+    }
+
+    if (Coroutine::IsMainCoroutine()) {
+      ErrorLog << "MySQLInstasePool of [" << m_key << "] has no free connection, main coroutine can't wait";
+      return NULL;
+    }
+    int64_t left = -1;
+    int64_t cor_deadline = Coroutine::GetCurrentCoroutine()->getDeadline();
+    if (cor_deadline > 0) {
+      left = cor_deadline - getNowMs();
+    }
+    if (left == 0 || deadline.isExpired() || !waitFreeInstase(left)) {
+      ErrorLog << "MySQLInstasePool of [" << m_key << "] has no free connection, over " << timeout << " ms";
+      return NULL;
+    }
+  }
+
+  // connection goes back to pool when user releases it
+  MySQLInstasePool* pool = this;
+  return MySQLInstase::ptr(instase.get(), [pool, instase](MySQLInstase*) {
+    pool->returnInstase(instase);
+  });
+}
+
+void MySQLInstasePool::returnInstase(MySQLInstase::ptr instase) {
+  if (instase->isInTrans()) {
+    // user didn't finish trans, don't let other requests see it
+    ErrorLog << "MySQLInstasePool of [" << m_key << "] got a connection in trans, roll it back";
+    instase->rollBack();
+  }
+  if (instase->isBroken()) {
+    // reconnected in background, by next check if one is running
+    m_broken_instases.push_back(instase);
+    loopFunc();
+    return;
+  }
+  m_idle_instases.push_back(instase);
+  wakeupWaiter();
+}
+
+bool MySQLInstasePool::waitFreeInstase(int64_t timeout) {
+  // on heap, stack of a suspended coroutine may be used by others if it runs on share stack
+  std::shared_ptr<Waiter> waiter = std::make_shared<Waiter>();
+  waiter->cor = Coroutine::GetCurrentCoroutine();
+  auto pos = m_waiters.insert(m_waiters.end(), waiter.get());
+
+  std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+  TimerEvent::ptr event;
+  if (timeout > 0) {
+    auto timer_cb = [this, pos, waiter, is_timeout]() {
+      if (!waiter->in_queue) {
+        // already waked up
+        return;
+      }
+      m_waiters.erase(pos);
+      waiter->in_queue = false;
+      *is_timeout = true;
+      m_reactor->schedule(waiter->cor);
+    };
+    event = std::make_shared<TimerEvent>(timeout, false, timer_cb);
+    m_reactor->getTimer()->addTimerEvent(event);
+  }
+
+  Coroutine::Yield();
+
+  if (event) {
+    m_reactor->getTimer()->delTimerEvent(event);
+  }
+  return !*is_timeout;
+}
+
+void MySQLInstasePool::wakeupWaiter() {
+  if (m_waiters.empty()) {
+    return;
+  }
+  Waiter* waiter = m_waiters.front();
+  m_waiters.pop_front();
+  waiter->in_queue = false;
+  m_reactor->schedule(waiter->cor, false);
+}
+
+void MySQLInstasePool::loopFunc() {
+  if (m_is_checking) {
+    return;
+  }
+  // take broken and long idle connections out of pool, requests won't wait for them
+  int64_t now = getNowMs();
+  std::vector<MySQLInstase::ptr> instases;
+  instases.swap(m_broken_instases);
+  for (auto it = m_idle_instases.begin(); it != m_idle_instases.end();) {
+    if ((*it)->isBroken() || now - (*it)->getLastActiveTime() >= m_option.m_ping_inteval) {
+      instases.push_back(*it);
+      it = m_idle_instases.erase(it);
+      continue;
+    }
+    ++it;
+  }
+  if (instases.empty()) {
+    return;
+  }
+
+  m_is_checking = true;
+  Coroutine::ptr cor = GetCoroutinePool()->getCoroutineInstanse();
+  cor->setCallBack([this, instases, cor]() mutable {
+    checkInstases(instases);
+    m_is_checking = false;
+    if (!m_broken_instases.empty()) {
+      // returned broken during this check
+      loopFunc();
+    }
+    GetCoroutinePool()->returnCoroutine(cor);
+    cor.reset();
+  });
+  m_reactor->addCoroutine(cor, false);
+}
+
+void MySQLInstasePool::checkInstases(std::vector<MySQLInstase::ptr> instases) {
+  for (size_t i = 0; i < instases.size(); ++i) {
+    MySQLInstase::ptr& tmp = instases[i];
+    if (!tmp->isBroken() && tmp->ping() != 0) {
+      ErrorLog << "MySQLInstasePool of [" << m_key << "] ping error: " << tmp->getMySQLErrorInfo();
+    }
+    if (tmp->isBroken() && tmp->reconnect() != 0) {
+      // drop it, a new one is created when it's needed
+      ErrorLog << "MySQLInstasePool of [" << m_key << "] reconnect error: " << tmp->getMySQLErrorInfo();
+      m_count--;
+      wakeupWaiter();
+      continue;
+    }
+    m_idle_instases.push_front(tmp);
+    wakeupWaiter();
+  }
+}
+
 #endif
 
 }
\ No newline at end of file
@@ -7,11 +7,29 @@
 
 #include <memory>
 #include <map>
+#include <list>
+#include <vector>
 #include "tinyrpc/net/mutex.h"
 #include "tinyrpc/net/net_address.h"
 
+#ifdef DECLARE_MYSQL_PLUGIN
+// mysql_*_nonblocking api of libmysqlclient, queries yield on socket of mysql instead of blocking thread
+#if defined(MYSQL_VERSION_ID) && MYSQL_VERSION_ID >= 80016 && !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_PACKAGE_VERSION)
+#define TINYRPC_MYSQL_NONBLOCKING
+#endif
+// bool fields of MYSQL_BIND are my_bool before mysql 8.0
+#if defined(MYSQL_VERSION_ID) && MYSQL_VERSION_ID >= 80000 && !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_PACKAGE_VERSION)
+typedef bool mysql_bool_t;
+#else
+typedef my_bool mysql_bool_t;
+#endif
+#endif
+
 namespace tinyrpc {
 
+class Coroutine;
+class Reactor;
+class TimerEvent;
 
 struct MySQLOption {
  public:
@@ -24,6 +42,11 @@ struct MySQLOption {
   std::string m_passwd;
   std::string m_select_db;
   std::string m_char_set;
+
+  int m_pool_size {4};            // max connections of this db of every io thread
+  int m_query_timeout {0};        // ms, 0 means no limit
+  int m_ping_inteval {30000};     // ms, idle connections are checked and broken ones reconnected by this inteval
+  int m_stmt_cache_size {64};     // max prepared statements of every connection
 };
 
 #ifdef DECLARE_MYSQL_PLUGIN 
@@ -36,6 +59,103 @@ class MySQLThreadInit {
 
 };
 
+//
+// Prepared statement of one connection, it's got by MySQLInstase::prepare and cached by sql.
+// Parameters and results are in binary protocol, so values aren't converted to text and back.
+// Index of parameter and column is from 0. Bound parameters are kept until they are bound again
+//
+class MySQLStatement {
+ public:
+
+  typedef std::shared_ptr<MySQLStatement> ptr;
+
+  MySQLStatement(MYSQL_STMT* stmt, const std::string& sql);
+
+  ~MySQLStatement();
+
+  const std::string& getSql();
+
+  bool isClosed();
+
+  void bindNull(int idx);
+
+  void bindInt64(int idx, int64_t value);
+
+  void bindUint64(int idx, uint64_t value);
+
+  void bindDouble(int idx, double value);
+
+  void bindString(int idx, const std::string& value);
+
+  // move to next row of result, false if no more rows
+  bool fetch();
+
+  int getColumnCount();
+
+  bool isNull(int idx);
+
+  int64_t getInt64(int idx);
+
+  uint64_t getUint64(int idx);
+
+  double getDouble(int idx);
+
+  std::string getString(int idx);
+
+  long long affectedRows();
+
+  long long lastInsertId();
+
+  std::string getErrorInfo();
+
+  int getErrno();
+
+ private:
+  friend class MySQLInstase;
+
+  struct Param {
+    enum_field_types type {MYSQL_TYPE_NULL};
+    bool is_unsigned {false};
+    int64_t int_value {0};
+    double double_value {0};
+    std::string str_value;
+    unsigned long length {0};
+  };
+
+  struct Column {
+    enum_field_types type {MYSQL_TYPE_STRING};
+    bool is_unsigned {false};
+    int64_t int_value {0};
+    double double_value {0};
+    std::vector<char> str_value;
+    unsigned long length {0};
+    mysql_bool_t is_null {0};
+    mysql_bool_t error {0};
+  };
+
+  Param* getParam(int idx);
+
+  Column* getColumn(int idx);
+
+  // bind buffers of columns to result, called again when a buffer grows
+  bool bindResult();
+
+  // send parameters, execute and store all rows of result in client
+  int execute();
+
+  void close();
+
+ private:
+  MYSQL_STMT* m_stmt {NULL};
+  std::string m_sql;
+  std::vector<Param> m_params;
+  std::vector<MYSQL_BIND> m_param_binds;
+  std::vector<Column> m_columns;
+  std::vector<MYSQL_BIND> m_column_binds;
+  bool m_has_result {false};
+
+};
+
 class MySQLInstase {
  public:
 
@@ -47,8 +167,28 @@ class MySQLInstase {
 
   bool isInitSuccess();
 
+  // connection has been lost, it's reconnected when next query if auto reconnect
+  bool isBroken();
+
+  bool isInTrans();
+
+  void setAutoReconnect(bool value);
+
+  int64_t getLastActiveTime();
+
   int query(const std::string& sql);
 
+  // SELECT 1, return 0 if connection is fine
+  int ping();
+
+  int reconnect();
+
+  // prepared statement of sql, it's prepared once and cached by this connection until connection is closed
+  MySQLStatement::ptr prepare(const std::string& sql);
+
+  // execute with parameters bound to stmt, rows of result are got by stmt->fetch
+  int execute(MySQLStatement::ptr stmt);
+
   int commit();
 
   int begin();
@@ -69,16 +209,82 @@ class MySQLInstase {
 
   int getMySQLErrno();
 
-private:
-  int reconnect();
+ private:
+  void closeHandler(const std::string& err_info, int err_no);
+
+  // statements belong to closed connection
+  void clearStatements();
 
  private:
   MySQLOption m_option;
   bool m_init_succ {false};
   bool m_in_trans {false};
+  bool m_auto_reconnect {true};
+  int64_t m_last_active_time {0};
   Mutex m_mutex;
   MYSQL* m_sql_handler {NULL};
 
+  // error of last failed call when m_sql_handler has been closed
+  std::string m_err_info;
+  int m_errno {0};
+
+  // sql -> statement, latest used one is at front of m_stmt_lru
+  std::map<std::string, std::pair<MySQLStatement::ptr, std::list<std::string>::iterator>> m_stmts;
+  std::list<std::string> m_stmt_lru;
+
+};
+
+
+//
+// Connections to one db of one io thread, requests borrow a connection and give it back when they finish,
+// so a slow query only blocks the coroutine which waits for it.
+// Idle connections are pinged and broken ones reconnected in a background coroutine,
+// not in the request which gets them.
+// Must be used in the io thread which creates it
+//
+class MySQLInstasePool {
+ public:
+
+  typedef std::shared_ptr<MySQLInstasePool> ptr;
+
+  MySQLInstasePool(const std::string& key, const MySQLOption& option);
+
+  ~MySQLInstasePool();
+
+  // borrow a connection, wait at most timeout ms (or until deadline of current coroutine) when all are busy.
+  // connection goes back to pool when returned ptr is destroyed. return NULL if timeout or can't connect
+  MySQLInstase::ptr getInstase(int64_t timeout = -1);
+
+ private:
+  struct Waiter {
+    Coroutine* cor {nullptr};
+    bool in_queue {true};
+  };
+
+  void returnInstase(MySQLInstase::ptr instase);
+
+  bool waitFreeInstase(int64_t timeout);
+
+  void wakeupWaiter();
+
+  void loopFunc();
+
+  void checkInstases(std::vector<MySQLInstase::ptr> instases);
+
+ private:
+  std::string m_key;
+  MySQLOption m_option;
+
+  int m_count {0};        // connections which are idle, borrowed or being connected/checked
+  bool m_is_checking {false};
+
+  Reactor* m_reactor {nullptr};
+  std::shared_ptr<TimerEvent> m_event;
+
+  std::list<MySQLInstase::ptr> m_idle_instases;
+  std::vector<MySQLInstase::ptr> m_broken_instases;     // returned broken, wait for next check
+  std::list<Waiter*> m_waiters;
+
 };
 
 
@@ -89,9 +295,16 @@ class MySQLInstaseFactroy {
   ~MySQLInstaseFactroy() = default;
 
   MySQLInstase::ptr GetMySQLInstase(const std::string& key);
+
+  // pool of current thread for db of key
+  MySQLInstasePool::ptr GetMySQLInstasePool(const std::string& key);
+
  public:
   static MySQLInstaseFactroy* GetThreadMySQLFactory();
 
+ private:
+  std::map<std::string, MySQLInstasePool::ptr> m_pools;
+
 };
 
 #endif
@@ -1,13 +1,20 @@
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <errno.h>
 #include <assert.h>
 #include <string.h>
 #include <atomic>
+#include <vector>
 #include "tinyrpc/coroutine/coroutine.h"
 #include "tinyrpc/comm/log.h"
+#include "tinyrpc/comm/config.h"
 #include "tinyrpc/comm/run_time.h"
 
 namespace tinyrpc {
 
+extern tinyrpc::Config::ptr gRpcConfig;
+
 // 主协程,主协程的栈就是当前线程的栈
 // 每个线程都有一个主协程
 static thread_local Coroutine* t_main_coroutine = nullptr;
@@ -25,6 +32,19 @@ static thread_local RunTime* t_cur_run_time = nullptr;
 
 static thread_local bool t_enable_coroutine_swap = true;
 
+// 当前线程的共享栈, 共享栈协程第一次 Resume 时轮流绑定到其中一个
+static thread_local std::vector<ShareStack*> t_share_stacks;
+
+static thread_local size_t t_share_stack_index = 0;
+
+static thread_local std::function<void(Coroutine*, int64_t)> t_resume_observer;
+
+static int64_t getResumeNowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 int getCoroutineIndex() {
   return t_cur_coroutine_id;
 }
@@ -73,12 +93,7 @@ Coroutine::Coroutine(int size) : m_stack_size(size) {
   }
   // assert(t_main_coroutine != nullptr);
 
-  m_stack_sp =  reinterpret_cast<char*>(malloc(m_stack_size));
-  if (!m_stack_sp) {
-    ErrorLog << "start server error. malloc stack return nullptr";
-    Exit(0);
-  }
-  // assert(m_stack_sp != nullptr);
+  allocStack();
 
   m_cor_id = t_cur_coroutine_id++;
   t_coroutine_count++;
@@ -86,6 +101,21 @@ Coroutine::Coroutine(int size) : m_stack_size(size) {
 }
 
 
+Coroutine::Coroutine(int size, CoroutineStackType stack_type)
+  : m_stack_size(size), m_is_share_stack(stack_type == Share_Stack) {
+
+  if (t_main_coroutine == nullptr) {
+    t_main_coroutine = new Coroutine();
+  }
+
+  if (!m_is_share_stack) {
+    allocStack();
+  }
+
+  m_cor_id = t_cur_coroutine_id++;
+  t_coroutine_count++;
+}
+
 Coroutine::Coroutine(int size, std::function<void()> cb)
   : m_stack_size(size) {
 
@@ -94,12 +124,7 @@ Coroutine::Coroutine(int size, std::function<void()> cb)
   }
   // assert(t_main_coroutine != nullptr);
 
-  m_stack_sp =  reinterpret_cast<char*>(malloc(m_stack_size));
-  if (!m_stack_sp) {
-    ErrorLog << "start server error. malloc stack return nullptr";
-    Exit(0);
-  }
-  // assert(m_stack_sp != nullptr);
+  allocStack();
 
   setCallBack(cb);
   m_cor_id = t_cur_coroutine_id++;
@@ -107,6 +132,140 @@ Coroutine::Coroutine(int size, std::function<void()> cb)
   // DebugLog << "coroutine created, id[" << m_cor_id << "]";
 }
 
+static size_t getPageSize() {
+  static size_t page_size = sysconf(_SC_PAGESIZE);
+  return page_size;
+}
+
+// 栈用 mmap 申请, 物理页在用到时才分配. 栈底下方是 PROT_NONE 的保护页, 栈溢出时直接段错误而不是踩坏其他内存
+// size 会向上取整到页大小
+static char* mmapStack(int& size) {
+  size_t page_size = getPageSize();
+  size = (size + page_size - 1) / page_size * page_size;
+
+  void* p = mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, -1, 0);
+  if (p == MAP_FAILED) {
+    ErrorLog << "start server error. mmap stack error, sys error=" << strerror(errno);
+    Exit(0);
+  }
+  if (mprotect(p, page_size, PROT_NONE) != 0) {
+    ErrorLog << "mprotect guard page of stack error, sys error=" << strerror(errno);
+  }
+  return reinterpret_cast<char*>(p) + page_size;
+}
+
+static void munmapStack(char* stack_sp, int size) {
+  size_t page_size = getPageSize();
+  munmap(stack_sp - page_size, size + page_size);
+}
+
+ShareStack::ShareStack(int size) : m_stack_size(size) {
+  m_stack_sp = mmapStack(m_stack_size);
+}
+
+ShareStack::~ShareStack() {
+  munmapStack(m_stack_sp, m_stack_size);
+  m_stack_sp = nullptr;
+}
+
+static ShareStack* GetShareStack(int size) {
+  if (t_share_stacks.empty()) {
+    int count = 1;
+    if (gRpcConfig && gRpcConfig->m_cor_share_stack_count > 0) {
+      count = gRpcConfig->m_cor_share_stack_count;
+    }
+    for (int i = 0; i < count; ++i) {
+      t_share_stacks.push_back(new ShareStack(size));
+    }
+  }
+  return t_share_stacks[t_share_stack_index++ % t_share_stacks.size()];
+}
+
+void Coroutine::allocStack() {
+  m_stack_sp = mmapStack(m_stack_size);
+}
+
+bool Coroutine::releaseStackMemory() {
+  if (m_is_in_cofunc) {
+    return false;
+  }
+  if (m_is_share_stack) {
+    free(m_save_buffer);
+    m_save_buffer = nullptr;
+    m_save_size = 0;
+    m_save_capacity = 0;
+    return true;
+  }
+  if (m_stack_sp != nullptr) {
+    madvise(m_stack_sp, m_stack_size, MADV_DONTNEED);
+  }
+  return true;
+}
+
+void Coroutine::initStackTop() {
+  // coctx_swap 切换时会把返回地址写在 top 处, 要保证它在栈内
+  char* top = m_stack_sp + m_stack_size - sizeof(void*);
+  // first set 0 to stack
+  // memset(&top, 0, m_stack_size);
+
+  top = reinterpret_cast<char*>((reinterpret_cast<unsigned long>(top)) & -16LL);
+
+  m_coctx.regs[kRSP] = top;
+  m_coctx.regs[kRBP] = top;
+}
+
+void Coroutine::bindShareStack() {
+  m_share_stack = GetShareStack(m_stack_size);
+  m_stack_sp = m_share_stack->getStackSp();
+  m_stack_size = m_share_stack->getStackSize();
+  initStackTop();
+}
+
+void Coroutine::unbindShareStack() {
+  if (m_share_stack && m_share_stack->getOccupy() == this) {
+    m_share_stack->setOccupy(nullptr);
+  }
+  m_share_stack = nullptr;
+  m_stack_sp = nullptr;
+  m_save_size = 0;
+}
+
+// 把栈上已使用的部分 [rsp, 栈顶) 拷贝到堆上, 缓冲区按实际大小申请
+void Coroutine::saveStack() {
+  char* sp = reinterpret_cast<char*>(m_coctx.regs[kRSP]);
+  int size = m_stack_sp + m_stack_size - sp;
+  if (size > m_save_capacity || size * 4 < m_save_capacity) {
+    free(m_save_buffer);
+    m_save_buffer = reinterpret_cast<char*>(malloc(size));
+    if (!m_save_buffer) {
+      ErrorLog << "malloc buffer to save share stack return nullptr";
+      Exit(0);
+    }
+    m_save_capacity = size;
+  }
+  memcpy(m_save_buffer, sp, size);
+  m_save_size = size;
+}
+
+// 在主协程中调用, 此时共享栈上没有正在执行的函数, 可以安全地换出占用者, 换入自己的栈
+void Coroutine::switchShareStack() {
+  if (m_share_stack == nullptr) {
+    bindShareStack();
+  }
+  Coroutine* occupy = m_share_stack->getOccupy();
+  if (occupy == this) {
+    return;
+  }
+  if (occupy && occupy->m_is_in_cofunc) {
+    occupy->saveStack();
+  }
+  m_share_stack->setOccupy(this);
+  if (m_save_size > 0) {
+    memcpy(m_stack_sp + m_stack_size - m_save_size, m_save_buffer, m_save_size);
+  }
+}
+
 bool Coroutine::setCallBack(std::function<void()> cb) {
 
   if (this == t_main_coroutine) {
@@ -119,19 +278,19 @@ bool Coroutine::setCallBack(std::function<void()> cb) {
   }
 
   m_call_back = cb;
+  m_priority = Normal_Priority;
+  m_deadline = 0;
 
   // assert(m_stack_sp != nullptr);
 
-  char* top = m_stack_sp + m_stack_size;
-  // first set 0 to stack
-  // memset(&top, 0, m_stack_size);
-
-  top = reinterpret_cast<char*>((reinterpret_cast<unsigned long>(top)) & -16LL);
-
   memset(&m_coctx, 0, sizeof(m_coctx));
 
-  m_coctx.regs[kRSP] = top;
-  m_coctx.regs[kRBP] = top;
+  if (m_is_share_stack) {
+    // 可能换了线程执行, 第一次 Resume 时再绑定当前线程的共享栈
+    unbindShareStack();
+  } else {
+    initStackTop();
+  }
   m_coctx.regs[kRETAddr] = reinterpret_cast<char*>(CoFunction); 
   m_coctx.regs[kRDI] = reinterpret_cast<char*>(this);
 
@@ -142,8 +301,12 @@ bool Coroutine::setCallBack(std::function<void()> cb) {
 Coroutine::~Coroutine() {
   t_coroutine_count--;
 
-  if (m_stack_sp != nullptr) {
-    free(m_stack_sp);
+  if (m_is_share_stack) {
+    unbindShareStack();
+    free(m_save_buffer);
+    m_save_buffer = nullptr;
+  } else if (m_stack_sp != nullptr) {
+    munmapStack(m_stack_sp, m_stack_size);
     m_stack_sp = nullptr;
   }
   DebugLog << "coroutine[" << m_cor_id << "] die";
@@ -211,12 +374,26 @@ void Coroutine::Resume(Coroutine* co) {
     DebugLog << "current coroutine is pending cor, need't swap";
     return;
   }
+  if (co->m_is_share_stack) {
+    co->switchShareStack();
+  }
+
   t_cur_coroutine = co;
   t_cur_run_time = co->getRunTime();
 
+  if (!t_resume_observer) {
+    coctx_swap(&(t_main_coroutine->m_coctx), &(co->m_coctx));
+    return;
+  }
+  int64_t begin = getResumeNowUs();
   coctx_swap(&(t_main_coroutine->m_coctx), &(co->m_coctx));
   // DebugLog << "swap back";
+  t_resume_observer(co, getResumeNowUs() - begin);
+
+}
 
+void Coroutine::SetResumeObserver(std::function<void(Coroutine*, int64_t)> observer) {
+  t_resume_observer = observer;
 }
 
 }
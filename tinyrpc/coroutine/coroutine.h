@@ -1,7 +1,9 @@
 #ifndef TINYRPC_COROUTINE_COROUTINE_H
 #define TINYRPC_COROUTINE_COROUTINE_H
 
+#include <stdint.h>
 #include <memory>
+#include <atomic>
 #include <functional>
 #include "tinyrpc/coroutine/coctx.h"
 #include "tinyrpc/comm/run_time.h"
@@ -14,8 +16,57 @@ RunTime* getCurrentRunTime();
 
 void setCurrentRunTime(RunTime* v);
 
+class Coroutine;
+
+enum CoroutineStackType {
+  Own_Stack = 1,      // 协程独占一块栈
+  Share_Stack = 2,    // 协程运行在线程的共享栈上
+};
+
+// 调度优先级, 数值越小越先被 reactor 恢复执行
+enum CoroutinePriority {
+  Control_Priority = 0,       // 控制类请求, 如健康检查
+  Normal_Priority = 1,        // 普通 rpc 请求
+  Background_Priority = 2,    // 后台任务
+};
+
+static const int COROUTINE_PRIORITY_COUNT = 3;
+
+// 共享栈, 多个协程轮流在同一块栈上执行, 切换时才把占用者已使用的部分拷贝到它自己的堆缓冲区
+class ShareStack {
+
+ public:
+  ShareStack(int size);
+
+  ~ShareStack();
+
+  char* getStackSp() const {
+    return m_stack_sp;
+  }
+
+  int getStackSize() const {
+    return m_stack_size;
+  }
+
+  Coroutine* getOccupy() const {
+    return m_occupy;
+  }
+
+  void setOccupy(Coroutine* cor) {
+    m_occupy = cor;
+  }
+
+ private:
+  int m_stack_size {0};
+  char* m_stack_sp {nullptr};
+  Coroutine* m_occupy {nullptr};    // 栈上当前保存的是哪个协程的数据
+
+};
+
 class Coroutine {
 
+ friend class CoroutineScheduler;
+
  public:
   typedef std::shared_ptr<Coroutine> ptr;
 
@@ -23,10 +74,26 @@ class Coroutine {
 
   Coroutine();
 
+  void allocStack();
+
+  void initStackTop();
+
+  void bindShareStack();
+
+  void unbindShareStack();
+
+  void saveStack();
+
+  void switchShareStack();
+
  public:
 
   Coroutine(int size);
 
+  // Share_Stack 时 size 是共享栈的大小.
+  // 挂起时其他协程不能访问它栈上的变量, 因为那块内存可能已经被别的协程占用
+  Coroutine(int size, CoroutineStackType stack_type);
+
   Coroutine(int size, std::function<void()> cb);
 
   ~Coroutine();
@@ -57,6 +124,40 @@ class Coroutine {
     m_msg_no = msg_no;
   }
 
+  // give physical pages of stack back to system, stack is still usable and will be zero filled.
+  // return false if it's still in its function, stack can't be released
+  bool releaseStackMemory();
+
+  void setIsInPool(const bool v) {
+    m_is_in_pool = v;
+  }
+
+  bool getIsInPool() const {
+    return m_is_in_pool;
+  }
+
+  bool getIsShareStack() const {
+    return m_is_share_stack;
+  }
+
+  // 每次 setCallBack 都会重置为 Normal_Priority
+  void setPriority(const CoroutinePriority v) {
+    m_priority = v;
+  }
+
+  CoroutinePriority getPriority() const {
+    return m_priority;
+  }
+
+  // 单调时钟 ms, hook 的 io 到期返回 ETIMEDOUT. 每次 setCallBack 都会清除
+  void setDeadline(const int64_t v) {
+    m_deadline = v;
+  }
+
+  int64_t getDeadline() const {
+    return m_deadline;
+  }
+
  public:
   static void Yield();
 
@@ -70,14 +171,30 @@ class Coroutine {
 
   static bool GetCoroutineSwapFlag();
 
+  // called by Resume of this thread with time (us) cor ran until it yields back, nullptr -- don't call
+  static void SetResumeObserver(std::function<void(Coroutine*, int64_t)> observer);
+
  private:
   int m_cor_id {0};       // 协程id
   coctx m_coctx;      // 协程寄存器上下文
   int m_stack_size {0};   // 协程申请堆空间的栈大小,单位: 字节
-  char* m_stack_sp {nullptr};   // 
+  char* m_stack_sp {nullptr};   // 栈底(低地址), 其下方有一个不可访问的保护页
   bool m_is_in_cofunc {false};  // 是否开始执行。只要协程进入CoFunction就变为true, CoFunction执行完变为false
   std::string m_msg_no;  // 当前协程正在处理的消息号
   RunTime m_run_time;
+  bool m_is_in_pool {false};    // 是否在协程池的空闲链表中
+
+  bool m_is_share_stack {false};    // 是否使用共享栈
+  ShareStack* m_share_stack {nullptr};    // 绑定的共享栈, 第一次 Resume 时绑定
+  char* m_save_buffer {nullptr};    // 被换出时保存栈数据的缓冲区
+  int m_save_size {0};
+  int m_save_capacity {0};
+
+  CoroutinePriority m_priority {Normal_Priority};
+  int64_t m_deadline {0};   // io 截止时间, 0 表示没有
+  Coroutine* m_ready_next {nullptr};    // 就绪队列中的下一个协程
+  std::atomic<bool> m_is_ready {false};   // 是否已经在某个 reactor 的就绪队列中
+  ptr m_ready_holder;     // 由 addCoroutine 加入时持有协程, 恢复执行后释放
 
 
  public:
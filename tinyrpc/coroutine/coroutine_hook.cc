@@ -1,15 +1,20 @@
 #include <assert.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <stdarg.h>
 #include <unistd.h>
 #include <string.h>
+#include <algorithm>
+#include <vector>
 #include "tinyrpc/coroutine/coroutine_hook.h"
 #include "tinyrpc/coroutine/coroutine.h"
 #include "tinyrpc/net/fd_event.h"
 #include "tinyrpc/net/reactor.h"
 #include "tinyrpc/net/timer.h"
+#include "tinyrpc/net/io_uring.h"
 #include "tinyrpc/comm/log.h"
 #include "tinyrpc/comm/config.h"
+#include <linux/io_uring.h>
 
 #define HOOK_SYS_FUNC(name) name##_fun_ptr_t g_sys_##name##_fun = (name##_fun_ptr_t)dlsym(RTLD_NEXT, #name);
 
@@ -17,8 +22,24 @@
 HOOK_SYS_FUNC(accept);
 HOOK_SYS_FUNC(read);
 HOOK_SYS_FUNC(write);
+HOOK_SYS_FUNC(readv);
+HOOK_SYS_FUNC(writev);
 HOOK_SYS_FUNC(connect);
 HOOK_SYS_FUNC(sleep);
+HOOK_SYS_FUNC(usleep);
+HOOK_SYS_FUNC(nanosleep);
+HOOK_SYS_FUNC(recv);
+HOOK_SYS_FUNC(recvfrom);
+HOOK_SYS_FUNC(recvmsg);
+HOOK_SYS_FUNC(send);
+HOOK_SYS_FUNC(sendto);
+HOOK_SYS_FUNC(sendmsg);
+HOOK_SYS_FUNC(poll);
+HOOK_SYS_FUNC(select);
+HOOK_SYS_FUNC(epoll_wait);
+HOOK_SYS_FUNC(fcntl);
+HOOK_SYS_FUNC(setsockopt);
+HOOK_SYS_FUNC(close);
 
 // static int g_hook_enable = false;
 
@@ -35,14 +56,50 @@ void SetHook(bool value) {
 	g_hook = value;
 }
 
+ScopedDeadline::ScopedDeadline(int64_t timeout) {
+	m_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
+	m_old_deadline = m_cor->getDeadline();
+	m_deadline = m_old_deadline;
+	if (timeout > 0) {
+		int64_t deadline = tinyrpc::getNowMs() + timeout;
+		if (m_deadline <= 0 || deadline < m_deadline) {
+			m_deadline = deadline;
+		}
+	}
+	m_cor->setDeadline(m_deadline);
+}
+
+ScopedDeadline::~ScopedDeadline() {
+	restore();
+}
+
+void ScopedDeadline::restore() {
+	m_cor->setDeadline(m_old_deadline);
+}
+
+bool ScopedDeadline::isExpired() const {
+	return m_deadline > 0 && tinyrpc::getNowMs() >= m_deadline;
+}
+
 void toEpoll(tinyrpc::FdEvent::ptr fd_event, int events) {
 	
 	tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine() ;
+	if (gRpcConfig && gRpcConfig->m_epoll_et) {
+		// fd is registered only once, reactor resumes waiter when it's ready
+		fd_event->registerEdgeTriggered();
+		if (events & tinyrpc::IOEvent::READ) {
+			fd_event->setWaiter(tinyrpc::IOEvent::READ, cur_cor);
+		}
+		if (events & tinyrpc::IOEvent::WRITE) {
+			fd_event->setWaiter(tinyrpc::IOEvent::WRITE, cur_cor);
+		}
+		return;
+	}
 	if (events & tinyrpc::IOEvent::READ) {
 		DebugLog << "fd:[" << fd_event->getFd() << "], register read event to epoll";
 		fd_event->setCallBack(tinyrpc::IOEvent::READ, 
 			[cur_cor, fd_event]() {
-				tinyrpc::Coroutine::Resume(cur_cor);
+				tinyrpc::Reactor::GetReactor()->schedule(cur_cor);
 			}
 		);
 		fd_event->addListenEvents(tinyrpc::IOEvent::READ);
@@ -51,7 +108,7 @@ void toEpoll(tinyrpc::FdEvent::ptr fd_event, int events) {
 		DebugLog << "fd:[" << fd_event->getFd() << "], register write event to epoll";
 		fd_event->setCallBack(tinyrpc::IOEvent::WRITE, 
 			[cur_cor]() {
-				tinyrpc::Coroutine::Resume(cur_cor);
+				tinyrpc::Reactor::GetReactor()->schedule(cur_cor);
 			}
 		);
 		fd_event->addListenEvents(tinyrpc::IOEvent::WRITE);
@@ -59,25 +116,102 @@ void toEpoll(tinyrpc::FdEvent::ptr fd_event, int events) {
 	// fd_event->updateToReactor();
 }
 
-ssize_t read_hook(int fd, void *buf, size_t count) {
-	DebugLog << "this is hook read";
-  if (tinyrpc::Coroutine::IsMainCoroutine()) {
-    DebugLog << "hook disable, call sys read func";
-    return g_sys_read_fun(fd, buf, count);
-  }
-
-	tinyrpc::Reactor::GetReactor();
-	// assert(reactor != nullptr);
+// return true if coroutine is resumed because fd is ready, only for edge-triggered fd
+bool fromEpoll(tinyrpc::FdEvent::ptr fd_event, tinyrpc::IOEvent event) {
+	if (gRpcConfig && gRpcConfig->m_epoll_et) {
+		// reactor takes waiter away when resume it, others (such as timer) don't
+		return fd_event->takeWaiter(event) == nullptr;
+	}
+	fd_event->delListenEvents(event);
+	return false;
+}
 
+// FdEvent of fd, reactor of current thread is set to it if it hasn't one
+static tinyrpc::FdEvent::ptr getHookFdEvent(int fd) {
   tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
-  if(fd_event->getReactor() == nullptr) {
+  if(fd_event && fd_event->getReactor() == nullptr) {
     fd_event->setReactor(tinyrpc::Reactor::GetReactor());  
   }
+	return fd_event;
+}
 
-	// if (fd_event->isNonBlock()) {
-		// DebugLog << "user set nonblock, call sys func";
-		// return g_sys_read_fun(fd, buf, count);
-	// }
+// user sets O_NONBLOCK and expects EAGAIN, so hooks call sys func directly
+static bool isUserNonBlock(int fd) {
+	tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
+	return fd_event && fd_event->isUserNonBlock();
+}
+
+// ms to wait from now, the nearer one of max_timeout and deadline of current coroutine. -1 means no limit
+static int64_t getWaitTimeout(int64_t max_timeout = -1) {
+	int64_t timeout = max_timeout;
+	int64_t deadline = tinyrpc::Coroutine::GetCurrentCoroutine()->getDeadline();
+	if (deadline > 0) {
+		int64_t left = std::max(deadline - tinyrpc::getNowMs(), (int64_t)0);
+		if (timeout < 0 || left < timeout) {
+			timeout = left;
+		}
+	}
+	return timeout;
+}
+
+// set is_timeout and resume current coroutine after timeout ms
+static tinyrpc::TimerEvent::ptr addTimeoutEvent(int64_t timeout, std::shared_ptr<bool> is_timeout) {
+	tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
+	auto timeout_cb = [is_timeout, cur_cor]() {
+		*is_timeout = true;
+		tinyrpc::Reactor::GetReactor()->schedule(cur_cor);
+	};
+	tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(timeout, false, timeout_cb);
+	tinyrpc::Reactor::GetReactor()->getTimer()->addTimerEvent(event);
+	return event;
+}
+
+// yield until fd is ready, is_ready is got by fromEpoll.
+// return false if it's timeout first, errno is EAGAIN for SO_RCVTIMEO or SO_SNDTIMEO of fd, ETIMEDOUT for deadline of coroutine
+static bool waitFdEvent(tinyrpc::FdEvent::ptr fd_event, tinyrpc::IOEvent event, bool& is_ready) {
+	int64_t fd_timeout = fd_event->getTimeout(event);
+	int64_t timeout = getWaitTimeout(fd_timeout);
+	int timeout_errno = (fd_timeout >= 0 && timeout == fd_timeout) ? EAGAIN : ETIMEDOUT;
+	if (timeout == 0) {
+		errno = timeout_errno;
+		return false;
+	}
+	std::shared_ptr<bool> is_timeout;
+	tinyrpc::TimerEvent::ptr timer_event;
+	if (timeout > 0) {
+		is_timeout = std::make_shared<bool>(false);
+		timer_event = addTimeoutEvent(timeout, is_timeout);
+	}
+
+	toEpoll(fd_event, event);
+	tinyrpc::Coroutine::Yield();
+	is_ready = fromEpoll(fd_event, event);
+
+	if (timer_event) {
+		tinyrpc::Reactor::GetReactor()->getTimer()->delTimerEvent(timer_event);
+		if (*is_timeout && !is_ready) {
+			errno = timeout_errno;
+			return false;
+		}
+	}
+	return true;
+}
+
+// whether sys func should be called again after fd is ready
+static bool needWait(ssize_t n) {
+	if (gRpcConfig && gRpcConfig->m_epoll_et) {
+		return n < 0 && errno == EAGAIN;
+	}
+	return n <= 0;
+}
+
+// call sys func of fd, if it would block, yield until fd is ready for event and call it again
+template <typename SysFunc>
+static ssize_t doIo(int fd, tinyrpc::IOEvent event, const char* name, SysFunc func) {
+	tinyrpc::FdEvent::ptr fd_event = getHookFdEvent(fd);
+	if (!fd_event) {
+		return func();
+	}
 
 	fd_event->setNonBlock();
 
@@ -85,105 +219,253 @@ ssize_t read_hook(int fd, void *buf, size_t count) {
 	// because reactor should always care read event when a connection sockfd was created
 	// so if first call sys read, and read return success, this fucntion will not register read event and return
 	// for this connection sockfd, reactor will never care read event
-  ssize_t n = g_sys_read_fun(fd, buf, count);
-  if (n > 0) {
+  ssize_t n = func();
+  if (!needWait(n)) {
     return n;
-  } 
+  }
 
-	toEpoll(fd_event, tinyrpc::IOEvent::READ);
+	while (true) {
+		DebugLog << name << " func to yield";
+		bool is_ready = false;
+		if (!waitFdEvent(fd_event, event, is_ready)) {
+			DebugLog << name << " func timeout";
+			return -1;
+		}
+
+		DebugLog << name << " func yield back, now to call sys " << name;
+		n = func();
+		// edge of fd may be reported for data which has been handled, wait again in this case
+		if (!is_ready || !needWait(n)) {
+			return n;
+		}
+	}
+}
 
-	DebugLog << "read func to yield";
-	tinyrpc::Coroutine::Yield();
+// free sqe of io_uring backend, nullptr if current reactor doesn't use io_uring
+static struct io_uring_sqe* getIoUringSqe() {
+	tinyrpc::IoUring* ring = tinyrpc::Reactor::GetReactor()->getIoUring();
+	if (!ring) {
+		return nullptr;
+	}
+	// kernel may write to buffer on stack after coroutine is switched out, share stack can't work with it
+	if (tinyrpc::Coroutine::GetCurrentCoroutine()->getIsShareStack()) {
+		return nullptr;
+	}
+	return ring->getSqe();
+}
 
-	fd_event->delListenEvents(tinyrpc::IOEvent::READ);
-	// fd_event->updateToReactor();
+static void prepareIoUringSqe(struct io_uring_sqe* sqe, int opcode, int fd, const void* addr, unsigned len) {
+	sqe->opcode = opcode;
+	sqe->fd = fd;
+	sqe->addr = reinterpret_cast<uint64_t>(addr);
+	sqe->len = len;
+	// use current file position, ignored by socket
+	sqe->off = static_cast<uint64_t>(-1);
+}
 
-	DebugLog << "read func yield back, now to call sys read";
-	return g_sys_read_fun(fd, buf, count);
+// yield until sqe is done, it's submitted by reactor with others of the same loop. return like sys func.
+// it's canceled after max_timeout (errno is max_timeout_errno) or deadline of current coroutine (errno is ETIMEDOUT)
+static int submitToIoUring(struct io_uring_sqe* sqe, int64_t max_timeout = -1, int max_timeout_errno = ETIMEDOUT) {
+	tinyrpc::IoUringRequest req;
+	req.cor = tinyrpc::Coroutine::GetCurrentCoroutine();
+	sqe->user_data = reinterpret_cast<uint64_t>(&req);
+
+	// sqe has been taken, so submit it even if deadline is reached, timer will cancel it in next loop
+	int64_t timeout = getWaitTimeout(max_timeout);
+	int timeout_errno = (max_timeout >= 0 && timeout == max_timeout) ? max_timeout_errno : ETIMEDOUT;
+	std::shared_ptr<bool> is_timeout;
+	tinyrpc::TimerEvent::ptr timer_event;
+	if (timeout >= 0) {
+		is_timeout = std::make_shared<bool>(false);
+		timer_event = addTimeoutEvent(timeout, is_timeout);
+	}
+
+	// kernel refers to req until its cqe arrives, so don't leave before it even if resumed by others.
+	// cancel it once timeout, then its cqe comes soon
+	bool is_canceled = false;
+	while (true) {
+		tinyrpc::Coroutine::Yield();
+		if (req.is_done) {
+			break;
+		}
+		if (!is_canceled && is_timeout && *is_timeout) {
+			tinyrpc::Reactor::GetReactor()->cancelIoUring(&req);
+			is_canceled = true;
+		}
+	}
 
+	if (timer_event) {
+		tinyrpc::Reactor::GetReactor()->getTimer()->delTimerEvent(timer_event);
+	}
+	if (req.res < 0) {
+		errno = (is_timeout && *is_timeout) ? timeout_errno : -req.res;
+		return -1;
+	}
+	return req.res;
 }
 
-int accept_hook(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-	DebugLog << "this is hook accept";
-  if (tinyrpc::Coroutine::IsMainCoroutine()) {
-    DebugLog << "hook disable, call sys accept func";
-    return g_sys_accept_fun(sockfd, addr, addrlen);
-  }
-	tinyrpc::Reactor::GetReactor();
-	// assert(reactor != nullptr);
+// SO_RCVTIMEO or SO_SNDTIMEO of fd, -1 if it isn't set
+static int64_t getFdTimeout(int fd, tinyrpc::IOEvent event) {
+	tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
+	return fd_event ? fd_event->getTimeout(event) : -1;
+}
 
-  tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(sockfd);
-  if(fd_event->getReactor() == nullptr) {
-    fd_event->setReactor(tinyrpc::Reactor::GetReactor());  
+ssize_t read_hook(int fd, void *buf, size_t count) {
+	DebugLog << "this is hook read";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(fd)) {
+    DebugLog << "hook disable, call sys read func";
+    return g_sys_read_fun(fd, buf, count);
   }
 
-	// if (fd_event->isNonBlock()) {
-		// DebugLog << "user set nonblock, call sys func";
-		// return g_sys_accept_fun(sockfd, addr, addrlen);
-	// }
-
-	fd_event->setNonBlock();
-
-  int n = g_sys_accept_fun(sockfd, addr, addrlen);
-  if (n > 0) {
-    return n;
-  } 
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_READ, fd, buf, count);
+		return submitToIoUring(sqe, getFdTimeout(fd, tinyrpc::IOEvent::READ), EAGAIN);
+	}
 
-	toEpoll(fd_event, tinyrpc::IOEvent::READ);
-	
-	DebugLog << "accept func to yield";
-	tinyrpc::Coroutine::Yield();
+	return doIo(fd, tinyrpc::IOEvent::READ, "read", [&]() {
+		return g_sys_read_fun(fd, buf, count);
+	});
+}
 
-	fd_event->delListenEvents(tinyrpc::IOEvent::READ);
-	// fd_event->updateToReactor();
+int accept_hook(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
+	DebugLog << "this is hook accept";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(sockfd)) {
+    DebugLog << "hook disable, call sys accept func";
+    return g_sys_accept_fun(sockfd, addr, addrlen);
+  }
 
-	DebugLog << "accept func yield back, now to call sys accept";
-	return g_sys_accept_fun(sockfd, addr, addrlen);
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_ACCEPT, sockfd, addr, 0);
+		sqe->off = reinterpret_cast<uint64_t>(addrlen);
+		sqe->accept_flags = SOCK_NONBLOCK;
+		return submitToIoUring(sqe, getFdTimeout(sockfd, tinyrpc::IOEvent::READ), EAGAIN);
+	}
 
+	return doIo(sockfd, tinyrpc::IOEvent::READ, "accept", [&]() {
+		return g_sys_accept_fun(sockfd, addr, addrlen);
+	});
 }
 
 ssize_t write_hook(int fd, const void *buf, size_t count) {
 	DebugLog << "this is hook write";
-  if (tinyrpc::Coroutine::IsMainCoroutine()) {
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(fd)) {
     DebugLog << "hook disable, call sys write func";
     return g_sys_write_fun(fd, buf, count);
   }
-	tinyrpc::Reactor::GetReactor();
-	// assert(reactor != nullptr);
 
-  tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
-  if(fd_event->getReactor() == nullptr) {
-    fd_event->setReactor(tinyrpc::Reactor::GetReactor());  
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_WRITE, fd, buf, count);
+		return submitToIoUring(sqe, getFdTimeout(fd, tinyrpc::IOEvent::WRITE), EAGAIN);
+	}
+
+	return doIo(fd, tinyrpc::IOEvent::WRITE, "write", [&]() {
+		return g_sys_write_fun(fd, buf, count);
+	});
+}
+
+ssize_t readv_hook(int fd, const struct iovec *iov, int iovcnt) {
+	DebugLog << "this is hook readv";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(fd)) {
+    DebugLog << "hook disable, call sys readv func";
+    return g_sys_readv_fun(fd, iov, iovcnt);
   }
 
-	// if (fd_event->isNonBlock()) {
-		// DebugLog << "user set nonblock, call sys func";
-		// return g_sys_write_fun(fd, buf, count);
-	// }
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_READV, fd, iov, iovcnt);
+		return submitToIoUring(sqe, getFdTimeout(fd, tinyrpc::IOEvent::READ), EAGAIN);
+	}
 
-	fd_event->setNonBlock();
+	return doIo(fd, tinyrpc::IOEvent::READ, "readv", [&]() {
+		return g_sys_readv_fun(fd, iov, iovcnt);
+	});
+}
 
-  ssize_t n = g_sys_write_fun(fd, buf, count);
-  if (n > 0) {
-    return n;
+ssize_t writev_hook(int fd, const struct iovec *iov, int iovcnt) {
+	DebugLog << "this is hook writev";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(fd)) {
+    DebugLog << "hook disable, call sys writev func";
+    return g_sys_writev_fun(fd, iov, iovcnt);
   }
 
-	toEpoll(fd_event, tinyrpc::IOEvent::WRITE);
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_WRITEV, fd, iov, iovcnt);
+		return submitToIoUring(sqe, getFdTimeout(fd, tinyrpc::IOEvent::WRITE), EAGAIN);
+	}
 
-	DebugLog << "write func to yield";
-	tinyrpc::Coroutine::Yield();
+	return doIo(fd, tinyrpc::IOEvent::WRITE, "writev", [&]() {
+		return g_sys_writev_fun(fd, iov, iovcnt);
+	});
+}
 
-	fd_event->delListenEvents(tinyrpc::IOEvent::WRITE);
-	// fd_event->updateToReactor();
+// recv and send family always wait for fd by epoll, MSG_DONTWAIT means user doesn't want to wait
+ssize_t recv_hook(int sockfd, void *buf, size_t len, int flags) {
+	DebugLog << "this is hook recv";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_recv_fun(sockfd, buf, len, flags);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::READ, "recv", [&]() {
+		return g_sys_recv_fun(sockfd, buf, len, flags);
+	});
+}
+
+ssize_t recvfrom_hook(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
+	DebugLog << "this is hook recvfrom";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_recvfrom_fun(sockfd, buf, len, flags, src_addr, addrlen);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::READ, "recvfrom", [&]() {
+		return g_sys_recvfrom_fun(sockfd, buf, len, flags, src_addr, addrlen);
+	});
+}
 
-	DebugLog << "write func yield back, now to call sys write";
-	return g_sys_write_fun(fd, buf, count);
+ssize_t recvmsg_hook(int sockfd, struct msghdr *msg, int flags) {
+	DebugLog << "this is hook recvmsg";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_recvmsg_fun(sockfd, msg, flags);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::READ, "recvmsg", [&]() {
+		return g_sys_recvmsg_fun(sockfd, msg, flags);
+	});
+}
 
+ssize_t send_hook(int sockfd, const void *buf, size_t len, int flags) {
+	DebugLog << "this is hook send";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_send_fun(sockfd, buf, len, flags);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::WRITE, "send", [&]() {
+		return g_sys_send_fun(sockfd, buf, len, flags);
+	});
+}
+
+ssize_t sendto_hook(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
+	DebugLog << "this is hook sendto";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_sendto_fun(sockfd, buf, len, flags, dest_addr, addrlen);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::WRITE, "sendto", [&]() {
+		return g_sys_sendto_fun(sockfd, buf, len, flags, dest_addr, addrlen);
+	});
+}
+
+ssize_t sendmsg_hook(int sockfd, const struct msghdr *msg, int flags) {
+	DebugLog << "this is hook sendmsg";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (flags & MSG_DONTWAIT) || isUserNonBlock(sockfd)) {
+    return g_sys_sendmsg_fun(sockfd, msg, flags);
+  }
+	return doIo(sockfd, tinyrpc::IOEvent::WRITE, "sendmsg", [&]() {
+		return g_sys_sendmsg_fun(sockfd, msg, flags);
+	});
 }
 
 int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 	DebugLog << "this is hook connect";
-  if (tinyrpc::Coroutine::IsMainCoroutine()) {
+  if (tinyrpc::Coroutine::IsMainCoroutine() || isUserNonBlock(sockfd)) {
     DebugLog << "hook disable, call sys connect func";
     return g_sys_connect_fun(sockfd, addr, addrlen);
   }
@@ -194,7 +476,6 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
   if(fd_event->getReactor() == nullptr) {
     fd_event->setReactor(reactor);  
   }
-	tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
 
 	// if (fd_event->isNonBlock()) {
 		// DebugLog << "user set nonblock, call sys func";
@@ -202,6 +483,19 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 	// }
 	
 	fd_event->setNonBlock();
+
+	struct io_uring_sqe* sqe = getIoUringSqe();
+	if (sqe) {
+		prepareIoUringSqe(sqe, IORING_OP_CONNECT, sockfd, addr, 0);
+		sqe->off = addrlen;
+
+		int rt = submitToIoUring(sqe, gRpcConfig->m_max_connect_timeout);
+		if (rt != 0 && errno == ETIMEDOUT) {
+			ErrorLog << "connect error, timeout";
+		}
+		return rt;
+	}
+
   int n = g_sys_connect_fun(sockfd, addr, addrlen);
   if (n == 0) {
     DebugLog << "direct connect succ, return";
@@ -213,47 +507,291 @@ int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 
 	DebugLog << "errno == EINPROGRESS";
 
-  toEpoll(fd_event, tinyrpc::IOEvent::WRITE);
+	std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);		// 是否超时
 
-	bool is_timeout = false;		// 是否超时
+	// 最多等待 m_max_connect_timeout, 协程的截止时间更早时以它为准
+	int64_t timeout = getWaitTimeout(gRpcConfig->m_max_connect_timeout);
+	tinyrpc::TimerEvent::ptr event = addTimeoutEvent(timeout, is_timeout);
+  tinyrpc::Timer* timer = reactor->getTimer();  
 
-	// 超时函数句柄
-  auto timeout_cb = [&is_timeout, cur_cor](){
-		// 设置超时标志，然后唤醒协程
-		is_timeout = true;
-		tinyrpc::Coroutine::Resume(cur_cor);
-  };
+	while (true) {
+		toEpoll(fd_event, tinyrpc::IOEvent::WRITE);
 
-  tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(gRpcConfig->m_max_connect_timeout, false, timeout_cb);
-  
-  tinyrpc::Timer* timer = reactor->getTimer();  
-  timer->addTimerEvent(event);
+		tinyrpc::Coroutine::Yield();
 
-  tinyrpc::Coroutine::Yield();
+		// write事件需要删除，因为连接成功后后面会重新监听该fd的写事件。
+		bool is_ready = fromEpoll(fd_event, tinyrpc::IOEvent::WRITE); 
 
-	// write事件需要删除，因为连接成功后后面会重新监听该fd的写事件。
-	fd_event->delListenEvents(tinyrpc::IOEvent::WRITE); 
-	// fd_event->updateToReactor();
+		n = g_sys_connect_fun(sockfd, addr, addrlen);
+		// out of date edge of fd, connection is still in progress
+		if (!is_ready || *is_timeout || !(n < 0 && errno == EALREADY)) {
+			break;
+		}
+	}
 
 	// 定时器也需要删除
 	timer->delTimerEvent(event);
 
-	n = g_sys_connect_fun(sockfd, addr, addrlen);
 	if ((n < 0 && errno == EISCONN) || n == 0) {
 		DebugLog << "connect succ";
 		return 0;
 	}
 
-	if (is_timeout) {
-    ErrorLog << "connect error,  timeout[ " << gRpcConfig->m_max_connect_timeout << "ms]";
+	if (*is_timeout) {
+    ErrorLog << "connect error,  timeout[ " << timeout << "ms]";
 		errno = ETIMEDOUT;
-	} 
+	}
 
 	DebugLog << "connect error and errno=" << errno <<  ", error=" << strerror(errno);
 	return -1;
 
 }
 
+static short toIOEvents(short poll_events) {
+	short events = 0;
+	if (poll_events & (POLLIN | POLLPRI | POLLRDHUP)) {
+		events |= tinyrpc::IOEvent::READ;
+	}
+	if (poll_events & POLLOUT) {
+		events |= tinyrpc::IOEvent::WRITE;
+	}
+	return events;
+}
+
+int poll_hook(struct pollfd *fds, nfds_t nfds, int timeout) {
+	DebugLog << "this is hook poll";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || timeout == 0) {
+    return g_sys_poll_fun(fds, nfds, timeout);
+  }
+
+	// fd which is ready now may not have a new edge
+	int n = g_sys_poll_fun(fds, nfds, 0);
+	if (n != 0) {
+		return n;
+	}
+
+	int64_t wait_timeout = getWaitTimeout(timeout < 0 ? -1 : timeout);
+	if (wait_timeout == 0) {
+		return 0;
+	}
+	std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+	tinyrpc::TimerEvent::ptr timer_event;
+	if (wait_timeout > 0) {
+		timer_event = addTimeoutEvent(wait_timeout, is_timeout);
+	}
+
+	std::vector<tinyrpc::FdEvent::ptr> fd_events(nfds);
+	while (true) {
+		for (nfds_t i = 0; i < nfds; ++i) {
+			short events = toIOEvents(fds[i].events);
+			if (fds[i].fd < 0 || events == 0) {
+				continue;
+			}
+			fd_events[i] = getHookFdEvent(fds[i].fd);
+			if (fd_events[i]) {
+				toEpoll(fd_events[i], events);
+			}
+		}
+
+		DebugLog << "poll func to yield";
+		tinyrpc::Coroutine::Yield();
+
+		for (nfds_t i = 0; i < nfds; ++i) {
+			if (!fd_events[i]) {
+				continue;
+			}
+			short events = toIOEvents(fds[i].events);
+			if (events & tinyrpc::IOEvent::READ) {
+				fromEpoll(fd_events[i], tinyrpc::IOEvent::READ);
+			}
+			if (events & tinyrpc::IOEvent::WRITE) {
+				fromEpoll(fd_events[i], tinyrpc::IOEvent::WRITE);
+			}
+		}
+
+		n = g_sys_poll_fun(fds, nfds, 0);
+		// resumed by out of date edge or others, wait again
+		if (n != 0 || *is_timeout) {
+			break;
+		}
+	}
+
+	if (timer_event) {
+		tinyrpc::Reactor::GetReactor()->getTimer()->delTimerEvent(timer_event);
+	}
+	return n;
+}
+
+int select_hook(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+	DebugLog << "this is hook select";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || (timeout && timeout->tv_sec == 0 && timeout->tv_usec == 0)) {
+    return g_sys_select_fun(nfds, readfds, writefds, exceptfds, timeout);
+  }
+
+	int timeout_ms = -1;
+	if (timeout) {
+		timeout_ms = timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+	}
+
+	std::vector<struct pollfd> fds;
+	for (int fd = 0; fd < nfds; ++fd) {
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = 0;
+		pfd.revents = 0;
+		if (readfds && FD_ISSET(fd, readfds)) {
+			pfd.events |= POLLIN;
+		}
+		if (writefds && FD_ISSET(fd, writefds)) {
+			pfd.events |= POLLOUT;
+		}
+		if (exceptfds && FD_ISSET(fd, exceptfds)) {
+			pfd.events |= POLLPRI;
+		}
+		if (pfd.events) {
+			fds.push_back(pfd);
+		}
+	}
+
+	int n = poll_hook(fds.data(), fds.size(), timeout_ms);
+	if (n < 0) {
+		return n;
+	}
+	for (size_t i = 0; i < fds.size(); ++i) {
+		if (fds[i].revents & POLLNVAL) {
+			errno = EBADF;
+			return -1;
+		}
+	}
+
+	int count = 0;
+	if (readfds) {
+		FD_ZERO(readfds);
+	}
+	if (writefds) {
+		FD_ZERO(writefds);
+	}
+	if (exceptfds) {
+		FD_ZERO(exceptfds);
+	}
+	for (size_t i = 0; i < fds.size(); ++i) {
+		if ((fds[i].events & POLLIN) && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+			FD_SET(fds[i].fd, readfds);
+			count++;
+		}
+		if ((fds[i].events & POLLOUT) && (fds[i].revents & (POLLOUT | POLLERR))) {
+			FD_SET(fds[i].fd, writefds);
+			count++;
+		}
+		if ((fds[i].events & POLLPRI) && (fds[i].revents & POLLPRI)) {
+			FD_SET(fds[i].fd, exceptfds);
+			count++;
+		}
+	}
+	if (timeout && count == 0) {
+		timeout->tv_sec = 0;
+		timeout->tv_usec = 0;
+	}
+	return count;
+}
+
+int epoll_wait_hook(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+	DebugLog << "this is hook epoll_wait";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || timeout == 0) {
+    return g_sys_epoll_wait_fun(epfd, events, maxevents, timeout);
+  }
+
+	int n = g_sys_epoll_wait_fun(epfd, events, maxevents, 0);
+	if (n != 0) {
+		return n;
+	}
+
+	// epoll fd is readable when it has events
+	struct pollfd pfd;
+	pfd.fd = epfd;
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+	n = poll_hook(&pfd, 1, timeout);
+	if (n <= 0) {
+		return n;
+	}
+	return g_sys_epoll_wait_fun(epfd, events, maxevents, 0);
+}
+
+int fcntl_hook(int fd, int cmd, int flags) {
+	tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
+	if (!fd_event) {
+		return g_sys_fcntl_fun(fd, cmd, flags);
+	}
+	if (cmd == F_GETFL) {
+		int rt = g_sys_fcntl_fun(fd, cmd);
+		if (rt != -1 && fd_event->isHookNonBlock() && !fd_event->isUserNonBlock()) {
+			rt &= ~O_NONBLOCK;
+		}
+		return rt;
+	}
+	if (cmd == F_SETFL) {
+		int sys_flags = flags;
+		if (fd_event->isHookNonBlock()) {
+			sys_flags |= O_NONBLOCK;
+		}
+		int rt = g_sys_fcntl_fun(fd, cmd, sys_flags);
+		if (rt != -1) {
+			fd_event->setUserNonBlock(flags & O_NONBLOCK);
+		}
+		return rt;
+	}
+	return g_sys_fcntl_fun(fd, cmd, flags);
+}
+
+int setsockopt_hook(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
+	if (level == SOL_SOCKET && (optname == SO_RCVTIMEO || optname == SO_SNDTIMEO)
+			&& optval && optlen >= sizeof(struct timeval)) {
+		tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(sockfd);
+		if (fd_event) {
+			const struct timeval* tv = reinterpret_cast<const struct timeval*>(optval);
+			int64_t timeout = tv->tv_sec * 1000 + (tv->tv_usec + 999) / 1000;
+			// 0 means never timeout
+			fd_event->setTimeout(optname == SO_RCVTIMEO ? tinyrpc::IOEvent::READ : tinyrpc::IOEvent::WRITE,
+					timeout > 0 ? timeout : -1);
+		}
+	}
+	return g_sys_setsockopt_fun(sockfd, level, optname, optval, optlen);
+}
+
+int close_hook(int fd) {
+	if (fd >= 0) {
+		tinyrpc::FdEvent::ptr fd_event = tinyrpc::FdEventContainer::GetFdContainer()->getFdEvent(fd);
+		if (fd_event) {
+			// fd number may be reused by others at once
+			if (fd_event->getReactor()) {
+				fd_event->unregisterFromReactor();
+			}
+			fd_event->resetUserState();
+		}
+	}
+	return g_sys_close_fun(fd);
+}
+
+// yield current coroutine for ms, 0 means just let others run first
+static void sleepMs(int64_t ms) {
+	tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
+	if (ms <= 0) {
+		tinyrpc::Reactor::GetReactor()->schedule(cur_cor);
+		tinyrpc::Coroutine::Yield();
+		return;
+	}
+
+	std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+	addTimeoutEvent(ms, is_timeout);
+
+	DebugLog << "now to yield sleep";
+	// beacuse read or wirte maybe resume this coroutine, so when this cor be resumed, must check is timeout, otherwise should yield again
+	while (!*is_timeout) {
+		tinyrpc::Coroutine::Yield();
+	}
+}
+
 unsigned int sleep_hook(unsigned int seconds) {
 
 	DebugLog << "this is hook sleep";
@@ -262,29 +800,35 @@ unsigned int sleep_hook(unsigned int seconds) {
     return g_sys_sleep_fun(seconds);
   }
 
-	tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
+	sleepMs(1000 * (int64_t)seconds);
+	return 0;
 
-	bool is_timeout = false;
-	auto timeout_cb = [cur_cor, &is_timeout](){
-		DebugLog << "onTime, now resume sleep cor";
-		is_timeout = true;
-		// 设置超时标志，然后唤醒协程
-		tinyrpc::Coroutine::Resume(cur_cor);
-  };
+}
 
-  tinyrpc::TimerEvent::ptr event = std::make_shared<tinyrpc::TimerEvent>(1000 * seconds, false, timeout_cb);
-  
-  tinyrpc::Reactor::GetReactor()->getTimer()->addTimerEvent(event);
+int usleep_hook(useconds_t usec) {
+	DebugLog << "this is hook usleep";
+  if (tinyrpc::Coroutine::IsMainCoroutine()) {
+    return g_sys_usleep_fun(usec);
+  }
 
-	DebugLog << "now to yield sleep";
-	// beacuse read or wirte maybe resume this coroutine, so when this cor be resumed, must check is timeout, otherwise should yield again
-	tinyrpc::Coroutine::Yield();
+	sleepMs(((int64_t)usec + 999) / 1000);
+	return 0;
+}
 
-	// 定时器也需要删除
-	// tinyrpc::Reactor::GetReactor()->getTimer()->delTimerEvent(event);
+int nanosleep_hook(const struct timespec *req, struct timespec *rem) {
+	DebugLog << "this is hook nanosleep";
+  if (tinyrpc::Coroutine::IsMainCoroutine() || req == nullptr
+      || req->tv_sec < 0 || req->tv_nsec < 0 || req->tv_nsec >= 1000000000) {
+    // sys func reports invalid argument
+    return g_sys_nanosleep_fun(req, rem);
+  }
 
+	sleepMs((int64_t)req->tv_sec * 1000 + (req->tv_nsec + 999999) / 1000000);
+	if (rem) {
+		rem->tv_sec = 0;
+		rem->tv_nsec = 0;
+	}
 	return 0;
-
 }
 
 
@@ -318,6 +862,22 @@ ssize_t write(int fd, const void *buf, size_t count) {
 	}
 }
 
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_readv_fun(fd, iov, iovcnt);
+	} else {
+		return tinyrpc::readv_hook(fd, iov, iovcnt);
+	}
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_writev_fun(fd, iov, iovcnt);
+	} else {
+		return tinyrpc::writev_hook(fd, iov, iovcnt);
+	}
+}
+
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
 		return g_sys_connect_fun(sockfd, addr, addrlen);
@@ -334,4 +894,152 @@ unsigned int sleep(unsigned int seconds) {
 	}
 }
 
-}
\ No newline at end of file
+int usleep(useconds_t usec) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_usleep_fun(usec);
+	} else {
+		return tinyrpc::usleep_hook(usec);
+	}
+}
+
+int nanosleep(const struct timespec *req, struct timespec *rem) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_nanosleep_fun(req, rem);
+	} else {
+		return tinyrpc::nanosleep_hook(req, rem);
+	}
+}
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_recv_fun(sockfd, buf, len, flags);
+	} else {
+		return tinyrpc::recv_hook(sockfd, buf, len, flags);
+	}
+}
+
+ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_recvfrom_fun(sockfd, buf, len, flags, src_addr, addrlen);
+	} else {
+		return tinyrpc::recvfrom_hook(sockfd, buf, len, flags, src_addr, addrlen);
+	}
+}
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_recvmsg_fun(sockfd, msg, flags);
+	} else {
+		return tinyrpc::recvmsg_hook(sockfd, msg, flags);
+	}
+}
+
+ssize_t send(int sockfd, const void *buf, size_t len, int flags) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_send_fun(sockfd, buf, len, flags);
+	} else {
+		return tinyrpc::send_hook(sockfd, buf, len, flags);
+	}
+}
+
+ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_sendto_fun(sockfd, buf, len, flags, dest_addr, addrlen);
+	} else {
+		return tinyrpc::sendto_hook(sockfd, buf, len, flags, dest_addr, addrlen);
+	}
+}
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_sendmsg_fun(sockfd, msg, flags);
+	} else {
+		return tinyrpc::sendmsg_hook(sockfd, msg, flags);
+	}
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_poll_fun(fds, nfds, timeout);
+	} else {
+		return tinyrpc::poll_hook(fds, nfds, timeout);
+	}
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_select_fun(nfds, readfds, writefds, exceptfds, timeout);
+	} else {
+		return tinyrpc::select_hook(nfds, readfds, writefds, exceptfds, timeout);
+	}
+}
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout) {
+	if (!tinyrpc::g_hook || !tinyrpc::Coroutine::GetCoroutineSwapFlag()) {
+		return g_sys_epoll_wait_fun(epfd, events, maxevents, timeout);
+	} else {
+		return tinyrpc::epoll_wait_hook(epfd, events, maxevents, timeout);
+	}
+}
+
+// flags of fd are kept even if hook is disabled in this thread, fd may be used by other threads
+int fcntl(int fd, int cmd, ...) {
+	va_list args;
+	va_start(args, cmd);
+	switch (cmd) {
+		// commands without argument
+		case F_GETFD:
+		case F_GETFL:
+		case F_GETOWN:
+		case F_GETSIG:
+		case F_GETLEASE:
+		case F_GETPIPE_SZ: {
+			va_end(args);
+			if (cmd == F_GETFL && tinyrpc::g_hook) {
+				return tinyrpc::fcntl_hook(fd, cmd, 0);
+			}
+			return g_sys_fcntl_fun(fd, cmd);
+		}
+		// commands with int argument
+		case F_DUPFD:
+		case F_DUPFD_CLOEXEC:
+		case F_SETFD:
+		case F_SETFL:
+		case F_SETOWN:
+		case F_SETSIG:
+		case F_SETLEASE:
+		case F_NOTIFY:
+		case F_SETPIPE_SZ: {
+			int arg = va_arg(args, int);
+			va_end(args);
+			if (cmd == F_SETFL && tinyrpc::g_hook) {
+				return tinyrpc::fcntl_hook(fd, cmd, arg);
+			}
+			return g_sys_fcntl_fun(fd, cmd, arg);
+		}
+		// others take a pointer, such as locks
+		default: {
+			void* arg = va_arg(args, void*);
+			va_end(args);
+			return g_sys_fcntl_fun(fd, cmd, arg);
+		}
+	}
+}
+
+int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) __THROW {
+	if (!tinyrpc::g_hook) {
+		return g_sys_setsockopt_fun(sockfd, level, optname, optval, optlen);
+	} else {
+		return tinyrpc::setsockopt_hook(sockfd, level, optname, optval, optlen);
+	}
+}
+
+int close(int fd) {
+	if (!tinyrpc::g_hook) {
+		return g_sys_close_fun(fd);
+	} else {
+		return tinyrpc::close_hook(fd);
+	}
+}
+
+}
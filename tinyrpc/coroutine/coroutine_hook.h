@@ -2,13 +2,24 @@
 #define TINYRPC_COROUTINE_COUROUTINE_HOOK_H
 
 #include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/select.h>
+#include <sys/epoll.h>
 
 typedef ssize_t (*read_fun_ptr_t)(int fd, void *buf, size_t count);
 
 typedef ssize_t (*write_fun_ptr_t)(int fd, const void *buf, size_t count);
 
+typedef ssize_t (*readv_fun_ptr_t)(int fd, const struct iovec *iov, int iovcnt);
+
+typedef ssize_t (*writev_fun_ptr_t)(int fd, const struct iovec *iov, int iovcnt);
+
 typedef int (*connect_fun_ptr_t)(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 
 typedef int (*accept_fun_ptr_t)(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
@@ -17,19 +28,112 @@ typedef int (*socket_fun_ptr_t)(int domain, int type, int protocol);
 
 typedef int (*sleep_fun_ptr_t)(unsigned int seconds);
 
+typedef int (*usleep_fun_ptr_t)(useconds_t usec);
+
+typedef int (*nanosleep_fun_ptr_t)(const struct timespec *req, struct timespec *rem);
+
+typedef ssize_t (*recv_fun_ptr_t)(int sockfd, void *buf, size_t len, int flags);
+
+typedef ssize_t (*recvfrom_fun_ptr_t)(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
+
+typedef ssize_t (*recvmsg_fun_ptr_t)(int sockfd, struct msghdr *msg, int flags);
+
+typedef ssize_t (*send_fun_ptr_t)(int sockfd, const void *buf, size_t len, int flags);
+
+typedef ssize_t (*sendto_fun_ptr_t)(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
+
+typedef ssize_t (*sendmsg_fun_ptr_t)(int sockfd, const struct msghdr *msg, int flags);
+
+typedef int (*poll_fun_ptr_t)(struct pollfd *fds, nfds_t nfds, int timeout);
+
+typedef int (*select_fun_ptr_t)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+
+typedef int (*epoll_wait_fun_ptr_t)(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+typedef int (*fcntl_fun_ptr_t)(int fd, int cmd, ...);
+
+typedef int (*setsockopt_fun_ptr_t)(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+
+typedef int (*close_fun_ptr_t)(int fd);
+
 
 namespace tinyrpc {
 
+class Coroutine;
+
+//
+// Deadline of hooked io in current coroutine, like SO_RCVTIMEO and SO_SNDTIMEO of every fd.
+// accept/read/write/readv/writev/connect which have to wait return -1 with errno ETIMEDOUT after it.
+// old deadline is restored when it's destroyed, nested one can't extend deadline of outer one
+//
+class ScopedDeadline {
+
+ public:
+  // timeout is ms from now, no new deadline if it's not greater than 0
+  explicit ScopedDeadline(int64_t timeout);
+
+  ~ScopedDeadline();
+
+  bool isExpired() const;
+
+  // restore old deadline before it's destroyed
+  void restore();
+
+ private:
+  Coroutine* m_cor {nullptr};
+  int64_t m_old_deadline {0};
+  int64_t m_deadline {0};
+
+};
+
 int accept_hook(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
 
 ssize_t read_hook(int fd, void *buf, size_t count);
 
 ssize_t write_hook(int fd, const void *buf, size_t count);
 
+ssize_t readv_hook(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t writev_hook(int fd, const struct iovec *iov, int iovcnt);
+
 int connect_hook(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 
 unsigned int sleep_hook(unsigned int seconds);
 
+int usleep_hook(useconds_t usec);
+
+int nanosleep_hook(const struct timespec *req, struct timespec *rem);
+
+ssize_t recv_hook(int sockfd, void *buf, size_t len, int flags);
+
+ssize_t recvfrom_hook(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
+
+ssize_t recvmsg_hook(int sockfd, struct msghdr *msg, int flags);
+
+ssize_t send_hook(int sockfd, const void *buf, size_t len, int flags);
+
+ssize_t sendto_hook(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
+
+ssize_t sendmsg_hook(int sockfd, const struct msghdr *msg, int flags);
+
+// fds are registered to reactor while waiting, then polled again without timeout
+int poll_hook(struct pollfd *fds, nfds_t nfds, int timeout);
+
+// converted to poll_hook
+int select_hook(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+
+// wait for epfd to be readable by poll_hook
+int epoll_wait_hook(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+// O_NONBLOCK of user is kept in FdEvent, fd is always non-blocking for hooks
+int fcntl_hook(int fd, int cmd, int flags);
+
+// SO_RCVTIMEO and SO_SNDTIMEO are kept in FdEvent, hooks return EAGAIN after them
+int setsockopt_hook(int sockfd, int level, int optname, const void *optval, socklen_t optlen);
+
+// unregister fd from reactor and forget its flags, it can be called by any thread
+int close_hook(int fd);
+
 void SetHook(bool);
 
 }
@@ -42,10 +146,42 @@ ssize_t read(int fd, void *buf, size_t count);
 
 ssize_t write(int fd, const void *buf, size_t count);
 
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
 int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen);
 
 unsigned int sleep(unsigned int seconds);
 
+int usleep(useconds_t usec);
+
+int nanosleep(const struct timespec *req, struct timespec *rem);
+
+ssize_t recv(int sockfd, void *buf, size_t len, int flags);
+
+ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen);
+
+ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags);
+
+ssize_t send(int sockfd, const void *buf, size_t len, int flags);
+
+ssize_t sendto(int sockfd, const void *buf, size_t len, int flags, const struct sockaddr *dest_addr, socklen_t addrlen);
+
+ssize_t sendmsg(int sockfd, const struct msghdr *msg, int flags);
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+
+int epoll_wait(int epfd, struct epoll_event *events, int maxevents, int timeout);
+
+int fcntl(int fd, int cmd, ...);
+
+int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) __THROW;
+
+int close(int fd);
+
 }
 
 #endif
\ No newline at end of file
@@ -1,5 +1,7 @@
 #include <vector>
+#include <algorithm>
 #include "tinyrpc/comm/config.h"
+#include "tinyrpc/comm/log.h"
 #include "tinyrpc/coroutine/coroutine_pool.h"
 #include "tinyrpc/coroutine/coroutine.h"
 
@@ -12,26 +14,23 @@ static thread_local CoroutinePool* t_coroutine_container_ptr = nullptr;
 
 CoroutinePool* GetCoroutinePool() {
   if (!t_coroutine_container_ptr) {
-    t_coroutine_container_ptr = new CoroutinePool(gRpcConfig->m_cor_pool_size, gRpcConfig->m_cor_stack_size);
+    t_coroutine_container_ptr = new CoroutinePool(gRpcConfig->m_cor_pool_size, gRpcConfig->m_cor_stack_size,
+        gRpcConfig->m_cor_share_stack_count > 0);
   }
   return t_coroutine_container_ptr;
 }
 
 
-CoroutinePool::CoroutinePool(int pool_size, int stack_size /*= 1024 * 128*/) : m_pool_size(pool_size), m_stack_size(stack_size) {
-  m_index = getCoroutineIndex();
+// idle coroutines whose stacks keep physical memory, stacks of others are released
+static const size_t MAX_WARM_COROUTINES = 128;
 
-  if (m_index == 0) {
-    // skip main coroutine
-    m_index = 1;
-  }
-
-  m_free_cors.resize(pool_size + m_index);
-
-  for (int i = m_index; i < pool_size + m_index; ++i) {
-    m_free_cors[i] = std::make_pair(std::make_shared<Coroutine>(stack_size), false);
-  }
+// check suspended coroutines when there are at least this many
+static const size_t MIN_SWEEP_SIZE = 64;
 
+CoroutinePool::CoroutinePool(int pool_size, int stack_size /*= 1024 * 128*/, bool is_share_stack /*= false*/)
+  : m_pool_size(pool_size), m_stack_size(stack_size), m_is_share_stack(is_share_stack) {
+  // coroutines are created when needed
+  m_free_cors.reserve(pool_size);
 }
 
 CoroutinePool::~CoroutinePool() {
@@ -40,24 +39,64 @@ CoroutinePool::~CoroutinePool() {
 
 Coroutine::ptr CoroutinePool::getCoroutineInstanse() {
 
-  for (int i = m_index; i < m_pool_size; ++i) {
-    if (!m_free_cors[i].first->getIsInCoFunc() && !m_free_cors[i].second) {
-      m_free_cors[i].second = true;
-      return m_free_cors[i].first;
+  // coroutine returns itself before its function ends, can't use it until it ends
+  if (!m_free_cors.empty() && !m_free_cors.back()->getIsInCoFunc()) {
+    Coroutine::ptr cor = m_free_cors.back();
+    m_free_cors.pop_back();
+    if (m_cold_count > m_free_cors.size()) {
+      m_cold_count = m_free_cors.size();
     }
+    cor->setIsInPool(false);
+    return cor;
   }
-  int newsize = (int)(1.5 * m_pool_size);
-  for (int i = 0; i < newsize - m_pool_size; ++i) {
-    m_free_cors.push_back(m_free_cors[i] = std::make_pair(std::make_shared<Coroutine>(m_stack_size), false));
-  }
-  int tmp = m_pool_size;
-  m_pool_size = newsize;
-  return m_free_cors[tmp].first;
+  return std::make_shared<Coroutine>(m_stack_size, m_is_share_stack ? Share_Stack : Own_Stack);
 
 }
 
 void CoroutinePool::returnCoroutine(Coroutine::ptr cor) {
-  m_free_cors[cor->getCorId()].second = false;
+  if (cor->getIsInPool()) {
+    ErrorLog << "coroutine[" << cor->getCorId() << "] has already been returned";
+    return;
+  }
+  if (cor->getIsInCoFunc() && cor.get() != Coroutine::GetCurrentCoroutine()) {
+    // it's suspended, may be resumed later, so keep it alive until its function ends
+    DebugLog << "coroutine[" << cor->getCorId() << "] is still running, don't reuse it now";
+    m_suspended_cors.push_back(cor);
+    if (m_suspended_cors.size() >= m_next_sweep) {
+      sweepSuspended();
+    }
+    return;
+  }
+  pushFree(cor);
+}
+
+void CoroutinePool::pushFree(Coroutine::ptr cor) {
+  if ((int)m_free_cors.size() >= m_pool_size && !cor->getIsInCoFunc()) {
+    // too many idle coroutines, shrink
+    return;
+  }
+
+  cor->setIsInPool(true);
+  m_free_cors.push_back(cor);
+
+  // coroutine which returned itself may be still in its function, it's released by a later push after it ends
+  if (m_free_cors.size() - m_cold_count > MAX_WARM_COROUTINES && m_free_cors[m_cold_count]->releaseStackMemory()) {
+    m_cold_count++;
+  }
+}
+
+void CoroutinePool::sweepSuspended() {
+  size_t j = 0;
+  for (size_t i = 0; i < m_suspended_cors.size(); ++i) {
+    if (m_suspended_cors[i]->getIsInCoFunc()) {
+      m_suspended_cors[j++] = m_suspended_cors[i];
+    } else {
+      pushFree(m_suspended_cors[i]);
+    }
+  }
+  m_suspended_cors.resize(j);
+  // amortized O(1) for each returned coroutine
+  m_next_sweep = std::max(MIN_SWEEP_SIZE, 2 * j);
 }
 
 
@@ -9,7 +9,7 @@ namespace tinyrpc {
 class CoroutinePool {
 
  public:
-  CoroutinePool(int pool_size, int stack_size = 1024 * 128);
+  CoroutinePool(int pool_size, int stack_size = 1024 * 128, bool is_share_stack = false);
   ~CoroutinePool();
 
   Coroutine::ptr getCoroutineInstanse();
@@ -17,15 +17,24 @@ class CoroutinePool {
   void returnCoroutine(Coroutine::ptr cor);
 
  private:
-  int m_index {0};
-  int m_pool_size {0};
+  void pushFree(Coroutine::ptr cor);
+
+  void sweepSuspended();
+
+ private:
+  int m_pool_size {0};      // max count of idle coroutines, more returned coroutines will be destroyed
   int m_stack_size {0};
+  bool m_is_share_stack {false};      // coroutines of this pool run on shared stacks
+
+  // idle coroutines, used as a stack, so the latest returned one (its stack is still hot) is used first
+  std::vector<Coroutine::ptr> m_free_cors;
+
+  // stacks of m_free_cors[0, m_cold_count) have been released by madvise
+  size_t m_cold_count {0};
 
-  // first--ptr of cor
-  // second
-  //    false -- can be dispatched
-  //    true -- can't be dispatched
-  std::vector<std::pair<Coroutine::ptr, bool>> m_free_cors;
+  // returned before their functions end, they become free when function ends
+  std::vector<Coroutine::ptr> m_suspended_cors;
+  size_t m_next_sweep {64};
 
 };
 
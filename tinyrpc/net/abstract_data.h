@@ -1,6 +1,8 @@
 #ifndef TINYRPC_NET_ABSTRACT_DATA_H
 #define TINYRPC_NET_ABSTRACT_DATA_H
 
+#include <stdint.h>
+
 namespace tinyrpc {
 
 class AbstractData {
@@ -10,6 +12,9 @@ class AbstractData {
 
   bool decode_succ {false};
   bool encode_succ {false};
+
+  int64_t decode_time {0};    // when it's decoded, us
+  int32_t decode_len {0};     // bytes read from buffer by decode
 };
 
 
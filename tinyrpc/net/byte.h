@@ -7,7 +7,7 @@
 
 namespace tinyrpc {
 
-int32_t getInt32FromNetByte(const char* buf) {
+inline int32_t getInt32FromNetByte(const char* buf) {
   int32_t tmp;
   memcpy(&tmp, buf, sizeof(tmp));
   return ntohl(tmp);
@@ -0,0 +1,501 @@
+#ifndef TINYRPC_NET_CO_CHANNEL_H
+#define TINYRPC_NET_CO_CHANNEL_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include "tinyrpc/net/mutex.h"
+#include "tinyrpc/net/co_mutex.h"
+#include "tinyrpc/net/reactor.h"
+#include "tinyrpc/net/timer.h"
+#include "tinyrpc/coroutine/coroutine.h"
+#include "tinyrpc/comm/log.h"
+
+namespace tinyrpc {
+
+//
+// Go style channel for coroutines, it can be used by coroutines of different IOThreads.
+// capacity is 0 means unbuffered, sender waits until a receiver takes the value.
+// send, recv and Selector::select only suspend current coroutine when they have to wait,
+// main coroutine blocks its thread instead like CoMutex.
+//
+//   Channel<int>::ptr ch = std::make_shared<Channel<int>>(10);
+//   ch->send(1);                     // false if channel is closed
+//   int v = 0;
+//   ch->recv(v);                     // false if channel is closed and empty
+//
+//   Selector sel;
+//   sel.addRecv(ch, &v);             // case 0
+//   sel.addSend(other_ch, 2);        // case 1
+//   int index = sel.select(100);     // index of case which is done, -1 if timeout
+//
+
+// state of one select (or one send/recv), shared by all its waiters in channels
+struct SelectState {
+  static const int NOT_FIRED = -1;
+  static const int TIMEOUT = -2;
+
+  // only one case of a select can be done, the one who fires state does it
+  bool tryFire(int index) {
+    int expected = NOT_FIRED;
+    return fired.compare_exchange_strong(expected, index);
+  }
+
+  std::atomic<int> fired {NOT_FIRED};
+  CoWaiter waiter;
+};
+
+// value and result are on heap, stack of waiting coroutine may be used by others if it runs on share stack
+template <class T>
+struct ChannelWaiter {
+  typedef std::shared_ptr<ChannelWaiter<T>> ptr;
+
+  std::shared_ptr<SelectState> state;
+  int index {0};
+  T value;
+  bool ok {false};
+};
+
+
+class ChannelBase {
+
+ public:
+  virtual ~ChannelBase() {}
+
+  Mutex& getMutex() {
+    return m_mutex;
+  }
+
+ protected:
+  Mutex m_mutex;
+  bool m_closed {false};
+
+};
+
+
+template <class T>
+class Channel : public ChannelBase {
+
+ public:
+  typedef std::shared_ptr<Channel<T>> ptr;
+
+  typedef typename ChannelWaiter<T>::ptr WaiterPtr;
+
+  explicit Channel(size_t capacity = 0) : m_capacity(capacity) {}
+
+  ~Channel() {}
+
+  bool send(const T& value);
+
+  bool recv(T& value);
+
+  // don't wait, false if it can't be done now
+  bool trySend(const T& value) {
+    Mutex::Lock lock(m_mutex);
+    T tmp = value;
+    bool ok = false;
+    return pollSend(tmp, ok) && ok;
+  }
+
+  bool tryRecv(T& value) {
+    Mutex::Lock lock(m_mutex);
+    bool ok = false;
+    return pollRecv(value, ok) && ok;
+  }
+
+  // waiting senders fail and waiting receivers get false, values in buffer can still be received
+  void close() {
+    std::vector<WaiterPtr> waiters;
+    Mutex::Lock lock(m_mutex);
+    m_closed = true;
+    waiters.insert(waiters.end(), m_recv_waiters.begin(), m_recv_waiters.end());
+    waiters.insert(waiters.end(), m_send_waiters.begin(), m_send_waiters.end());
+    m_recv_waiters.clear();
+    m_send_waiters.clear();
+    lock.unlock();
+
+    for (size_t i = 0; i < waiters.size(); ++i) {
+      if (waiters[i]->state->tryFire(waiters[i]->index)) {
+        waiters[i]->ok = false;
+        wakeupCoWaiter(waiters[i]->state->waiter);
+      }
+    }
+  }
+
+  bool isClosed() {
+    Mutex::Lock lock(m_mutex);
+    return m_closed;
+  }
+
+  size_t size() {
+    Mutex::Lock lock(m_mutex);
+    return m_buffer.size();
+  }
+
+  size_t capacity() const {
+    return m_capacity;
+  }
+
+ public:
+  // below are used by Selector, m_mutex must be locked
+
+  // return true if send is done (ok is false if channel is closed)
+  bool pollSend(T& value, bool& ok) {
+    if (m_closed) {
+      ok = false;
+      return true;
+    }
+    WaiterPtr receiver = popWaiter(m_recv_waiters);
+    if (receiver) {
+      receiver->value = std::move(value);
+      receiver->ok = true;
+      wakeupCoWaiter(receiver->state->waiter);
+      ok = true;
+      return true;
+    }
+    if (m_buffer.size() < m_capacity) {
+      m_buffer.push_back(std::move(value));
+      ok = true;
+      return true;
+    }
+    return false;
+  }
+
+  // return true if recv is done (ok is false if channel is closed and empty)
+  bool pollRecv(T& value, bool& ok) {
+    if (!m_buffer.empty()) {
+      value = std::move(m_buffer.front());
+      m_buffer.pop_front();
+      // a sender can put its value into buffer now
+      WaiterPtr sender = popWaiter(m_send_waiters);
+      if (sender) {
+        m_buffer.push_back(std::move(sender->value));
+        sender->ok = true;
+        wakeupCoWaiter(sender->state->waiter);
+      }
+      ok = true;
+      return true;
+    }
+    WaiterPtr sender = popWaiter(m_send_waiters);
+    if (sender) {
+      value = std::move(sender->value);
+      sender->ok = true;
+      wakeupCoWaiter(sender->state->waiter);
+      ok = true;
+      return true;
+    }
+    if (m_closed) {
+      ok = false;
+      return true;
+    }
+    return false;
+  }
+
+  void addSendWaiter(WaiterPtr waiter) {
+    m_send_waiters.push_back(waiter);
+  }
+
+  void addRecvWaiter(WaiterPtr waiter) {
+    m_recv_waiters.push_back(waiter);
+  }
+
+  void removeWaiter(WaiterPtr waiter) {
+    removeWaiter(m_send_waiters, waiter);
+    removeWaiter(m_recv_waiters, waiter);
+  }
+
+ private:
+  // first waiter whose select isn't done by other cases, it's fired
+  WaiterPtr popWaiter(std::deque<WaiterPtr>& waiters) {
+    while (!waiters.empty()) {
+      WaiterPtr waiter = waiters.front();
+      waiters.pop_front();
+      if (waiter->state->tryFire(waiter->index)) {
+        return waiter;
+      }
+    }
+    return WaiterPtr();
+  }
+
+  void removeWaiter(std::deque<WaiterPtr>& waiters, WaiterPtr waiter) {
+    auto it = std::find(waiters.begin(), waiters.end(), waiter);
+    if (it != waiters.end()) {
+      waiters.erase(it);
+    }
+  }
+
+ private:
+  size_t m_capacity {0};
+  std::deque<T> m_buffer;
+  std::deque<WaiterPtr> m_send_waiters;
+  std::deque<WaiterPtr> m_recv_waiters;
+
+};
+
+
+class SelectCase {
+
+ public:
+  virtual ~SelectCase() {}
+
+  virtual ChannelBase* getChannel() = 0;
+
+  // try to do it now, channel is locked
+  virtual bool poll() = 0;
+
+  // add waiter to channel, channel is locked
+  virtual void wait(std::shared_ptr<SelectState> state, int index) = 0;
+
+  // remove waiter from channel, and get result if this case is fired
+  virtual void finish(bool is_fired) = 0;
+
+};
+
+template <class T>
+class SendCase : public SelectCase {
+
+ public:
+  SendCase(Channel<T>* channel, const T& value, bool* ok)
+    : m_channel(channel), m_value(value), m_ok(ok) {}
+
+  ChannelBase* getChannel() {
+    return m_channel;
+  }
+
+  bool poll() {
+    bool ok = false;
+    if (!m_channel->pollSend(m_value, ok)) {
+      return false;
+    }
+    if (m_ok) {
+      *m_ok = ok;
+    }
+    return true;
+  }
+
+  void wait(std::shared_ptr<SelectState> state, int index) {
+    m_waiter = std::make_shared<ChannelWaiter<T>>();
+    m_waiter->state = state;
+    m_waiter->index = index;
+    m_waiter->value = std::move(m_value);
+    m_channel->addSendWaiter(m_waiter);
+  }
+
+  void finish(bool is_fired) {
+    if (!m_waiter) {
+      return;
+    }
+    Mutex::Lock lock(m_channel->getMutex());
+    m_channel->removeWaiter(m_waiter);
+    lock.unlock();
+    if (is_fired && m_ok) {
+      *m_ok = m_waiter->ok;
+    }
+  }
+
+ private:
+  Channel<T>* m_channel {nullptr};     // kept alive by caller of select
+  T m_value;
+  bool* m_ok {nullptr};
+  typename ChannelWaiter<T>::ptr m_waiter;
+
+};
+
+template <class T>
+class RecvCase : public SelectCase {
+
+ public:
+  RecvCase(Channel<T>* channel, T* value, bool* ok)
+    : m_channel(channel), m_value(value), m_ok(ok) {}
+
+  ChannelBase* getChannel() {
+    return m_channel;
+  }
+
+  bool poll() {
+    bool ok = false;
+    T tmp;
+    if (!m_channel->pollRecv(tmp, ok)) {
+      return false;
+    }
+    if (m_value && ok) {
+      *m_value = std::move(tmp);
+    }
+    if (m_ok) {
+      *m_ok = ok;
+    }
+    return true;
+  }
+
+  void wait(std::shared_ptr<SelectState> state, int index) {
+    m_waiter = std::make_shared<ChannelWaiter<T>>();
+    m_waiter->state = state;
+    m_waiter->index = index;
+    m_channel->addRecvWaiter(m_waiter);
+  }
+
+  void finish(bool is_fired) {
+    if (!m_waiter) {
+      return;
+    }
+    Mutex::Lock lock(m_channel->getMutex());
+    m_channel->removeWaiter(m_waiter);
+    lock.unlock();
+    if (is_fired) {
+      if (m_value && m_waiter->ok) {
+        *m_value = std::move(m_waiter->value);
+      }
+      if (m_ok) {
+        *m_ok = m_waiter->ok;
+      }
+    }
+  }
+
+ private:
+  Channel<T>* m_channel {nullptr};     // kept alive by caller of select
+  T* m_value {nullptr};
+  bool* m_ok {nullptr};
+  typename ChannelWaiter<T>::ptr m_waiter;
+
+};
+
+
+//
+// Wait until one of cases is done. If more than one are ready, the first added one is done.
+// Only used once, add cases again for next select
+//
+class Selector {
+
+ public:
+  Selector() {}
+
+  ~Selector() {}
+
+  // ok is set false if channel is closed (and empty for recv)
+  template <class T>
+  int addSend(Channel<T>* channel, const T& value, bool* ok = nullptr) {
+    m_cases.push_back(std::unique_ptr<SelectCase>(new SendCase<T>(channel, value, ok)));
+    return (int)m_cases.size() - 1;
+  }
+
+  template <class T>
+  int addSend(std::shared_ptr<Channel<T>> channel, const T& value, bool* ok = nullptr) {
+    return addSend(channel.get(), value, ok);
+  }
+
+  template <class T>
+  int addRecv(Channel<T>* channel, T* value, bool* ok = nullptr) {
+    m_cases.push_back(std::unique_ptr<SelectCase>(new RecvCase<T>(channel, value, ok)));
+    return (int)m_cases.size() - 1;
+  }
+
+  template <class T>
+  int addRecv(std::shared_ptr<Channel<T>> channel, T* value, bool* ok = nullptr) {
+    return addRecv(channel.get(), value, ok);
+  }
+
+  // index of case which is done, -1 if timeout. timeout(ms) < 0 means wait forever, 0 means don't wait
+  int select(int timeout = -1) {
+    // lock all channels in address order, so no one can change them until current coroutine waits on them
+    std::vector<ChannelBase*> channels;
+    for (size_t i = 0; i < m_cases.size(); ++i) {
+      channels.push_back(m_cases[i]->getChannel());
+    }
+    std::sort(channels.begin(), channels.end());
+    channels.erase(std::unique(channels.begin(), channels.end()), channels.end());
+    for (size_t i = 0; i < channels.size(); ++i) {
+      channels[i]->getMutex().lock();
+    }
+
+    int index = -1;
+    for (size_t i = 0; i < m_cases.size(); ++i) {
+      if (m_cases[i]->poll()) {
+        index = (int)i;
+        break;
+      }
+    }
+
+    bool is_wait = (index == -1 && timeout != 0);
+    std::shared_ptr<SelectState> state;
+    if (is_wait) {
+      state = std::make_shared<SelectState>();
+      state->waiter = getCurrentCoWaiter();
+      for (size_t i = 0; i < m_cases.size(); ++i) {
+        m_cases[i]->wait(state, (int)i);
+      }
+    }
+
+    for (size_t i = 0; i < channels.size(); ++i) {
+      channels[i]->getMutex().unlock();
+    }
+    if (!is_wait) {
+      return index;
+    }
+
+    if (state->waiter.thread) {
+      // main coroutine blocks its thread, reactor of this thread can't run timer for it
+      if (!state->waiter.thread->wait(timeout) && !state->tryFire(SelectState::TIMEOUT)) {
+        // other case fires at the same time, wait for its notify so it can't wake next wait of this thread
+        state->waiter.thread->wait();
+      }
+      return finishSelect(state);
+    }
+
+    TimerEvent::ptr event;
+    if (timeout > 0) {
+      auto timer_cb = [state]() {
+        if (state->tryFire(SelectState::TIMEOUT)) {
+          wakeupCoWaiter(state->waiter);
+        }
+      };
+      event = std::make_shared<TimerEvent>(timeout, false, timer_cb);
+      Reactor::GetReactor()->getTimer()->addTimerEvent(event);
+    }
+
+    // coroutine may be resumed by others, such as read or write of a fd, wait until select is fired
+    while (state->fired.load() == SelectState::NOT_FIRED) {
+      Coroutine::Yield();
+    }
+
+    if (event) {
+      Reactor::GetReactor()->getTimer()->delTimerEvent(event);
+    }
+    return finishSelect(state);
+  }
+
+ private:
+  int finishSelect(const std::shared_ptr<SelectState>& state) {
+    int index = state->fired.load();
+    for (size_t i = 0; i < m_cases.size(); ++i) {
+      m_cases[i]->finish((int)i == index);
+    }
+    return index >= 0 ? index : -1;
+  }
+
+  std::vector<std::unique_ptr<SelectCase>> m_cases;
+
+};
+
+
+template <class T>
+bool Channel<T>::send(const T& value) {
+  bool ok = false;
+  Selector sel;
+  sel.addSend(this, value, &ok);
+  return sel.select() == 0 && ok;
+}
+
+template <class T>
+bool Channel<T>::recv(T& value) {
+  bool ok = false;
+  Selector sel;
+  sel.addRecv(this, &value, &ok);
+  return sel.select() == 0 && ok;
+}
+
+}
+
+#endif
@@ -0,0 +1,310 @@
+#include <time.h>
+#include <errno.h>
+#include <vector>
+#include "tinyrpc/net/co_mutex.h"
+#include "tinyrpc/net/reactor.h"
+#include "tinyrpc/comm/log.h"
+#include "tinyrpc/coroutine/coroutine.h"
+
+
+namespace tinyrpc {
+
+static thread_local ThreadWaiter t_thread_waiter;
+
+ThreadWaiter::ThreadWaiter() {
+  pthread_cond_init(&m_condition, nullptr);
+}
+
+ThreadWaiter::~ThreadWaiter() {
+  pthread_cond_destroy(&m_condition);
+}
+
+void ThreadWaiter::reset() {
+  Mutex::Lock lock(m_mutex);
+  m_is_waked = false;
+}
+
+bool ThreadWaiter::wait(int64_t timeout /*= -1*/) {
+  Mutex::Lock lock(m_mutex);
+  if (timeout < 0) {
+    while (!m_is_waked) {
+      pthread_cond_wait(&m_condition, m_mutex.getMutex());
+    }
+    return true;
+  }
+  timespec abstime;
+  clock_gettime(CLOCK_REALTIME, &abstime);
+  int64_t nsec = abstime.tv_nsec + timeout * 1000000;
+  abstime.tv_sec += nsec / 1000000000;
+  abstime.tv_nsec = nsec % 1000000000;
+  while (!m_is_waked) {
+    if (pthread_cond_timedwait(&m_condition, m_mutex.getMutex(), &abstime) == ETIMEDOUT) {
+      return m_is_waked;
+    }
+  }
+  return true;
+}
+
+void ThreadWaiter::notify() {
+  Mutex::Lock lock(m_mutex);
+  m_is_waked = true;
+  pthread_cond_signal(&m_condition);
+}
+
+
+CoWaiter getCurrentCoWaiter(bool is_write /*= false*/) {
+  CoWaiter waiter;
+  waiter.is_write = is_write;
+  if (Coroutine::IsMainCoroutine()) {
+    // reactor of this thread can't run until it's waked up
+    DebugLog << "main coroutine blocks thread to wait";
+    t_thread_waiter.reset();
+    waiter.thread = &t_thread_waiter;
+    return waiter;
+  }
+  waiter.cor = Coroutine::GetCurrentCoroutine();
+  waiter.reactor = Reactor::GetReactor();
+  return waiter;
+}
+
+void waitCoWaiter(const CoWaiter& waiter) {
+  if (waiter.thread) {
+    waiter.thread->wait();
+  } else {
+    Coroutine::Yield();
+  }
+}
+
+void wakeupCoWaiter(const CoWaiter& waiter) {
+  if (waiter.thread) {
+    waiter.thread->notify();
+  } else {
+    waiter.reactor->schedule(waiter.cor);
+  }
+}
+
+
+CoMutex::CoMutex() {}
+
+CoMutex::~CoMutex() {}
+
+void CoMutex::lock() {
+  Mutex::Lock lock(m_mutex);
+  if (!m_locked) {
+    m_locked = true;
+    return;
+  }
+  CoWaiter waiter = getCurrentCoWaiter();
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  // lock is handed over by unlock
+  waitCoWaiter(waiter);
+}
+
+bool CoMutex::tryLock() {
+  Mutex::Lock lock(m_mutex);
+  if (m_locked) {
+    return false;
+  }
+  m_locked = true;
+  return true;
+}
+
+void CoMutex::unlock() {
+  Mutex::Lock lock(m_mutex);
+  if (m_waiters.empty()) {
+    m_locked = false;
+    return;
+  }
+  // keep locked, first waiter owns it now
+  CoWaiter waiter = m_waiters.front();
+  m_waiters.pop_front();
+  lock.unlock();
+
+  wakeupCoWaiter(waiter);
+}
+
+
+CoRWMutex::CoRWMutex() {}
+
+CoRWMutex::~CoRWMutex() {}
+
+void CoRWMutex::rdlock() {
+  Mutex::Lock lock(m_mutex);
+  // don't go ahead of waiting writers
+  if (!m_writer && m_waiters.empty()) {
+    m_readers++;
+    return;
+  }
+  CoWaiter waiter = getCurrentCoWaiter(false);
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  waitCoWaiter(waiter);
+}
+
+void CoRWMutex::wrlock() {
+  Mutex::Lock lock(m_mutex);
+  if (!m_writer && m_readers == 0 && m_waiters.empty()) {
+    m_writer = true;
+    return;
+  }
+  CoWaiter waiter = getCurrentCoWaiter(true);
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  waitCoWaiter(waiter);
+}
+
+void CoRWMutex::unlock() {
+  std::vector<CoWaiter> wakeup_waiters;
+
+  Mutex::Lock lock(m_mutex);
+  if (m_writer) {
+    m_writer = false;
+  } else if (m_readers > 0) {
+    m_readers--;
+  }
+  if (m_readers == 0 && !m_waiters.empty()) {
+    if (m_waiters.front().is_write) {
+      m_writer = true;
+      wakeup_waiters.push_back(m_waiters.front());
+      m_waiters.pop_front();
+    } else {
+      // all readers before next writer get lock together
+      while (!m_waiters.empty() && !m_waiters.front().is_write) {
+        m_readers++;
+        wakeup_waiters.push_back(m_waiters.front());
+        m_waiters.pop_front();
+      }
+    }
+  }
+  lock.unlock();
+
+  for (size_t i = 0; i < wakeup_waiters.size(); ++i) {
+    wakeupCoWaiter(wakeup_waiters[i]);
+  }
+}
+
+
+CoConditionVariable::CoConditionVariable() {}
+
+CoConditionVariable::~CoConditionVariable() {}
+
+void CoConditionVariable::wait(CoMutex& mutex) {
+  Mutex::Lock lock(m_mutex);
+  CoWaiter waiter = getCurrentCoWaiter();
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  // notify between unlock and wait is fine, waiter is only resumed (or its thread waked) after it waits
+  mutex.unlock();
+  waitCoWaiter(waiter);
+  mutex.lock();
+}
+
+void CoConditionVariable::notifyOne() {
+  Mutex::Lock lock(m_mutex);
+  if (m_waiters.empty()) {
+    return;
+  }
+  CoWaiter waiter = m_waiters.front();
+  m_waiters.pop_front();
+  lock.unlock();
+
+  wakeupCoWaiter(waiter);
+}
+
+void CoConditionVariable::notifyAll() {
+  std::deque<CoWaiter> waiters;
+  Mutex::Lock lock(m_mutex);
+  waiters.swap(m_waiters);
+  lock.unlock();
+
+  for (size_t i = 0; i < waiters.size(); ++i) {
+    wakeupCoWaiter(waiters[i]);
+  }
+}
+
+
+CoSemaphore::CoSemaphore(int count /*= 0*/) : m_count(count) {}
+
+CoSemaphore::~CoSemaphore() {}
+
+void CoSemaphore::wait() {
+  Mutex::Lock lock(m_mutex);
+  if (m_count > 0) {
+    m_count--;
+    return;
+  }
+  CoWaiter waiter = getCurrentCoWaiter();
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  // count is handed over by post
+  waitCoWaiter(waiter);
+}
+
+bool CoSemaphore::tryWait() {
+  Mutex::Lock lock(m_mutex);
+  if (m_count > 0) {
+    m_count--;
+    return true;
+  }
+  return false;
+}
+
+void CoSemaphore::post() {
+  Mutex::Lock lock(m_mutex);
+  if (m_waiters.empty()) {
+    m_count++;
+    return;
+  }
+  CoWaiter waiter = m_waiters.front();
+  m_waiters.pop_front();
+  lock.unlock();
+
+  wakeupCoWaiter(waiter);
+}
+
+
+WaitGroup::WaitGroup() {}
+
+WaitGroup::~WaitGroup() {}
+
+void WaitGroup::add(int delta /*= 1*/) {
+  std::deque<CoWaiter> waiters;
+  Mutex::Lock lock(m_mutex);
+  m_count += delta;
+  if (m_count < 0) {
+    ErrorLog << "WaitGroup counter is negative";
+    m_count = 0;
+  }
+  if (m_count == 0) {
+    waiters.swap(m_waiters);
+  }
+  lock.unlock();
+
+  for (size_t i = 0; i < waiters.size(); ++i) {
+    wakeupCoWaiter(waiters[i]);
+  }
+}
+
+void WaitGroup::done() {
+  add(-1);
+}
+
+void WaitGroup::wait() {
+  Mutex::Lock lock(m_mutex);
+  if (m_count == 0) {
+    return;
+  }
+  CoWaiter waiter = getCurrentCoWaiter();
+  m_waiters.push_back(waiter);
+  lock.unlock();
+
+  waitCoWaiter(waiter);
+}
+
+}
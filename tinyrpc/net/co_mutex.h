@@ -0,0 +1,178 @@
+#ifndef TINYRPC_NET_CO_MUTEX_H
+#define TINYRPC_NET_CO_MUTEX_H
+
+#include <deque>
+#include "tinyrpc/net/mutex.h"
+
+namespace tinyrpc {
+
+class Coroutine;
+class Reactor;
+
+//
+// Synchronization primitives for coroutines.
+// A coroutine which has to wait yields and is parked in a queue instead of blocking its thread,
+// waiters are waked up in FIFO order and resumed by the reactor they belong to,
+// so they can be shared by coroutines of different IOThreads.
+// Main coroutine can't yield, so it blocks its thread when it has to wait
+//
+
+// main coroutine of a thread which is blocked, each thread has one
+class ThreadWaiter {
+
+ public:
+  ThreadWaiter();
+
+  ~ThreadWaiter();
+
+  // called before it's put into waiters
+  void reset();
+
+  // block until notify is called or timeout (ms, < 0 means forever), return false if timeout
+  bool wait(int64_t timeout = -1);
+
+  void notify();
+
+ private:
+  Mutex m_mutex;
+  pthread_cond_t m_condition;
+  bool m_is_waked {false};
+
+};
+
+// a parked coroutine, or a blocked thread if thread isn't nullptr
+struct CoWaiter {
+  Coroutine* cor {nullptr};
+  Reactor* reactor {nullptr};
+  ThreadWaiter* thread {nullptr};
+  bool is_write {false};      // only used by CoRWMutex
+};
+
+// waiter of current coroutine, or of current thread if it's main coroutine
+CoWaiter getCurrentCoWaiter(bool is_write = false);
+
+// yield until waiter is waked up, main coroutine blocks its thread instead
+void waitCoWaiter(const CoWaiter& waiter);
+
+// resume waiter in its own reactor, it's only resumed after it has yielded even if it's in other thread
+void wakeupCoWaiter(const CoWaiter& waiter);
+
+
+class CoMutex {
+
+ public:
+  typedef ScopedLockImpl<CoMutex> Lock;
+
+  CoMutex();
+
+  ~CoMutex();
+
+  void lock();
+
+  bool tryLock();
+
+  void unlock();
+
+ private:
+  Mutex m_mutex;
+  bool m_locked {false};
+  std::deque<CoWaiter> m_waiters;
+
+};
+
+
+class CoRWMutex {
+
+ public:
+  typedef ReadScopedLockImpl<CoRWMutex> ReadLock;
+
+  typedef WriteScopedLockImpl<CoRWMutex> WriteLock;
+
+  CoRWMutex();
+
+  ~CoRWMutex();
+
+  void rdlock();
+
+  void wrlock();
+
+  void unlock();
+
+ private:
+  Mutex m_mutex;
+  int m_readers {0};          // count of readers which hold lock
+  bool m_writer {false};
+  std::deque<CoWaiter> m_waiters;
+
+};
+
+
+class CoConditionVariable {
+
+ public:
+  CoConditionVariable();
+
+  ~CoConditionVariable();
+
+  // mutex must be locked by current coroutine, it's unlocked when waiting and locked again before return
+  void wait(CoMutex& mutex);
+
+  void notifyOne();
+
+  void notifyAll();
+
+ private:
+  Mutex m_mutex;
+  std::deque<CoWaiter> m_waiters;
+
+};
+
+
+class CoSemaphore {
+
+ public:
+  explicit CoSemaphore(int count = 0);
+
+  ~CoSemaphore();
+
+  void wait();
+
+  bool tryWait();
+
+  void post();
+
+ private:
+  Mutex m_mutex;
+  int m_count {0};
+  std::deque<CoWaiter> m_waiters;
+
+};
+
+
+//
+// Wait until a group of tasks are done, such as coroutines which call rpc in parallel.
+// add is called before tasks start, and each task calls done when it ends
+//
+class WaitGroup {
+
+ public:
+  WaitGroup();
+
+  ~WaitGroup();
+
+  void add(int delta = 1);
+
+  void done();
+
+  void wait();
+
+ private:
+  Mutex m_mutex;
+  int m_count {0};
+  std::deque<CoWaiter> m_waiters;
+
+};
+
+}
+
+#endif
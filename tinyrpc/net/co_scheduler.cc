@@ -0,0 +1,124 @@
+#include "tinyrpc/net/co_scheduler.h"
+#include "tinyrpc/net/timer.h"
+#include "tinyrpc/comm/log.h"
+
+
+namespace tinyrpc {
+
+CoroutineScheduler::CoroutineScheduler() {}
+
+CoroutineScheduler::~CoroutineScheduler() {}
+
+bool CoroutineScheduler::markReady(Coroutine* cor, Coroutine::ptr& holder) {
+  if (cor == nullptr) {
+    ErrorLog << "schedule nullptr coroutine";
+    return false;
+  }
+  if (cor->m_is_ready.exchange(true, std::memory_order_acq_rel)) {
+    // already in queue, it will be resumed once
+    return false;
+  }
+  cor->m_ready_holder = std::move(holder);
+  cor->m_ready_next = nullptr;
+  return true;
+}
+
+void CoroutineScheduler::append(Coroutine* cor) {
+  int priority = cor->m_priority;
+  if (priority < 0 || priority >= COROUTINE_PRIORITY_COUNT) {
+    priority = Normal_Priority;
+  }
+  ReadyList& list = m_ready[priority];
+  cor->m_ready_next = nullptr;
+  if (list.tail) {
+    list.tail->m_ready_next = cor;
+  } else {
+    list.head = cor;
+  }
+  list.tail = cor;
+}
+
+void CoroutineScheduler::schedule(Coroutine* cor, Coroutine::ptr holder /*= nullptr*/) {
+  if (markReady(cor, holder)) {
+    append(cor);
+  }
+}
+
+void CoroutineScheduler::scheduleRemote(Coroutine* cor, Coroutine::ptr holder /*= nullptr*/) {
+  if (!markReady(cor, holder)) {
+    return;
+  }
+  Coroutine* head = m_remote_head.load(std::memory_order_relaxed);
+  do {
+    cor->m_ready_next = head;
+  } while (!m_remote_head.compare_exchange_weak(head, cor, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void CoroutineScheduler::takeRemote() {
+  Coroutine* head = m_remote_head.exchange(nullptr, std::memory_order_acquire);
+
+  // stack is in reverse order of push
+  Coroutine* prev = nullptr;
+  while (head) {
+    Coroutine* next = head->m_ready_next;
+    head->m_ready_next = prev;
+    prev = head;
+    head = next;
+  }
+  while (prev) {
+    Coroutine* next = prev->m_ready_next;
+    append(prev);
+    prev = next;
+  }
+}
+
+bool CoroutineScheduler::runOne(int priority) {
+  ReadyList& list = m_ready[priority];
+  Coroutine* cor = list.head;
+  if (cor == nullptr) {
+    return false;
+  }
+  list.head = cor->m_ready_next;
+  if (list.head == nullptr) {
+    list.tail = nullptr;
+  }
+  cor->m_ready_next = nullptr;
+  Coroutine::ptr holder;
+  holder.swap(cor->m_ready_holder);
+
+  // it can be scheduled again as soon as it runs
+  cor->m_is_ready.store(false, std::memory_order_release);
+  // its time is recorded by resume observer of reactor
+  Coroutine::Resume(cor);
+  return true;
+}
+
+size_t CoroutineScheduler::run(size_t budget) {
+  takeRemote();
+
+  size_t count = 0;
+  bool has_run[COROUTINE_PRIORITY_COUNT] = {false};
+  for (int i = 0; i < COROUTINE_PRIORITY_COUNT; ++i) {
+    while (count < budget && runOne(i)) {
+      has_run[i] = true;
+      ++count;
+    }
+  }
+  for (int i = 1; i < COROUTINE_PRIORITY_COUNT; ++i) {
+    if (!has_run[i] && runOne(i)) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+bool CoroutineScheduler::empty() const {
+  for (int i = 0; i < COROUTINE_PRIORITY_COUNT; ++i) {
+    if (m_ready[i].head) {
+      return false;
+    }
+  }
+  return m_remote_head.load(std::memory_order_acquire) == nullptr;
+}
+
+}
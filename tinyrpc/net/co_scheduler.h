@@ -0,0 +1,60 @@
+#ifndef TINYRPC_NET_CO_SCHEDULER_H
+#define TINYRPC_NET_CO_SCHEDULER_H
+
+#include <stddef.h>
+#include <atomic>
+#include "tinyrpc/coroutine/coroutine.h"
+
+namespace tinyrpc {
+
+//
+// Ready queue of coroutines of one reactor, one FIFO list for every priority.
+// Coroutines are linked by their own m_ready_next, so resuming a coroutine allocates nothing.
+// Loop thread appends to lists directly, other threads push to a lock-free stack
+// which is moved to lists by loop thread at the beginning of run.
+// A coroutine is in the queue at most once, scheduling it again before it runs does nothing
+//
+class CoroutineScheduler {
+
+ public:
+  CoroutineScheduler();
+
+  ~CoroutineScheduler();
+
+  // only loop thread can call. holder keeps cor alive until it has been resumed
+  void schedule(Coroutine* cor, Coroutine::ptr holder = nullptr);
+
+  // can be called by any thread
+  void scheduleRemote(Coroutine* cor, Coroutine::ptr holder = nullptr);
+
+  // resume at most budget coroutines, higher priority first.
+  // every lower priority which is still waiting gets one more, so it can't starve.
+  // return count of resumed coroutines
+  size_t run(size_t budget);
+
+  // only loop thread can call
+  bool empty() const;
+
+ private:
+  struct ReadyList {
+    Coroutine* head {nullptr};
+    Coroutine* tail {nullptr};
+  };
+
+  bool markReady(Coroutine* cor, Coroutine::ptr& holder);
+
+  void append(Coroutine* cor);
+
+  void takeRemote();
+
+  bool runOne(int priority);
+
+ private:
+  ReadyList m_ready[COROUTINE_PRIORITY_COUNT];
+  std::atomic<Coroutine*> m_remote_head {nullptr};
+
+};
+
+}
+
+#endif
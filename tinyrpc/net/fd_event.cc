@@ -1,10 +1,12 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include "fd_event.h"
+#include "../coroutine/coroutine_hook.h"
 
-namespace tinyrpc {
+// fcntl is hooked, flags of user are kept by hook
+extern fcntl_fun_ptr_t g_sys_fcntl_fun;
 
-static FdEventContainer* g_FdContainer = nullptr;
+namespace tinyrpc {
 
 FdEvent::FdEvent(tinyrpc::Reactor* reactor, int fd/*=-1*/) : m_fd(fd), m_reactor(reactor) {
     if (reactor == nullptr) {
@@ -93,6 +95,67 @@ void FdEvent::unregisterFromReactor () {
   m_listen_events = 0;
   m_read_callback = nullptr;
   m_write_callback = nullptr;
+
+  // fd may be reused by other thread after close
+  m_reactor = nullptr;
+
+  Mutex::Lock lock(m_mutex);
+  m_is_edge_triggered = false;
+  m_read_waiter = nullptr;
+  m_write_waiter = nullptr;
+}
+
+void FdEvent::registerEdgeTriggered() {
+  {
+    Mutex::Lock lock(m_mutex);
+    if (m_is_edge_triggered) {
+      return;
+    }
+    m_is_edge_triggered = true;
+  }
+  m_listen_events = READ | WRITE | ETModel;
+  updateToReactor();
+}
+
+bool FdEvent::isEdgeTriggered() {
+  Mutex::Lock lock(m_mutex);
+  return m_is_edge_triggered;
+}
+
+void FdEvent::setWaiter(IOEvent event, Coroutine* cor) {
+  Mutex::Lock lock(m_mutex);
+  if (event == READ) {
+    m_read_waiter = cor;
+  } else if (event == WRITE) {
+    m_write_waiter = cor;
+  } else {
+    ErrorLog << "error flag";
+  }
+}
+
+Coroutine* FdEvent::takeWaiter(IOEvent event) {
+  Mutex::Lock lock(m_mutex);
+  Coroutine* cor = nullptr;
+  if (event == READ) {
+    cor = m_read_waiter;
+    m_read_waiter = nullptr;
+  } else if (event == WRITE) {
+    cor = m_write_waiter;
+    m_write_waiter = nullptr;
+  }
+  return cor;
+}
+
+void FdEvent::resumeWaiter(IOEvent event) {
+  // waiter is taken when event occurs, so coroutine which has been waked up by others won't be resumed again.
+  // fd may be closed and reused by other thread, skip it
+  if (m_reactor != Reactor::GetReactor()) {
+    return;
+  }
+  Coroutine* cor = takeWaiter(event);
+  if (cor) {
+    m_reactor->schedule(cor);
+  }
 }
 
 int FdEvent::getFd() const {
@@ -121,14 +184,15 @@ void FdEvent::setNonBlock() {
     return;
   }
 
-  int flag = fcntl(m_fd, F_GETFL, 0); 
+  m_is_hook_nonblock = true;
+  int flag = g_sys_fcntl_fun(m_fd, F_GETFL, 0); 
   if (flag & O_NONBLOCK) {
     DebugLog << "fd already set o_nonblock";
     return;
   }
 
-  fcntl(m_fd, F_SETFL, flag | O_NONBLOCK);
-  flag = fcntl(m_fd, F_GETFL, 0); 
+  g_sys_fcntl_fun(m_fd, F_SETFL, flag | O_NONBLOCK);
+  flag = g_sys_fcntl_fun(m_fd, F_GETFL, 0); 
   if (flag & O_NONBLOCK) {
     DebugLog << "succ set o_nonblock";
   } else {
@@ -142,47 +206,95 @@ bool FdEvent::isNonBlock() {
     ErrorLog << "error, fd=-1";
     return false;
   }
-  int flag = fcntl(m_fd, F_GETFL, 0); 
+  int flag = g_sys_fcntl_fun(m_fd, F_GETFL, 0); 
   return (flag & O_NONBLOCK);
 
 }
 
-FdEvent::ptr FdEventContainer::getFdEvent(int fd) {
-  RWMutex::ReadLock lock(m_mutex);
-  std::vector<FdEvent::ptr> tmps = m_fds;
-  lock.unlock();
-  if (fd < static_cast<int>(tmps.size())) {
-    return tmps[fd];
+void FdEvent::setUserNonBlock(bool v) {
+  m_is_user_nonblock = v;
+}
+
+bool FdEvent::isUserNonBlock() const {
+  return m_is_user_nonblock;
+}
+
+bool FdEvent::isHookNonBlock() const {
+  return m_is_hook_nonblock;
+}
+
+void FdEvent::setTimeout(IOEvent event, int64_t timeout) {
+  if (event == READ) {
+    m_read_timeout = timeout;
+  } else if (event == WRITE) {
+    m_write_timeout = timeout;
   }
+}
 
-  int n = (int)(tmps.size() * 1.5);
-  n = (n > fd ? n : fd);
+int64_t FdEvent::getTimeout(IOEvent event) const {
+  if (event == READ) {
+    return m_read_timeout;
+  } else if (event == WRITE) {
+    return m_write_timeout;
+  }
+  return -1;
+}
 
-  for (int i = tmps.size(); i < n; ++i) {
-    FdEvent::ptr p = std::make_shared<FdEvent>(i);
-    tmps.push_back(p);
+void FdEvent::resetUserState() {
+  m_is_user_nonblock = false;
+  m_is_hook_nonblock = false;
+  m_read_timeout = -1;
+  m_write_timeout = -1;
+}
+
+FdEvent::ptr FdEventContainer::getFdEvent(int fd) {
+  if (fd < 0 || fd >= MAX_PAGES * PAGE_SIZE) {
+    ErrorLog << "get FdEvent error, invalid fd[" << fd << "]";
+    return nullptr;
+  }
+  Page* page = getPage(fd / PAGE_SIZE);
+  return page->fds[fd % PAGE_SIZE];
+}
+
+FdEventContainer::Page* FdEventContainer::getPage(int index) {
+  Page* page = m_pages[index].load(std::memory_order_acquire);
+  if (page) {
+    return page;
   }
-  tinyrpc::FdEvent::ptr re = tmps[fd]; 
-  RWMutex::WriteLock lock2(m_mutex);
-  m_fds.swap(tmps);
-  lock.unlock();
-  return re;
 
+  Page* tmp = new Page();
+  for (int i = 0; i < PAGE_SIZE; ++i) {
+    tmp->fds[i] = std::make_shared<FdEvent>(index * PAGE_SIZE + i);
+  }
+  // other thread may publish this page at the same time, use its page then
+  if (!m_pages[index].compare_exchange_strong(page, tmp, std::memory_order_acq_rel, std::memory_order_acquire)) {
+    delete tmp;
+    return page;
+  }
+  return tmp;
 }
 
 FdEventContainer::FdEventContainer(int size) {
-  for(int i = 0; i < size; ++i) {
-    FdEvent::ptr p = std::make_shared<FdEvent>(i);
-    m_fds.push_back(p);
+  m_pages = new std::atomic<Page*>[MAX_PAGES];
+  for (int i = 0; i < MAX_PAGES; ++i) {
+    m_pages[i].store(nullptr, std::memory_order_relaxed);
+  }
+  for (int i = 0; i < size && i < MAX_PAGES * PAGE_SIZE; i += PAGE_SIZE) {
+    getPage(i / PAGE_SIZE);
   }
+}
 
+FdEventContainer::~FdEventContainer() {
+  for (int i = 0; i < MAX_PAGES; ++i) {
+    delete m_pages[i].load();
+  }
+  delete[] m_pages;
 }
 
 FdEventContainer* FdEventContainer::GetFdContainer() {
-  if (g_FdContainer == nullptr) {
-    g_FdContainer = new FdEventContainer(128); 
-  }
-  return g_FdContainer;
+  // thread safe initialization
+  static FdEventContainer* container = new FdEventContainer(128);
+  return container;
 }
 
 
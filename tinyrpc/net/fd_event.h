@@ -3,6 +3,7 @@
 
 #include <functional>
 #include <memory>
+#include <atomic>
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <assert.h>
@@ -60,6 +61,36 @@ class FdEvent : public std::enable_shared_from_this<FdEvent> {
   
   bool isNonBlock();
 
+  // O_NONBLOCK set by user through fcntl, hooks don't wait for this fd then
+  void setUserNonBlock(bool v);
+
+  bool isUserNonBlock() const;
+
+  // O_NONBLOCK set by setNonBlock for hooks, it's hidden from user
+  bool isHookNonBlock() const;
+
+  // SO_RCVTIMEO (READ) or SO_SNDTIMEO (WRITE) set by user through setsockopt, ms. -1 if it's not set
+  void setTimeout(IOEvent event, int64_t timeout);
+
+  int64_t getTimeout(IOEvent event) const;
+
+  // forget flags and timeouts above, fd has been closed
+  void resetUserState();
+
+  // register fd for IN|OUT with EPOLLET, only first call touch epoll
+  void registerEdgeTriggered();
+
+  bool isEdgeTriggered();
+
+  // coroutine waiting for fd to be readable or writable, only used by edge-triggered fd
+  void setWaiter(IOEvent event, Coroutine* cor);
+
+  // clear waiter and return it, nullptr if it has been resumed by reactor
+  Coroutine* takeWaiter(IOEvent event);
+
+  // schedule waiting coroutine of this direction to its reactor, must be called in loop thread
+  void resumeWaiter(IOEvent event);
+
  public:
 	Mutex m_mutex;
 
@@ -72,22 +103,50 @@ class FdEvent : public std::enable_shared_from_this<FdEvent> {
 
   Reactor* m_reactor {nullptr};
 
+  bool m_is_edge_triggered {false};
+  Coroutine* m_read_waiter {nullptr};
+  Coroutine* m_write_waiter {nullptr};
+
+  bool m_is_user_nonblock {false};
+  bool m_is_hook_nonblock {false};
+  int64_t m_read_timeout {-1};
+  int64_t m_write_timeout {-1};
+
 };
 
 
+//
+// FdEvent of every fd, FdEvent is created once and reused when fd number is reused.
+// Two levels of fixed size pages, pages are never freed, so getFdEvent needn't lock
+//
 class FdEventContainer {
 
  public:
+  // fds of one page
+  static const int PAGE_SIZE = 1024;
+
+  // max count of pages, so fd must be less than MAX_PAGES * PAGE_SIZE
+  static const int MAX_PAGES = 16384;
+
   FdEventContainer(int size);
 
-  FdEvent::ptr getFdEvent(int fd); 
+  ~FdEventContainer();
+
+  // nullptr if fd is invalid
+  FdEvent::ptr getFdEvent(int fd);
 
  public:
   static FdEventContainer* GetFdContainer();
 
  private:
-  RWMutex m_mutex;
-  std::vector<FdEvent::ptr> m_fds;
+  struct Page {
+    FdEvent::ptr fds[PAGE_SIZE];
+  };
+
+  Page* getPage(int index);
+
+ private:
+  std::atomic<Page*>* m_pages {nullptr};
 
 };
 
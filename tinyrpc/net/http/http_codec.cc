@@ -29,12 +29,14 @@ void HttpCodeC::encode(TcpBuffer* buf, AbstractData* data) {
   std::stringstream ss;
   ss << response->m_response_version << " " << response->m_response_code << " "
     << response->m_response_info << "\r\n" << response->m_response_header.toHttpString()
-    << "\r\n" << response->m_response_body;
+    << "\r\n";
   std::string http_res = ss.str();
-  DebugLog << "encode http response is:  " << http_res;  
+  DebugLog << "encode http response is:  " << http_res << response->m_response_body;  
 
+  // body is written to buf directly
   buf->writeToBuffer(http_res.c_str(), http_res.length());
-  DebugLog << "succ encode and write to buffer, writeindex=" << buf->writeIndex();
+  buf->writeToBuffer(response->m_response_body.c_str(), response->m_response_body.length());
+  DebugLog << "succ encode and write to buffer, readable=" << buf->readAble();
   response->encode_succ = true;
   DebugLog << "test encode end";
 }
@@ -5,6 +5,8 @@
 #include "tinyrpc/net/http/http_servlet.h"
 #include "tinyrpc/comm/log.h"
 #include "tinyrpc/comm/msg_req.h"
+#include "tinyrpc/comm/metrics.h"
+#include "tinyrpc/net/timer.h"
 
 
 namespace tinyrpc {
@@ -17,24 +19,42 @@ void HttpDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
 
   InfoLog << "begin to dispatch client http request, msgno=" << Coroutine::GetCurrentCoroutine()->getRunTime()->m_msg_no;
 
+  int64_t begin_time = getNowUs();
+  InterfaceMetrics* metrics = nullptr;
+  // coroutine serves later requests of this connection, they shouldn't inherit priority of this servlet
+  CoroutinePriority old_priority = Coroutine::GetCurrentCoroutine()->getPriority();
+
   std::string url_path = resquest->m_request_path;
   if (!url_path.empty()) {
     auto it = m_servlets.find(url_path);
     if (it == m_servlets.end()) {
       ErrorLog << "404, url path{ " << url_path << "}, msgno=" << Coroutine::GetCurrentCoroutine()->getRunTime()->m_msg_no;
       NotFoundHttpServlet servlet;
+      Coroutine::GetCurrentCoroutine()->setPriority(servlet.getPriority());
       Coroutine::GetCurrentCoroutine()->getRunTime()->m_interface_name = servlet.getServletName();
+      metrics = MetricsRegistry::GetInterfaceMetrics(servlet.getServletName());
+      metrics->begin(begin_time - resquest->decode_time, resquest->decode_len);
       servlet.setCommParam(resquest, &response);
       servlet.handle(resquest, &response);
     } else {
 
+      // keep it until response has been encoded
+      Coroutine::GetCurrentCoroutine()->setPriority(it->second->getPriority());
       Coroutine::GetCurrentCoroutine()->getRunTime()->m_interface_name = it->second->getServletName();
+      metrics = MetricsRegistry::GetInterfaceMetrics(it->second->getServletName());
+      metrics->begin(begin_time - resquest->decode_time, resquest->decode_len);
       it->second->setCommParam(resquest, &response);
       it->second->handle(resquest, &response);
     }
   }
 
+  int out_bytes = conn->getOutBuffer()->readAble();
   conn->getCodec()->encode(conn->getOutBuffer(), &response);
+  if (metrics) {
+    out_bytes = conn->getOutBuffer()->readAble() - out_bytes;
+    metrics->end(getNowUs() - begin_time, response.m_response_code >= 400 ? response.m_response_code : 0, out_bytes);
+  }
+  Coroutine::GetCurrentCoroutine()->setPriority(old_priority);
 
   InfoLog << "end dispatch client http request, msgno=" << Coroutine::GetCurrentCoroutine()->getRunTime()->m_msg_no;
 
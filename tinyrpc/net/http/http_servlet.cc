@@ -1,9 +1,13 @@
 #include <memory>
+#include <sstream>
 #include "tinyrpc/net/http/http_servlet.h"
 #include "tinyrpc/net/http/http_request.h"
 #include "tinyrpc/net/http/http_response.h"
 #include "tinyrpc/net/http/http_define.h"
 #include "tinyrpc/comm/log.h"
+#include "tinyrpc/comm/metrics.h"
+#include "tinyrpc/comm/start.h"
+#include "tinyrpc/net/tcp/tcp_server.h"
 
 namespace tinyrpc {
 
@@ -32,6 +36,14 @@ void HttpServlet::handleNotFound(HttpRequest* req, HttpResponse* res) {
   res->m_response_header.m_maps["Content-Length"]= std::to_string(res->m_response_body.length());
 }
 
+void HttpServlet::setPriority(CoroutinePriority priority) {
+  m_priority = priority;
+}
+
+CoroutinePriority HttpServlet::getPriority() const {
+  return m_priority;
+}
+
 void HttpServlet::setHttpCode(HttpResponse* res, const int code) {
   res->m_response_code = code;
   res->m_response_info = std::string(httpCodeToString(code));
@@ -71,4 +83,83 @@ std::string NotFoundHttpServlet::getServletName() {
 }
 
 
+MetricsHttpServlet::MetricsHttpServlet() {
+  // scraping must not wait behind business requests
+  setPriority(Control_Priority);
+}
+
+MetricsHttpServlet::~MetricsHttpServlet() {
+
+}
+
+void MetricsHttpServlet::handle(HttpRequest* req, HttpResponse* res) {
+  setHttpCode(res, HTTP_OK);
+  setHttpContentType(res, "text/plain; version=0.0.4");
+  setHttpBody(res, MetricsRegistry::ToPrometheusText());
+}
+
+std::string MetricsHttpServlet::getServletName() {
+  return "MetricsHttpServlet";
+}
+
+
+ReactorStatsHttpServlet::ReactorStatsHttpServlet() {
+  // a stalled io thread must not stop us from seeing it
+  setPriority(Control_Priority);
+}
+
+ReactorStatsHttpServlet::~ReactorStatsHttpServlet() {
+
+}
+
+template <typename T>
+static void writeReactorStats(std::stringstream& ss, const std::vector<ReactorStatsSnapshot>& stats,
+    const char* name, const char* type, const char* help, T ReactorStatsSnapshot::*member) {
+  ss << "# HELP " << name << " " << help << "\n";
+  ss << "# TYPE " << name << " " << type << "\n";
+  for (size_t i = 0; i < stats.size(); ++i) {
+    ss << name << "{thread=\"" << stats[i].tid << "\"} " << stats[i].*member << "\n";
+  }
+}
+
+void ReactorStatsHttpServlet::handle(HttpRequest* req, HttpResponse* res) {
+  std::vector<ReactorStatsSnapshot> stats;
+  if (GetServer()) {
+    stats = GetServer()->getIOThreadPool()->getReactorStats();
+  }
+
+  std::stringstream ss;
+  writeReactorStats(ss, stats, "tinyrpc_reactor_loops_total", "counter", "loops of reactor", &ReactorStatsSnapshot::loop_count);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_loop_microseconds_total", "counter", "time of loops", &ReactorStatsSnapshot::loop_time);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_wait_microseconds_total", "counter", "time blocked in epoll_wait or io_uring", &ReactorStatsSnapshot::wait_time);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_tasks_total", "counter", "pending tasks executed", &ReactorStatsSnapshot::tasks);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_resumes_total", "counter", "coroutine resumes by ready queue, tasks and callbacks", &ReactorStatsSnapshot::resumes);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_wakeups_total", "counter", "epoll_wait returned with events", &ReactorStatsSnapshot::wakeups);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_events_total", "counter", "events returned by epoll_wait", &ReactorStatsSnapshot::events);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_timer_events_total", "counter", "fired timer events", &ReactorStatsSnapshot::timer_events);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_timer_late_milliseconds_total", "counter", "lateness of fired timer events", &ReactorStatsSnapshot::timer_late_time);
+
+  const char* max_help = "max of recent interval";
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_loop_microseconds", "gauge", max_help, &ReactorStatsSnapshot::max_loop_time);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_busy_microseconds", "gauge", max_help, &ReactorStatsSnapshot::max_busy_time);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_pending_tasks", "gauge", max_help, &ReactorStatsSnapshot::max_pending_tasks);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_events_per_wakeup", "gauge", max_help, &ReactorStatsSnapshot::max_events);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_timer_late_milliseconds", "gauge", max_help, &ReactorStatsSnapshot::max_timer_late);
+  writeReactorStats(ss, stats, "tinyrpc_reactor_max_resume_microseconds", "gauge", max_help, &ReactorStatsSnapshot::max_resume_time);
+
+  // not a number, so it's a comment
+  for (size_t i = 0; i < stats.size(); ++i) {
+    ss << "# thread " << stats[i].tid << " longest resume: " << stats[i].max_resume_desc << "\n";
+  }
+
+  setHttpCode(res, HTTP_OK);
+  setHttpContentType(res, "text/plain; version=0.0.4");
+  setHttpBody(res, ss.str());
+}
+
+std::string ReactorStatsHttpServlet::getServletName() {
+  return "ReactorStatsHttpServlet";
+}
+
+
 }
\ No newline at end of file
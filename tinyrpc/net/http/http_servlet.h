@@ -4,6 +4,7 @@
 #include <memory>
 #include "tinyrpc/net/http/http_request.h"
 #include "tinyrpc/net/http/http_response.h"
+#include "tinyrpc/coroutine/coroutine.h"
 
 namespace tinyrpc {
 
@@ -29,6 +30,14 @@ class HttpServlet : public std::enable_shared_from_this<HttpServlet> {
 
   void setCommParam(HttpRequest* req, HttpResponse* res);
 
+  // priority of coroutine which handles request of this servlet, such as Control_Priority for health check
+  void setPriority(CoroutinePriority priority);
+
+  CoroutinePriority getPriority() const;
+
+ private:
+  CoroutinePriority m_priority {Normal_Priority};
+
 };
 
 
@@ -45,6 +54,36 @@ class NotFoundHttpServlet: public HttpServlet {
 
 };
 
+
+// prometheus text of MetricsRegistry, register it to a path such as /metrics
+class MetricsHttpServlet: public HttpServlet {
+ public:
+
+  MetricsHttpServlet();
+
+  ~MetricsHttpServlet();
+
+  void handle(HttpRequest* req, HttpResponse* res);
+
+  std::string getServletName();
+
+};
+
+
+// loop health of every io thread of server in prometheus text, labeled by thread id
+class ReactorStatsHttpServlet: public HttpServlet {
+ public:
+
+  ReactorStatsHttpServlet();
+
+  ~ReactorStatsHttpServlet();
+
+  void handle(HttpRequest* req, HttpResponse* res);
+
+  std::string getServletName();
+
+};
+
 }
 
 
@@ -0,0 +1,186 @@
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "tinyrpc/net/io_uring.h"
+#include "tinyrpc/comm/log.h"
+
+
+namespace tinyrpc {
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params* p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags, void* arg, size_t argsz) {
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, argsz);
+}
+
+IoUring::IoUring(int entries) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  m_ring_fd = sys_io_uring_setup(entries, &params);
+  if (m_ring_fd < 0) {
+    ErrorLog << "io_uring_setup error, sys error=" << strerror(errno);
+    return;
+  }
+  m_features = params.features;
+
+  m_sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  m_cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if (m_features & IORING_FEAT_SINGLE_MMAP) {
+    m_sq_size = m_sq_size > m_cq_size ? m_sq_size : m_cq_size;
+  }
+
+  m_sq_ptr = mmap(nullptr, m_sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQ_RING);
+  if (m_sq_ptr == MAP_FAILED) {
+    ErrorLog << "mmap sq ring error, sys error=" << strerror(errno);
+    m_sq_ptr = nullptr;
+    close(m_ring_fd);
+    m_ring_fd = -1;
+    return;
+  }
+
+  if (m_features & IORING_FEAT_SINGLE_MMAP) {
+    m_cq_ptr = m_sq_ptr;
+  } else {
+    m_cq_ptr = mmap(nullptr, m_cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_CQ_RING);
+    if (m_cq_ptr == MAP_FAILED) {
+      ErrorLog << "mmap cq ring error, sys error=" << strerror(errno);
+      m_cq_ptr = nullptr;
+      munmap(m_sq_ptr, m_sq_size);
+      m_sq_ptr = nullptr;
+      close(m_ring_fd);
+      m_ring_fd = -1;
+      return;
+    }
+  }
+
+  m_sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  m_sqes = reinterpret_cast<struct io_uring_sqe*>(mmap(nullptr, m_sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring_fd, IORING_OFF_SQES));
+  if (m_sqes == MAP_FAILED) {
+    ErrorLog << "mmap sqes error, sys error=" << strerror(errno);
+    m_sqes = nullptr;
+    if (m_cq_ptr != m_sq_ptr) {
+      munmap(m_cq_ptr, m_cq_size);
+    }
+    munmap(m_sq_ptr, m_sq_size);
+    m_cq_ptr = nullptr;
+    m_sq_ptr = nullptr;
+    close(m_ring_fd);
+    m_ring_fd = -1;
+    return;
+  }
+
+  char* sq = reinterpret_cast<char*>(m_sq_ptr);
+  m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+  m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+  m_sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+  m_sq_entries = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+  m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+  char* cq = reinterpret_cast<char*>(m_cq_ptr);
+  m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+  m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+  m_cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+  m_cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+  m_sqe_tail = *m_sq_tail;
+
+  DebugLog << "succ create io_uring, fd=" << m_ring_fd << ", sq entries=" << params.sq_entries << ", cq entries=" << params.cq_entries;
+}
+
+IoUring::~IoUring() {
+  if (m_sqes) {
+    munmap(m_sqes, m_sqes_size);
+  }
+  if (m_cq_ptr && m_cq_ptr != m_sq_ptr) {
+    munmap(m_cq_ptr, m_cq_size);
+  }
+  if (m_sq_ptr) {
+    munmap(m_sq_ptr, m_sq_size);
+  }
+  if (m_ring_fd != -1) {
+    close(m_ring_fd);
+  }
+}
+
+bool IoUring::isValid() const {
+  return m_ring_fd != -1;
+}
+
+bool IoUring::canWaitTimeout() const {
+  return (m_features & IORING_FEAT_EXT_ARG) != 0;
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+  unsigned head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+  if (m_sqe_tail - head >= *m_sq_entries) {
+    // sq is full, let kernel consume it first
+    submit(0);
+    head = __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+    if (m_sqe_tail - head >= *m_sq_entries) {
+      ErrorLog << "io_uring sq is full";
+      return nullptr;
+    }
+  }
+  unsigned index = m_sqe_tail & *m_sq_mask;
+  struct io_uring_sqe* sqe = &m_sqes[index];
+  memset(sqe, 0, sizeof(*sqe));
+  m_sq_array[index] = index;
+  m_sqe_tail++;
+  return sqe;
+}
+
+int IoUring::submit(int wait_nr, int timeout /*=-1*/) {
+  // make filled sqes visible to kernel
+  __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+
+  unsigned flags = 0;
+  void* arg = nullptr;
+  size_t argsz = 0;
+
+  struct io_uring_getevents_arg ext_arg;
+  struct __kernel_timespec ts;
+  if (wait_nr > 0) {
+    flags |= IORING_ENTER_GETEVENTS;
+    if (timeout >= 0 && (m_features & IORING_FEAT_EXT_ARG)) {
+      memset(&ext_arg, 0, sizeof(ext_arg));
+      ts.tv_sec = timeout / 1000;
+      ts.tv_nsec = (timeout % 1000) * 1000000;
+      ext_arg.sigmask_sz = _NSIG / 8;
+      ext_arg.ts = reinterpret_cast<uint64_t>(&ts);
+      flags |= IORING_ENTER_EXT_ARG;
+      arg = &ext_arg;
+      argsz = sizeof(ext_arg);
+    }
+  }
+  // sqes which kernel hasn't consumed
+  unsigned to_submit = m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE);
+  if (to_submit == 0 && wait_nr == 0) {
+    return 0;
+  }
+
+  int rt = sys_io_uring_enter(m_ring_fd, to_submit, wait_nr, flags, arg, argsz);
+  if (rt < 0) {
+    if (errno != ETIME && errno != EINTR) {
+      ErrorLog << "io_uring_enter error, sys error=" << strerror(errno);
+    }
+  }
+  return rt;
+}
+
+bool IoUring::popCqe(struct io_uring_cqe& cqe) {
+  unsigned head = *m_cq_head;
+  if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+    return false;
+  }
+  cqe = m_cqes[head & *m_cq_mask];
+  __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef TINYRPC_NET_IO_URING_H
+#define TINYRPC_NET_IO_URING_H
+
+#include <memory>
+#include <stdint.h>
+
+// don't include <linux/io_uring.h> here, it drags in macros like BLOCK_SIZE
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace tinyrpc {
+
+class Coroutine;
+
+// user_data of sqe which completion should be ignored, such as cancel
+static const uint64_t IO_URING_IGNORE_DATA = 0;
+
+// user_data of poll request on epoll fd of reactor
+static const uint64_t IO_URING_EPOLL_DATA = 1;
+
+// request of a coroutine in flight, its address is user_data of sqe
+struct IoUringRequest {
+  Coroutine* cor {nullptr};
+  int res {0};
+  bool is_done {false};
+};
+
+//
+// A thin wrapper of io_uring by raw syscalls, liburing isn't needed.
+// Only used by the thread which owns it, so there is no lock.
+// sqes got by getSqe are submitted together when submit is called
+//
+class IoUring {
+
+ public:
+  typedef std::shared_ptr<IoUring> ptr;
+
+  IoUring(int entries);
+
+  ~IoUring();
+
+  bool isValid() const;
+
+  // whether submit can wait with timeout, it needs IORING_FEAT_EXT_ARG
+  bool canWaitTimeout() const;
+
+  // free sqe to fill, it's cleared. nullptr if sq is full even after submit
+  struct io_uring_sqe* getSqe();
+
+  // submit all sqes, and wait until at least wait_nr cqes arrive or timeout (ms, -1 means forever).
+  // timeout is ignored if canWaitTimeout is false
+  int submit(int wait_nr, int timeout = -1);
+
+  // pop one cqe, return false if cq is empty
+  bool popCqe(struct io_uring_cqe& cqe);
+
+ private:
+  int m_ring_fd {-1};
+  unsigned m_features {0};
+
+  void* m_sq_ptr {nullptr};
+  size_t m_sq_size {0};
+  void* m_cq_ptr {nullptr};
+  size_t m_cq_size {0};
+  struct io_uring_sqe* m_sqes {nullptr};
+  size_t m_sqes_size {0};
+
+  unsigned* m_sq_head {nullptr};
+  unsigned* m_sq_tail {nullptr};
+  unsigned* m_sq_mask {nullptr};
+  unsigned* m_sq_entries {nullptr};
+  unsigned* m_sq_array {nullptr};
+
+  unsigned* m_cq_head {nullptr};
+  unsigned* m_cq_tail {nullptr};
+  unsigned* m_cq_mask {nullptr};
+  struct io_uring_cqe* m_cqes {nullptr};
+
+  unsigned m_sqe_tail {0};        // local tail, sqes before it have been filled
+
+};
+
+}
+
+#endif
@@ -37,9 +37,8 @@ void CoroutineMutex::lock() {
     // beacuse can't get lock, so should yield current cor
 
     Coroutine* cor = Coroutine::GetCurrentCoroutine();
-    // add to tasks, wait next reactor back to resume this coroutine
-    std::shared_ptr<Coroutine> tmp(cor);
-    Reactor::GetReactor()->addCoroutine(tmp, false);
+    // add to ready queue, wait next reactor back to resume this coroutine
+    Reactor::GetReactor()->schedule(cor, false);
     Coroutine::Yield();
   } 
 }
@@ -1,6 +1,7 @@
 #include <sys/socket.h>
 #include <sys/epoll.h>
 #include <sys/eventfd.h>
+#include <poll.h>
 #include <assert.h>
 #include <string.h>
 #include <algorithm>
@@ -11,6 +12,8 @@
 #include "timer.h"
 #include "../coroutine/coroutine.h"
 #include "../coroutine/coroutine_hook.h"
+#include "../comm/config.h"
+#include <linux/io_uring.h>
 
 
 extern read_fun_ptr_t g_sys_read_fun;  // sys read func
@@ -22,6 +25,10 @@ static thread_local Reactor* t_reactor_ptr = nullptr;
 
 static thread_local int t_max_epoll_timeout = 10000;     // ms
 
+static const int IO_URING_ENTRIES = 256;
+
+extern tinyrpc::Config::ptr gRpcConfig;
+
 
 Reactor::Reactor() {
   
@@ -53,6 +60,29 @@ Reactor::Reactor() {
   // assert(m_wake_fd > 0);	
 	addWakeupFd();
 
+	if (gRpcConfig && gRpcConfig->m_reactor_schedule_budget > 0) {
+		m_schedule_budget = gRpcConfig->m_reactor_schedule_budget;
+	}
+
+	m_stats.setTid(m_tid);
+	if (gRpcConfig) {
+		m_stats.setSlowThreshold(gRpcConfig->m_reactor_slow_loop_threshold * 1000);
+	}
+
+	if (gRpcConfig && gRpcConfig->m_reactor_backend == "io_uring") {
+		m_io_uring = new IoUring(IO_URING_ENTRIES);
+		if (!m_io_uring->isValid()) {
+			ErrorLog << "create io_uring failed, use epoll instead";
+			delete m_io_uring;
+			m_io_uring = nullptr;
+		} else if (!m_io_uring->canWaitTimeout()) {
+			// loop would block until next cqe, timers and pending cancels need a timeout
+			ErrorLog << "io_uring of this kernel can't wait with timeout (IORING_FEAT_EXT_ARG, linux 5.11), use epoll instead";
+			delete m_io_uring;
+			m_io_uring = nullptr;
+		}
+	}
+
 }
 
 Reactor::~Reactor() {
@@ -62,6 +92,10 @@ Reactor::~Reactor() {
     delete m_timer;
     m_timer = nullptr;
   }
+  if (m_io_uring != nullptr) {
+    delete m_io_uring;
+    m_io_uring = nullptr;
+  }
   t_reactor_ptr = nullptr;
 }
 
@@ -106,12 +140,15 @@ void Reactor::delEvent(int fd, bool is_wakeup/*=true*/) {
     return;
   }
 
+	// fd is usually closed right after this, and its number may be reused and added to this loop again
+	// before loop runs, so del it from epoll now (epoll_ctl is thread safe) instead of queueing it.
+	// fd is left in m_fds, addEventInLoopThread corrects it if fd is added again
 	{
-    Mutex::Lock lock(m_mutex);
-		m_pending_del_fds.push_back(fd);
+		Mutex::Lock lock(m_mutex);
+		m_pending_add_fds.erase(fd);
 	}
-	if (is_wakeup) {
-		wakeup();
+	if (epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr) != 0 && errno != ENOENT) {
+		ErrorLog << "epoo_ctl error, fd[" << fd << "], sys errinfo = " << strerror(errno);
 	}
 }
 
@@ -121,6 +158,11 @@ void Reactor::wakeup() {
     return;
   }
 
+	// loop has been signalled and hasn't drained wakeup fd yet, one signal is enough
+	if (m_is_wakeup_pending.exchange(true)) {
+		return;
+	}
+
 	uint64_t tmp = 1;
 	uint64_t* p = &tmp; 
 	if(g_sys_write_fun(m_wake_fd, p, 8) != 8) {
@@ -147,7 +189,7 @@ void Reactor::addWakeupFd() {
 	if ((epoll_ctl(m_epfd, op, m_wake_fd, &event)) != 0) {
 		ErrorLog << "epoo_ctl error, fd[" << m_wake_fd << "], errno=" << errno << ", err=" << strerror(errno) ;
 	}
-	m_fds.push_back(m_wake_fd);
+	m_fds.insert(m_wake_fd);
 
 }
 
@@ -159,8 +201,7 @@ void Reactor::addEventInLoopThread(int fd, epoll_event event) {
 	int op = EPOLL_CTL_ADD;
 	bool is_add = true;
 	// int tmp_fd = event;
-	auto it = find(m_fds.begin(), m_fds.end(), fd);
-	if (it != m_fds.end()) {
+	if (m_fds.count(fd)) {
 		is_add = false;
 		op = EPOLL_CTL_MOD;
 	}
@@ -169,12 +210,19 @@ void Reactor::addEventInLoopThread(int fd, epoll_event event) {
 	// event.data.ptr = fd_event.get();
 	// event.events = fd_event->getListenEvents();
 
-	if (epoll_ctl(m_epfd, op, fd, &event) != 0) {
+	int rt = epoll_ctl(m_epfd, op, fd, &event);
+	if (rt != 0 && !is_add && errno == ENOENT) {
+		// fd was deleted by other thread and its number is reused
+		is_add = true;
+		op = EPOLL_CTL_ADD;
+		rt = epoll_ctl(m_epfd, op, fd, &event);
+	}
+	if (rt != 0) {
 		ErrorLog << "epoo_ctl error, fd[" << fd << "], sys errinfo = " << strerror(errno);
 		return;
 	}
 	if (is_add) {
-		m_fds.push_back(fd);
+		m_fds.insert(fd);
 	}
 	DebugLog << "epoll_ctl add succ, fd[" << fd << "]"; 
 
@@ -186,14 +234,15 @@ void Reactor::delEventInLoopThread(int fd) {
 
   assert(isLoopThread());
 
-	auto it = find(m_fds.begin(), m_fds.end(), fd);
+	auto it = m_fds.find(fd);
 	if (it == m_fds.end()) {
 		DebugLog << "fd[" << fd << "] not in this loop";
 		return;
 	}
 	int op = EPOLL_CTL_DEL;
 
-	if ((epoll_ctl(m_epfd, op, fd, nullptr)) != 0) {
+	// ENOENT if it has been deleted by other thread
+	if ((epoll_ctl(m_epfd, op, fd, nullptr)) != 0 && errno != ENOENT) {
 		ErrorLog << "epoo_ctl error, fd[" << fd << "], sys errinfo = " << strerror(errno);
 	}
 
@@ -213,20 +262,50 @@ void Reactor::loop() {
   
   m_is_looping = true;
 	m_stop_flag = false;
+	updateCachedClock();
+	// every resume in this thread, by ready queue, task or callback, is recorded with its coroutine
+	Coroutine::SetResumeObserver([this](Coroutine* cor, int64_t time) {
+		m_stats.onRun("coroutine", cor, time);
+	});
 
 	while(!m_stop_flag) {
 		const int MAX_EVENTS = 10;
 		epoll_event re_events[MAX_EVENTS + 1];
+		int64_t now = getNowUs();
+		m_stats.beginLoop(now);
 		// DebugLog << "task";
 		// excute tasks
-		for (size_t i = 0; i < m_pending_tasks.size(); ++i) {
+		m_stats.onTasks(m_pending_tasks.popAll(m_running_tasks));
+		for (size_t i = 0; i < m_running_tasks.size(); ++i) {
 			// DebugLog << "begin to excute task[" << i << "]";
-			m_pending_tasks[i]();
+			m_stats.beginRun();
+			m_running_tasks[i]();
 			// DebugLog << "end excute tasks[" << i << "]";
+			int64_t end = getNowUs();
+			m_stats.onRun("task", nullptr, end - now);
+			now = end;
+		}
+		m_running_tasks.clear();
+
+		// resume ready coroutines, no more than budget so that loop can go back to epoll_wait in time
+		m_scheduler.run(m_schedule_budget);
+
+		// tasks and coroutines added above should be excuted as soon as possible
+		int timeout = t_max_epoll_timeout;
+		if (!m_pending_tasks.empty() || !m_scheduler.empty()) {
+			timeout = 0;
 		}
-		m_pending_tasks.clear();
 		// DebugLog << "to epoll_wait";
-		int rt = epoll_wait(m_epfd, re_events, MAX_EVENTS, t_max_epoll_timeout);
+		int rt = 0;
+		now = getNowUs();
+		if (m_io_uring) {
+			rt = waitIoUring(re_events, MAX_EVENTS, timeout);
+		} else {
+			rt = epoll_wait(m_epfd, re_events, MAX_EVENTS, timeout);
+			// time used by this loop
+			updateCachedClock();
+		}
+		m_stats.onWait(getNowUs() - now, rt);
 
 		// DebugLog << "epoll_wait back";
 
@@ -246,11 +325,14 @@ void Reactor::loop() {
 							break;
 						}
 					}
+					// after drained, so a later wakeup must write again
+					m_is_wakeup_pending.store(false);
 
 				} else {
 					tinyrpc::FdEvent* ptr = (tinyrpc::FdEvent*)one_event.data.ptr;
           if (ptr != nullptr) {
             int fd;
+            bool is_et;
             std::function<void()> read_cb;
             std::function<void()> write_cb;
 
@@ -260,25 +342,37 @@ void Reactor::loop() {
               read_cb = ptr->getCallBack(READ);
               write_cb = ptr->getCallBack(WRITE);
             }
+            is_et = ptr->isEdgeTriggered();
+
+            if (is_et) {
+              // interest list is never changed, just resume who is waiting.
+              // error or hang up wakes both sides, they will get it from syscall
+              if (one_event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                ptr->resumeWaiter(READ);
+              }
+              if (one_event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+                ptr->resumeWaiter(WRITE);
+              }
+              continue;
+            }
 
             if ((!(one_event.events & EPOLLIN)) && (!(one_event.events & EPOLLOUT))){
               ErrorLog << "socket [" << fd << "] occur other unknow event:[" << one_event.events << "], need unregister this socket";
               delEventInLoopThread(fd);
             } else {
 							// if timer event, direct excute
+							// every timer event is recorded by timer
 							if (fd == m_timer_fd) {
 								read_cb();
 								continue;
 							}
               if (one_event.events & EPOLLIN) {
                 // DebugLog << "socket [" << fd << "] occur read event";
-                Mutex::Lock lock(m_mutex);
-                m_pending_tasks.push_back(read_cb);						
+                m_pending_tasks.push(std::move(read_cb));
               }
               if (one_event.events & EPOLLOUT) {
                 // DebugLog << "socket [" << fd << "] occur write event";
-                Mutex::Lock lock(m_mutex);
-                m_pending_tasks.push_back(write_cb);						
+                m_pending_tasks.push(std::move(write_cb));
               }
             }
           }
@@ -297,29 +391,23 @@ void Reactor::loop() {
       // m_pending_tasks.clear();
 
 			std::map<int, epoll_event> tmp_add;
-			std::vector<int> tmp_del;
 
 			{
         Mutex::Lock lock(m_mutex);
 				tmp_add.swap(m_pending_add_fds);
 				m_pending_add_fds.clear();
-
-				tmp_del.swap(m_pending_del_fds);
-				m_pending_del_fds.clear();
-
 			}
 			for (auto i = tmp_add.begin(); i != tmp_add.end(); ++i) {
 				// DebugLog << "fd[" << (*i).first <<"] need to add";
 				addEventInLoopThread((*i).first, (*i).second);	
 			}
-			for (auto i = tmp_del.begin(); i != tmp_del.end(); ++i) {
-				// DebugLog << "fd[" << (*i) <<"] need to del";
-				delEventInLoopThread((*i));	
-			}
 		}
+		m_stats.endLoop(getNowUs());
 	}
   DebugLog << "reactor loop end";
+  Coroutine::SetResumeObserver(nullptr);
   m_is_looping = false;
+  resetCachedClock();
 }
 
 void Reactor::stop() {
@@ -330,12 +418,9 @@ void Reactor::stop() {
 }
 
 
-void Reactor::addTask(std::function<void()> task, bool is_wakeup /*=true*/) {
+void Reactor::addTask(Task task, bool is_wakeup /*=true*/) {
 
-  {
-    Mutex::Lock lock(m_mutex);
-    m_pending_tasks.push_back(task);
-  }
+  m_pending_tasks.push(std::move(task));
   if (is_wakeup) {
     wakeup();
   }
@@ -347,9 +432,8 @@ void Reactor::addTask(std::vector<std::function<void()>> task, bool is_wakeup /*
     return;
   }
 
-  {
-    Mutex::Lock lock(m_mutex);
-    m_pending_tasks.insert(m_pending_tasks.end(), task.begin(), task.end());
+  for (size_t i = 0; i < task.size(); ++i) {
+    m_pending_tasks.push(std::move(task[i]));
   }
   if (is_wakeup) {
     wakeup();
@@ -358,10 +442,27 @@ void Reactor::addTask(std::vector<std::function<void()>> task, bool is_wakeup /*
 
 void Reactor::addCoroutine(tinyrpc::Coroutine::ptr cor, bool is_wakeup /*=true*/) {
 
-  auto func = [cor](){
-    tinyrpc::Coroutine::Resume(cor.get());
-  };
-  addTask(func, is_wakeup);
+  Coroutine* tmp = cor.get();
+  if (isLoopThread()) {
+    m_scheduler.schedule(tmp, std::move(cor));
+    return;
+  }
+  m_scheduler.scheduleRemote(tmp, std::move(cor));
+  if (is_wakeup) {
+    wakeup();
+  }
+}
+
+void Reactor::schedule(tinyrpc::Coroutine* cor, bool is_wakeup /*=true*/) {
+
+  if (isLoopThread()) {
+    m_scheduler.schedule(cor);
+    return;
+  }
+  m_scheduler.scheduleRemote(cor);
+  if (is_wakeup) {
+    wakeup();
+  }
 }
 
 Timer* Reactor::getTimer() {
@@ -376,4 +477,77 @@ pid_t Reactor::getTid() {
   return m_tid;
 }
 
+IoUring* Reactor::getIoUring() {
+  return m_io_uring;
+}
+
+void Reactor::cancelIoUring(IoUringRequest* req) {
+	m_pending_cancels.push_back(req);
+	submitPendingCancels();
+}
+
+// fill cancel sqes as many as sq can hold, the rest wait for next loop
+void Reactor::submitPendingCancels() {
+	size_t i = 0;
+	for (; i < m_pending_cancels.size(); ++i) {
+		struct io_uring_sqe* sqe = m_io_uring->getSqe();
+		if (!sqe) {
+			break;
+		}
+		sqe->opcode = IORING_OP_ASYNC_CANCEL;
+		sqe->addr = reinterpret_cast<uint64_t>(m_pending_cancels[i]);
+		sqe->user_data = IO_URING_IGNORE_DATA;
+	}
+	m_pending_cancels.erase(m_pending_cancels.begin(), m_pending_cancels.begin() + i);
+}
+
+ReactorStats* Reactor::getStats() {
+  return &m_stats;
+}
+
+// submit all sqes of this loop in one syscall, and resume coroutines whose io done.
+// epoll fd (wakeup fd, timer fd and other fd events) is polled by ring too, return its events like epoll_wait
+int Reactor::waitIoUring(epoll_event* events, int max_events, int timeout) {
+	if (!m_pending_cancels.empty()) {
+		submitPendingCancels();
+		// coroutines of them wait for cancel, so don't block long if sq is still full
+		if (!m_pending_cancels.empty() && (timeout < 0 || timeout > 1)) {
+			timeout = 1;
+		}
+	}
+
+	if (!m_is_polling_epoll) {
+		struct io_uring_sqe* sqe = m_io_uring->getSqe();
+		if (sqe) {
+			sqe->opcode = IORING_OP_POLL_ADD;
+			sqe->fd = m_epfd;
+			sqe->poll32_events = POLLIN;
+			sqe->user_data = IO_URING_EPOLL_DATA;
+			m_is_polling_epoll = true;
+		}
+	}
+
+	m_io_uring->submit(timeout == 0 ? 0 : 1, timeout);
+	updateCachedClock();
+
+	bool is_epoll_ready = false;
+	struct io_uring_cqe cqe;
+	while (m_io_uring->popCqe(cqe)) {
+		if (cqe.user_data == IO_URING_EPOLL_DATA) {
+			m_is_polling_epoll = false;
+			is_epoll_ready = true;
+		} else if (cqe.user_data != IO_URING_IGNORE_DATA) {
+			IoUringRequest* req = reinterpret_cast<IoUringRequest*>(cqe.user_data);
+			req->res = cqe.res;
+			req->is_done = true;
+			schedule(req->cor);
+		}
+	}
+
+	if (!is_epoll_ready) {
+		return 0;
+	}
+	return epoll_wait(m_epfd, events, max_events, 0);
+}
+
 }
@@ -6,10 +6,15 @@
 #include <vector>
 #include <atomic>
 #include <map>
+#include <unordered_set>
 #include <functional>
 #include "../coroutine/coroutine.h"
 #include "fd_event.h"
 #include "mutex.h"
+#include "io_uring.h"
+#include "task_queue.h"
+#include "co_scheduler.h"
+#include "reactor_stats.h"
 
 namespace tinyrpc {
 
@@ -24,20 +29,30 @@ class Reactor {
 
   typedef std::shared_ptr<Reactor> ptr;
 
+  static const size_t TASK_QUEUE_CAPACITY = 1024;
+
+  // max coroutines resumed in one loop, if config doesn't set it
+  static const size_t DEFAULT_SCHEDULE_BUDGET = 256;
+
   explicit Reactor();
 
   ~Reactor();
 
   void addEvent(int fd, epoll_event event, bool is_wakeup = true);
 
+  // fd is deleted from epoll before return even if it's called by other thread, so fd can be closed after it
   void delEvent(int fd, bool is_wakeup = true);
 
-  void addTask(std::function<void()> task, bool is_wakeup = true);
+  // can be called by any thread
+  void addTask(Task task, bool is_wakeup = true);
 
   void addTask(std::vector<std::function<void()>> task, bool is_wakeup = true);
   
   void addCoroutine(tinyrpc::Coroutine::ptr cor, bool is_wakeup = true);
 
+  // put cor into ready queue, it's resumed by loop of this reactor. can be called by any thread
+  void schedule(tinyrpc::Coroutine* cor, bool is_wakeup = true);
+
   void wakeup();
   
   void loop();
@@ -47,6 +62,15 @@ class Reactor {
   Timer* getTimer();
 
   pid_t getTid();
+
+  // nullptr if backend isn't io_uring
+  IoUring* getIoUring();
+
+  // cancel request in flight on io_uring. if sq is full, it's kept and retried by loop. only called by loop thread
+  void cancelIoUring(IoUringRequest* req);
+
+  // loop health, any thread can get snapshot from it
+  ReactorStats* getStats();
  
  public:
   static Reactor* GetReactor();
@@ -61,6 +85,10 @@ class Reactor {
   void addEventInLoopThread(int fd, epoll_event event);
 
   void delEventInLoopThread(int fd);
+
+  int waitIoUring(epoll_event* events, int max_events, int timeout);
+
+  void submitPendingCancels();
   
  private:
   int m_epfd {-1};
@@ -73,18 +101,27 @@ class Reactor {
 
   Mutex m_mutex;                    // mutex
   
-  std::vector<int> m_fds;              // alrady care events
+  std::unordered_set<int> m_fds;       // alrady care events
   std::atomic<int> m_fd_size; 
 
-  // fds that wait for operate
-  // 1 -- to add to loop
-  // 2 -- to del from loop
+  // fds that wait to add to loop, del from other thread is done at once
   std::map<int, epoll_event> m_pending_add_fds;
-  std::vector<int> m_pending_del_fds;
-  std::vector<std::function<void()>> m_pending_tasks;
+
+  TaskQueue m_pending_tasks {TASK_QUEUE_CAPACITY};
+  std::vector<Task> m_running_tasks;
+  std::atomic<bool> m_is_wakeup_pending {false};    // wakeup fd has been written but not read by loop
+
+  CoroutineScheduler m_scheduler;
+  size_t m_schedule_budget {DEFAULT_SCHEDULE_BUDGET};
 
   Timer* m_timer {nullptr};
 
+  IoUring* m_io_uring {nullptr};
+  bool m_is_polling_epoll {false};    // epoll fd is polled by ring
+  std::vector<IoUringRequest*> m_pending_cancels;     // cancels which didn't get sqe yet
+
+  ReactorStats m_stats;
+
 };
 
 
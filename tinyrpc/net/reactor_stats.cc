@@ -0,0 +1,180 @@
+#include <sstream>
+#include <algorithm>
+#include "tinyrpc/net/reactor_stats.h"
+#include "tinyrpc/comm/log.h"
+
+
+namespace tinyrpc {
+
+// only loop thread writes, so load and store is enough
+static void addRelaxed(std::atomic<uint64_t>& counter, uint64_t value) {
+  counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static void maxRelaxed(std::atomic<int64_t>& max, int64_t value) {
+  if (value > max.load(std::memory_order_relaxed)) {
+    max.store(value, std::memory_order_relaxed);
+  }
+}
+
+static uint64_t loadRelaxed(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+static int64_t loadMax(const std::atomic<int64_t>& a, const std::atomic<int64_t>& b) {
+  return std::max(a.load(std::memory_order_relaxed), b.load(std::memory_order_relaxed));
+}
+
+
+ReactorStats::ReactorStats() {}
+
+void ReactorStats::setSlowThreshold(int64_t threshold) {
+  m_slow_threshold = threshold;
+}
+
+void ReactorStats::setTid(pid_t tid) {
+  m_tid = tid;
+}
+
+void ReactorStats::beginLoop(int64_t now) {
+  if (m_window_begin == 0) {
+    m_window_begin = now;
+  } else if (now - m_window_begin >= INTERVAL) {
+    rollWindow(now);
+  }
+  m_loop_begin = now;
+  m_loop_wait = 0;
+  m_longest_time = 0;
+  m_longest_desc.clear();
+}
+
+void ReactorStats::onTasks(size_t count) {
+  addRelaxed(m_tasks, count);
+  maxRelaxed(m_windows[m_current.load(std::memory_order_relaxed)].pending_tasks, count);
+}
+
+void ReactorStats::onWait(int64_t wait_time, int events) {
+  addRelaxed(m_wait_time, wait_time);
+  m_loop_wait += wait_time;
+  if (events > 0) {
+    addRelaxed(m_wakeups, 1);
+    addRelaxed(m_events, events);
+    maxRelaxed(m_windows[m_current.load(std::memory_order_relaxed)].events, events);
+  }
+}
+
+void ReactorStats::beginRun() {
+  m_resumed_time = 0;
+}
+
+void ReactorStats::onRun(const char* kind, Coroutine* cor, int64_t time) {
+  if (!cor) {
+    time -= m_resumed_time;
+    m_resumed_time = 0;
+  } else {
+    m_resumed_time += time;
+    addRelaxed(m_resumes, 1);
+    Window& window = m_windows[m_current.load(std::memory_order_relaxed)];
+    if (time > window.resume_time.load(std::memory_order_relaxed)) {
+      std::string desc = describe(kind, cor);
+      Mutex::Lock lock(m_mutex);
+      window.resume_time.store(time, std::memory_order_relaxed);
+      window.resume_desc.swap(desc);
+    }
+  }
+
+  if (time > m_longest_time) {
+    m_longest_time = time;
+    // describe it only when it may be logged
+    if (m_slow_threshold > 0 && time >= m_slow_threshold) {
+      m_longest_desc = describe(kind, cor);
+    } else {
+      m_longest_desc.clear();
+    }
+  }
+}
+
+void ReactorStats::onTimerEvent(int64_t late) {
+  addRelaxed(m_timer_events, 1);
+  if (late > 0) {
+    addRelaxed(m_timer_late_time, late);
+    maxRelaxed(m_windows[m_current.load(std::memory_order_relaxed)].timer_late, late);
+  }
+}
+
+void ReactorStats::endLoop(int64_t now) {
+  int64_t loop_time = now - m_loop_begin;
+  int64_t busy_time = loop_time - m_loop_wait;
+  addRelaxed(m_loop_count, 1);
+  addRelaxed(m_loop_time, loop_time);
+  Window& window = m_windows[m_current.load(std::memory_order_relaxed)];
+  maxRelaxed(window.loop_time, loop_time);
+  maxRelaxed(window.busy_time, busy_time);
+
+  if (m_slow_threshold <= 0 || busy_time < m_slow_threshold) {
+    return;
+  }
+  if (!m_longest_desc.empty()) {
+    WarnLog << "slow loop, busy " << busy_time << "us in " << loop_time << "us, thread was held by "
+      << m_longest_desc << " for " << m_longest_time << "us";
+  } else {
+    WarnLog << "slow loop, busy " << busy_time << "us in " << loop_time << "us, no single task or coroutine exceeds "
+      << m_slow_threshold << "us, longest one ran " << m_longest_time << "us";
+  }
+}
+
+ReactorStatsSnapshot ReactorStats::getSnapshot() {
+  ReactorStatsSnapshot re;
+  re.tid = m_tid;
+  re.loop_count = loadRelaxed(m_loop_count);
+  re.loop_time = loadRelaxed(m_loop_time);
+  re.wait_time = loadRelaxed(m_wait_time);
+  re.tasks = loadRelaxed(m_tasks);
+  re.resumes = loadRelaxed(m_resumes);
+  re.wakeups = loadRelaxed(m_wakeups);
+  re.events = loadRelaxed(m_events);
+  re.timer_events = loadRelaxed(m_timer_events);
+  re.timer_late_time = loadRelaxed(m_timer_late_time);
+
+  re.max_loop_time = loadMax(m_windows[0].loop_time, m_windows[1].loop_time);
+  re.max_busy_time = loadMax(m_windows[0].busy_time, m_windows[1].busy_time);
+  re.max_pending_tasks = loadMax(m_windows[0].pending_tasks, m_windows[1].pending_tasks);
+  re.max_events = loadMax(m_windows[0].events, m_windows[1].events);
+  re.max_timer_late = loadMax(m_windows[0].timer_late, m_windows[1].timer_late);
+
+  Mutex::Lock lock(m_mutex);
+  int i = m_windows[0].resume_time.load(std::memory_order_relaxed) >= m_windows[1].resume_time.load(std::memory_order_relaxed) ? 0 : 1;
+  re.max_resume_time = m_windows[i].resume_time.load(std::memory_order_relaxed);
+  re.max_resume_desc = m_windows[i].resume_desc;
+  return re;
+}
+
+void ReactorStats::rollWindow(int64_t now) {
+  // last window is dropped, current one becomes last
+  int next = 1 - m_current.load(std::memory_order_relaxed);
+  Window& window = m_windows[next];
+  window.loop_time.store(0, std::memory_order_relaxed);
+  window.busy_time.store(0, std::memory_order_relaxed);
+  window.pending_tasks.store(0, std::memory_order_relaxed);
+  window.events.store(0, std::memory_order_relaxed);
+  window.timer_late.store(0, std::memory_order_relaxed);
+  {
+    Mutex::Lock lock(m_mutex);
+    window.resume_time.store(0, std::memory_order_relaxed);
+    window.resume_desc.clear();
+  }
+  m_current.store(next, std::memory_order_relaxed);
+  m_window_begin = now;
+}
+
+std::string ReactorStats::describe(const char* kind, Coroutine* cor) {
+  if (cor == nullptr) {
+    return kind;
+  }
+  std::stringstream ss;
+  ss << kind << "[cor_id=" << cor->getCorId() << ", interface=" << cor->getRunTime()->m_interface_name
+    << ", msgno=" << cor->getRunTime()->m_msg_no << "]";
+  return ss.str();
+}
+
+}
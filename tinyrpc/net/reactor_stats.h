@@ -0,0 +1,121 @@
+#ifndef TINYRPC_NET_REACTOR_STATS_H
+#define TINYRPC_NET_REACTOR_STATS_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <atomic>
+#include <string>
+#include "tinyrpc/coroutine/coroutine.h"
+#include "tinyrpc/net/mutex.h"
+
+namespace tinyrpc {
+
+// loop health of one reactor at some time. times are us except timer lateness (ms).
+// totals are since reactor starts, max_* are max of current and last interval
+struct ReactorStatsSnapshot {
+  pid_t tid {0};
+
+  uint64_t loop_count {0};
+  uint64_t loop_time {0};           // total time of loops
+  uint64_t wait_time {0};           // total time blocked in epoll_wait or io_uring
+  uint64_t tasks {0};               // pending tasks executed
+  uint64_t resumes {0};             // coroutine resumes
+  uint64_t wakeups {0};             // epoll_wait returned with events
+  uint64_t events {0};
+  uint64_t timer_events {0};        // fired timer events
+  uint64_t timer_late_time {0};     // total lateness of fired timer events, ms
+
+  int64_t max_loop_time {0};
+  int64_t max_busy_time {0};        // loop time except waiting
+  int64_t max_pending_tasks {0};    // tasks popped by one loop
+  int64_t max_events {0};           // events of one wakeup
+  int64_t max_timer_late {0};       // ms
+  int64_t max_resume_time {0};      // longest coroutine resume
+  std::string max_resume_desc;      // which coroutine it is
+
+};
+
+
+//
+// Loop health of one reactor. Only loop thread records, any thread can get snapshot.
+// A loop whose busy time exceeds slow threshold is logged with the task, coroutine
+// or callback which held the thread longest in it
+//
+class ReactorStats {
+
+ public:
+  // max_* are reset every interval
+  static const int64_t INTERVAL = 10 * 1000 * 1000;   // us
+
+  ReactorStats();
+
+  // 0 -- don't log slow loop
+  void setSlowThreshold(int64_t threshold);
+
+  void setTid(pid_t tid);
+
+  void beginLoop(int64_t now);
+
+  void onTasks(size_t count);
+
+  void onWait(int64_t wait_time, int events);
+
+  // called before a task or callback runs
+  void beginRun();
+
+  // one task, coroutine resume or callback has run for time. cor is nullptr if it isn't a coroutine,
+  // then time of coroutines it resumed since beginRun is taken off, they are recorded by themselves
+  void onRun(const char* kind, Coroutine* cor, int64_t time);
+
+  void onTimerEvent(int64_t late);
+
+  void endLoop(int64_t now);
+
+  ReactorStatsSnapshot getSnapshot();
+
+ private:
+  struct Window {
+    std::atomic<int64_t> loop_time {0};
+    std::atomic<int64_t> busy_time {0};
+    std::atomic<int64_t> pending_tasks {0};
+    std::atomic<int64_t> events {0};
+    std::atomic<int64_t> timer_late {0};
+    std::atomic<int64_t> resume_time {0};
+    std::string resume_desc;        // locked by m_mutex
+  };
+
+  void rollWindow(int64_t now);
+
+  static std::string describe(const char* kind, Coroutine* cor);
+
+ private:
+  pid_t m_tid {0};
+  int64_t m_slow_threshold {0};
+
+  std::atomic<uint64_t> m_loop_count {0};
+  std::atomic<uint64_t> m_loop_time {0};
+  std::atomic<uint64_t> m_wait_time {0};
+  std::atomic<uint64_t> m_tasks {0};
+  std::atomic<uint64_t> m_resumes {0};
+  std::atomic<uint64_t> m_wakeups {0};
+  std::atomic<uint64_t> m_events {0};
+  std::atomic<uint64_t> m_timer_events {0};
+  std::atomic<uint64_t> m_timer_late_time {0};
+
+  Mutex m_mutex;
+  Window m_windows[2];
+  std::atomic<int> m_current {0};
+  int64_t m_window_begin {0};
+
+  // current loop
+  int64_t m_loop_begin {0};
+  int64_t m_loop_wait {0};
+  int64_t m_longest_time {0};
+  int64_t m_resumed_time {0};       // coroutines resumed since beginRun
+  std::string m_longest_desc;       // only set when it's slower than threshold
+
+};
+
+}
+
+#endif
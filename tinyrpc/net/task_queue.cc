@@ -0,0 +1,87 @@
+#include <assert.h>
+#include <stdint.h>
+#include "tinyrpc/net/task_queue.h"
+
+
+namespace tinyrpc {
+
+TaskQueue::TaskQueue(size_t capacity) {
+  assert(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+  m_cells = new Cell[capacity];
+  m_mask = capacity - 1;
+  for (size_t i = 0; i < capacity; ++i) {
+    m_cells[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+TaskQueue::~TaskQueue() {
+  delete[] m_cells;
+  m_cells = nullptr;
+}
+
+void TaskQueue::push(Task&& task) {
+  // once overflow isn't empty, keep pushing to it until consumer drains it, so tasks keep order
+  if (m_overflow_size.load(std::memory_order_acquire) == 0) {
+    size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = m_cells[pos & m_mask];
+      size_t seq = cell.sequence.load(std::memory_order_acquire);
+      intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+      if (dif == 0) {
+        if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          cell.task = std::move(task);
+          cell.sequence.store(pos + 1, std::memory_order_release);
+          return;
+        }
+      } else if (dif < 0) {
+        // ring is full
+        break;
+      } else {
+        pos = m_enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  Mutex::Lock lock(m_overflow_mutex);
+  m_overflow.push_back(std::move(task));
+  m_overflow_size.store(m_overflow.size(), std::memory_order_release);
+}
+
+size_t TaskQueue::popAll(std::vector<Task>& tasks) {
+  size_t count = 0;
+  while (true) {
+    Cell& cell = m_cells[m_dequeue_pos & m_mask];
+    size_t seq = cell.sequence.load(std::memory_order_acquire);
+    if (seq != m_dequeue_pos + 1) {
+      // empty, or producer hasn't finished writing this cell
+      break;
+    }
+    tasks.push_back(std::move(cell.task));
+    cell.sequence.store(m_dequeue_pos + m_mask + 1, std::memory_order_release);
+    ++m_dequeue_pos;
+    ++count;
+  }
+
+  if (m_overflow_size.load(std::memory_order_acquire) > 0) {
+    Mutex::Lock lock(m_overflow_mutex);
+    // a producer may still be writing a cell it took before its tasks in overflow,
+    // leave overflow to next time so tasks of one producer keep order
+    if (m_enqueue_pos.load(std::memory_order_relaxed) != m_dequeue_pos) {
+      return count;
+    }
+    for (size_t i = 0; i < m_overflow.size(); ++i) {
+      tasks.push_back(std::move(m_overflow[i]));
+    }
+    count += m_overflow.size();
+    m_overflow.clear();
+    m_overflow_size.store(0, std::memory_order_release);
+  }
+  return count;
+}
+
+bool TaskQueue::empty() const {
+  return m_enqueue_pos.load(std::memory_order_acquire) == m_dequeue_pos
+      && m_overflow_size.load(std::memory_order_acquire) == 0;
+}
+
+}
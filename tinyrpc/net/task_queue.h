@@ -0,0 +1,188 @@
+#ifndef TINYRPC_NET_TASK_QUEUE_H
+#define TINYRPC_NET_TASK_QUEUE_H
+
+#include <stddef.h>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <type_traits>
+#include "mutex.h"
+
+namespace tinyrpc {
+
+//
+// A movable callable, small callable (such as lambda capture a pointer or a shared_ptr,
+// or a std::function) is stored inline, bigger one is allocated on heap
+//
+class Task {
+
+ public:
+  // bytes of inline storage, sizeof(Task) is 56
+  static const size_t INLINE_SIZE = 48;
+
+  Task() {}
+
+  template <typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+  Task(F&& f) {
+    typedef typename std::decay<F>::type Func;
+    init<Func>(std::forward<F>(f), std::integral_constant<bool, IsInline<Func>::value>());
+  }
+
+  Task(Task&& other) noexcept {
+    moveFrom(other);
+  }
+
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      reset();
+      moveFrom(other);
+    }
+    return *this;
+  }
+
+  Task(const Task&) = delete;
+
+  Task& operator=(const Task&) = delete;
+
+  ~Task() {
+    reset();
+  }
+
+  void operator()() {
+    m_ops->invoke(m_buf);
+  }
+
+  explicit operator bool() const {
+    return m_ops != nullptr;
+  }
+
+  void reset() {
+    if (m_ops) {
+      m_ops->destroy(m_buf);
+      m_ops = nullptr;
+    }
+  }
+
+ private:
+  struct Ops {
+    void (*invoke)(void*);
+    void (*move)(void* dst, void* src);     // move src to dst, and destroy src
+    void (*destroy)(void*);
+  };
+
+  template <typename Func>
+  struct IsInline {
+    static const bool value = sizeof(Func) <= INLINE_SIZE && alignof(Func) <= alignof(void*)
+        && std::is_nothrow_move_constructible<Func>::value;
+  };
+
+  template <typename Func>
+  struct InlineOps {
+    static void invoke(void* p) {
+      (*reinterpret_cast<Func*>(p))();
+    }
+    static void move(void* dst, void* src) {
+      new (dst) Func(std::move(*reinterpret_cast<Func*>(src)));
+      reinterpret_cast<Func*>(src)->~Func();
+    }
+    static void destroy(void* p) {
+      reinterpret_cast<Func*>(p)->~Func();
+    }
+    static const Ops ops;
+  };
+
+  template <typename Func>
+  struct HeapOps {
+    static void invoke(void* p) {
+      (**reinterpret_cast<Func**>(p))();
+    }
+    static void move(void* dst, void* src) {
+      *reinterpret_cast<Func**>(dst) = *reinterpret_cast<Func**>(src);
+    }
+    static void destroy(void* p) {
+      delete *reinterpret_cast<Func**>(p);
+    }
+    static const Ops ops;
+  };
+
+  template <typename Func, typename F>
+  void init(F&& f, std::true_type) {
+    new (m_buf) Func(std::forward<F>(f));
+    m_ops = &InlineOps<Func>::ops;
+  }
+
+  template <typename Func, typename F>
+  void init(F&& f, std::false_type) {
+    *reinterpret_cast<Func**>(m_buf) = new Func(std::forward<F>(f));
+    m_ops = &HeapOps<Func>::ops;
+  }
+
+  void moveFrom(Task& other) {
+    m_ops = other.m_ops;
+    if (m_ops) {
+      m_ops->move(m_buf, other.m_buf);
+      other.m_ops = nullptr;
+    }
+  }
+
+ private:
+  alignas(void*) char m_buf[INLINE_SIZE];
+  const Ops* m_ops {nullptr};
+
+};
+
+template <typename Func>
+const Task::Ops Task::InlineOps<Func>::ops = {&InlineOps<Func>::invoke, &InlineOps<Func>::move, &InlineOps<Func>::destroy};
+
+template <typename Func>
+const Task::Ops Task::HeapOps<Func>::ops = {&HeapOps<Func>::invoke, &HeapOps<Func>::move, &HeapOps<Func>::destroy};
+
+
+//
+// Bounded lock-free multi-producer single-consumer queue of Task.
+// Any thread can push, only the owner (loop thread of reactor) can pop.
+// When ring is full, tasks go to an overflow list under mutex, so push never fails
+//
+class TaskQueue {
+
+ public:
+  // capacity must be power of 2
+  explicit TaskQueue(size_t capacity);
+
+  ~TaskQueue();
+
+  void push(Task&& task);
+
+  // pop all tasks which have been pushed, append them to tasks. only owner thread can call
+  size_t popAll(std::vector<Task>& tasks);
+
+  // approximate, but it's exact if only owner thread push
+  bool empty() const;
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    Task task;
+  };
+
+  // keep producers and consumer index away from each other's cache line
+  char m_pad0[64];
+  std::atomic<size_t> m_enqueue_pos {0};
+  char m_pad1[64];
+  size_t m_dequeue_pos {0};
+  std::atomic<size_t> m_overflow_size {0};
+  char m_pad2[64];
+
+  Cell* m_cells {nullptr};
+  size_t m_mask {0};
+
+  Mutex m_overflow_mutex;
+  std::vector<Task> m_overflow;
+
+};
+
+}
+
+#endif
@@ -22,7 +22,12 @@ static thread_local IOThread* t_cur_io_thread = nullptr;
 
 
 IOThread::IOThread() {
+  sem_init(&m_init_semaphore, 0, 0);
   pthread_create(&m_thread, nullptr, &IOThread::main, this);
+
+  // wait until reactor is created, so others can add task to it at once
+  sem_wait(&m_init_semaphore);
+  sem_destroy(&m_init_semaphore);
 }
 
 IOThread::~IOThread() {
@@ -69,12 +74,14 @@ void* IOThread::main(void* arg) {
 
   Coroutine::GetCurrentCoroutine();
 
+  sem_post(&thread->m_init_semaphore);
+
   t_reactor_ptr->loop();
 
   return nullptr;
 }
 
-bool IOThread::addClient(TcpServer* tcp_svr, int fd) {
+bool IOThread::addClient(TcpServer* tcp_svr, int fd, NetAddress::ptr peer_addr) {
 
   auto it = m_clients.find(fd);
   if (it != m_clients.end()) {
@@ -87,11 +94,11 @@ bool IOThread::addClient(TcpServer* tcp_svr, int fd) {
     s_conn.reset();
 		it->second.reset();
     // set new Tcpconnection	
-		it->second = std::make_shared<TcpConnection>(tcp_svr, this, fd, 128, tcp_svr->getPeerAddr());
+		it->second = std::make_shared<TcpConnection>(tcp_svr, this, fd, peer_addr);
     it->second->registerToTimeWheel();
 
   } else {
-    TcpConnection::ptr conn = std::make_shared<TcpConnection>(tcp_svr, this, fd, 128, tcp_svr->getPeerAddr()); 
+    TcpConnection::ptr conn = std::make_shared<TcpConnection>(tcp_svr, this, fd, peer_addr); 
     m_clients.insert(std::make_pair(fd, conn));
     conn->registerToTimeWheel();
     
@@ -138,6 +145,14 @@ int IOThreadPool::getIOThreadPoolSize() {
   return m_size;
 }
 
+std::vector<ReactorStatsSnapshot> IOThreadPool::getReactorStats() {
+  std::vector<ReactorStatsSnapshot> re;
+  for (auto i : m_io_threads) {
+    re.push_back(i->getReactor()->getStats()->getSnapshot());
+  }
+  return re;
+}
+
 void IOThreadPool::broadcastTask(std::function<void()> cb) {
   for (auto i : m_io_threads) {
     i->getReactor()->addTask(cb, true);
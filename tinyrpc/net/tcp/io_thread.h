@@ -2,10 +2,12 @@
 #define TINYRPC_NET_TCP_IO_THREAD_H
 
 #include <memory>
+#include <semaphore.h>
 #include <map>
 #include <atomic>
 #include <functional>
 #include "tinyrpc/net/reactor.h"
+#include "tinyrpc/net/net_address.h"
 #include "tinyrpc/net/tcp/tcp_connection_time_wheel.h"
 #include "tinyrpc/coroutine/coroutine.h"
 
@@ -28,7 +30,7 @@ class IOThread {
 
   TcpTimeWheel::ptr getTimeWheel();
 
-  bool addClient(TcpServer* tcp_svr, int fd);
+  bool addClient(TcpServer* tcp_svr, int fd, NetAddress::ptr peer_addr);
 
   pthread_t getPthreadId();
 
@@ -51,6 +53,7 @@ class IOThread {
 
 	pthread_t m_thread;
 	pid_t m_tid;
+	sem_t m_init_semaphore;     // post when reactor of thread is ready
   TimerEvent::ptr m_timer_event;
 
 };
@@ -78,6 +81,9 @@ class IOThreadPool {
   // call returnCoroutine(cor) to free coroutine
   Coroutine::ptr addCoroutineToRandomThread(std::function<void()> cb, bool self = false);
 
+  // loop health of every io thread, index is same as io thread
+  std::vector<ReactorStatsSnapshot> getReactorStats();
+
  private:
   int m_size {0};
 
@@ -1,149 +1,271 @@
 #include <unistd.h>
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
 #include "tinyrpc/net/tcp/tcp_buffer.h"
 #include "tinyrpc/comm/log.h"
 
 
 namespace tinyrpc {
 
-TcpBuffer::TcpBuffer(int size) {
-	m_buffer.resize(size);	
+// max count of free blocks cached by one thread
+static const size_t MAX_FREE_BLOCKS = 256;
+
+static thread_local std::vector<char*> t_free_blocks;
+
+TcpBuffer::TcpBuffer() {
+
 }
 
 
 TcpBuffer::~TcpBuffer() {
+  clearBuffer();
+}
 
+TcpBuffer::Block TcpBuffer::newBlock(int size) {
+  Block block;
+  if (size <= BLOCK_SIZE) {
+    size = BLOCK_SIZE;
+    if (!t_free_blocks.empty()) {
+      block.data = t_free_blocks.back();
+      t_free_blocks.pop_back();
+    }
+  }
+  if (!block.data) {
+    block.data = reinterpret_cast<char*>(malloc(size));
+  }
+  block.capacity = size;
+  block.end = size;
+  return block;
+}
+
+void TcpBuffer::freeBlock(Block& block) {
+  if (block.capacity == BLOCK_SIZE && t_free_blocks.size() < MAX_FREE_BLOCKS) {
+    t_free_blocks.push_back(block.data);
+  } else {
+    free(block.data);
+  }
+  block.data = nullptr;
 }
 
 int TcpBuffer::readAble() {
 
-	return m_write_index - m_read_index;
+	return m_readable;
 }
 
 int TcpBuffer::writeAble() {
-	
-	return m_buffer.size() - m_write_index;
+  int i = writeBlockIndex();
+  if (i == (int)m_blocks.size()) {
+    return 0;
+  }
+	return m_blocks[i].end - m_blocks[i].write_index;
 }
 
-int TcpBuffer::readIndex() const {
-  return m_read_index;
+// next byte will be written to this block, all blocks after it are empty
+int TcpBuffer::writeBlockIndex() {
+  int i = (int)m_blocks.size() - 1;
+  while (i >= 0 && m_blocks[i].write_index == 0) {
+    --i;
+  }
+  if (i < 0) {
+    return 0;
+  }
+  if (m_blocks[i].write_index == m_blocks[i].end) {
+    return i + 1;
+  }
+  return i;
 }
 
-int TcpBuffer::writeIndex() const {
-  return m_write_index;
+int TcpBuffer::getReadIovec(struct iovec* iov, int max_count) {
+  int count = 0;
+  for (size_t i = 0; i < m_blocks.size() && count < max_count; ++i) {
+    Block& block = m_blocks[i];
+    if (block.write_index > block.read_index) {
+      iov[count].iov_base = block.data + block.read_index;
+      iov[count].iov_len = block.write_index - block.read_index;
+      count++;
+    }
+  }
+  return count;
 }
 
-// int TcpBuffer::readFromSocket(int sockfd) {
-	// if (writeAble() == 0) {
-		// m_buffer.resize(2 * m_size);
-	// }
-	// int rt = read(sockfd, &m_buffer[m_write_index], writeAble());
-	// if (rt >= 0) {
-		// m_write_index += rt;
-	// }
-	// return rt;
-// }
-
-void TcpBuffer::resizeBuffer(int size) {
-  std::vector<char> tmp(size);
-  int c = std::min(size, readAble());
-  memcpy(&tmp[0], &m_buffer[m_read_index], c);
-
-  m_buffer.swap(tmp);
-  m_read_index = 0;
-  m_write_index = m_read_index + c;
+int TcpBuffer::getWriteIovec(struct iovec* iov, int max_count, int size) {
+  int count = 0;
+  int total = 0;
+  size_t i = writeBlockIndex();
+  while (count < max_count && total < size) {
+    if (i == m_blocks.size()) {
+      m_blocks.push_back(newBlock(BLOCK_SIZE));
+    }
+    Block& block = m_blocks[i];
+    int free_size = block.end - block.write_index;
+    if (free_size > 0) {
+      iov[count].iov_base = block.data + block.write_index;
+      iov[count].iov_len = free_size;
+      total += free_size;
+      count++;
+    }
+    ++i;
+  }
+  return count;
+}
 
+char* TcpBuffer::beginWrite(int size) {
+  size_t i = writeBlockIndex();
+  if (i < m_blocks.size()) {
+    Block& block = m_blocks[i];
+    if (block.end - block.write_index >= size) {
+      return block.data + block.write_index;
+    }
+    if (block.write_index > 0) {
+      // rest of this block is too small, don't write it anymore
+      block.end = block.write_index;
+      ++i;
+    }
+    // drop empty blocks, they are too small
+    while (m_blocks.size() > i) {
+      freeBlock(m_blocks.back());
+      m_blocks.pop_back();
+    }
+  }
+  m_blocks.push_back(newBlock(size));
+  return m_blocks.back().data;
 }
 
 void TcpBuffer::writeToBuffer(const char* buf, int size) {
-	if (size > writeAble()) {
-    int new_size = (int)(1.5 * (m_write_index + size));
-		resizeBuffer(new_size);
-	}
-	memcpy(&m_buffer[m_write_index], buf, size);
-	m_write_index += size;
-
+  struct iovec iov[8];
+  while (size > 0) {
+    int count = getWriteIovec(iov, 8, size);
+    int n = 0;
+    for (int i = 0; i < count && n < size; ++i) {
+      int c = std::min((int)iov[i].iov_len, size - n);
+      memcpy(iov[i].iov_base, buf + n, c);
+      n += c;
+    }
+    recycleWrite(n);
+    buf += n;
+    size -= n;
+  }
 }
 
+const char* TcpBuffer::pullUp(int size) {
+  if (size > m_readable || size <= 0) {
+    return nullptr;
+  }
+  size_t k = 0;
+  while (m_blocks[k].write_index == m_blocks[k].read_index) {
+    ++k;
+  }
+  Block& first = m_blocks[k];
+  if (first.write_index - first.read_index >= size) {
+    return first.data + first.read_index;
+  }
+
+  // bytes cross blocks, copy them to a new block
+  Block block = newBlock(size);
+  int n = 0;
+  for (size_t j = k; n < size; ++j) {
+    Block& tmp = m_blocks[j];
+    int c = std::min(tmp.write_index - tmp.read_index, size - n);
+    memcpy(block.data + n, tmp.data + tmp.read_index, c);
+    tmp.read_index += c;
+    n += c;
+  }
+  block.write_index = size;
+  block.end = size;
+  m_blocks.insert(m_blocks.begin() + k, block);
+  return block.data;
+}
 
 void TcpBuffer::readFromBuffer(std::vector<char>& re, int size) {
   if (readAble() == 0) {
     DebugLog << "read buffer empty!";
-    return; 
+    return;
   }
   int read_size = readAble() > size ? size : readAble();
-  std::vector<char> tmp(read_size); 
-
-  // std::copy(m_read_index, m_read_index + read_size, tmp);
-  memcpy(&tmp[0], &m_buffer[m_read_index], read_size);
+  std::vector<char> tmp(read_size);
+
+  int n = 0;
+  for (size_t i = 0; i < m_blocks.size() && n < read_size; ++i) {
+    Block& block = m_blocks[i];
+    int c = std::min(block.write_index - block.read_index, read_size - n);
+    memcpy(&tmp[n], block.data + block.read_index, c);
+    n += c;
+  }
   re.swap(tmp);
-  m_read_index += read_size;
-  adjustBuffer();
+  recycleRead(read_size);
 
 }
 
 void TcpBuffer::adjustBuffer() {
-  if (m_read_index > static_cast<int>(m_buffer.size() / 3)) {
-    
-    std::vector<char> new_buffer(m_buffer.size());
-
-    int count = readAble();
-    // std::copy(&m_buffer[m_read_index], readAble(), &new_buffer);
-    memcpy(&new_buffer[0], &m_buffer[m_read_index], count);
-
-    m_buffer.swap(new_buffer);
-    m_write_index = count;
-    m_read_index = 0;
-    new_buffer.clear();
-
+  while (!m_blocks.empty()) {
+    Block& block = m_blocks.front();
+    if (block.read_index != block.write_index) {
+      break;
+    }
+    if (m_blocks.size() == 1) {
+      // reuse last block
+      block.read_index = 0;
+      block.write_index = 0;
+      block.end = block.capacity;
+      break;
+    }
+    freeBlock(block);
+    m_blocks.pop_front();
   }
 
 }
 
-int TcpBuffer::getSize() {
-  return m_buffer.size();
-}
-
 void TcpBuffer::clearBuffer() {
-  m_buffer.clear();
-  m_read_index = 0;
-  m_write_index = 0;
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    freeBlock(m_blocks[i]);
+  }
+  m_blocks.clear();
+  m_readable = 0;
 }
 
 void TcpBuffer::recycleRead(int index) {
-  int j = m_read_index + index;
-  if (j > (int)m_buffer.size()) {
-    ErrorLog << "recycleRead error";
+  skipRead(index);
+  adjustBuffer();
+}
+
+void TcpBuffer::skipRead(int index) {
+  if (index > m_readable) {
+    ErrorLog << "skipRead error";
     return;
   }
-  m_read_index = j;
-  adjustBuffer();
+  m_readable -= index;
+  for (size_t i = 0; i < m_blocks.size() && index > 0; ++i) {
+    Block& block = m_blocks[i];
+    int c = std::min(block.write_index - block.read_index, index);
+    block.read_index += c;
+    index -= c;
+  }
 }
 
 void TcpBuffer::recycleWrite(int index) {
-  int j = m_write_index + index;
-  if (j > (int)m_buffer.size()) {
+  size_t i = writeBlockIndex();
+  int n = index;
+  for (; i < m_blocks.size() && n > 0; ++i) {
+    Block& block = m_blocks[i];
+    int c = std::min(block.end - block.write_index, n);
+    block.write_index += c;
+    n -= c;
+  }
+  if (n > 0) {
     ErrorLog << "recycleWrite error";
-    return;
   }
-  m_write_index = j;
-  adjustBuffer();
+  m_readable += index - n;
 }
 
-// const char* TcpBuffer::getBuffer() {
-//   char* tmp;
-//   memcpy(&tmp, &m_buffer[m_read_index], readAble());
-//   return tmp;
-// }
-
 std::string TcpBuffer::getBufferString() {
-  std::string re(readAble(), '0');
-  memcpy(&re[0],  &m_buffer[m_read_index], readAble());
+  std::string re;
+  re.reserve(m_readable);
+  for (size_t i = 0; i < m_blocks.size(); ++i) {
+    Block& block = m_blocks[i];
+    re.append(block.data + block.read_index, block.write_index - block.read_index);
+  }
   return re;
 }
 
-std::vector<char> TcpBuffer::getBufferVector() {
-  return m_buffer;
-}
-
 }
@@ -2,61 +2,97 @@
 #define TINYRPC_NET_TCP_TCP_BUFFER_H
 
 #include <vector>
+#include <deque>
 #include <memory>
+#include <string>
+#include <stdint.h>
+#include <sys/uio.h>
 
 
 namespace tinyrpc {
 
+// bytes in TcpBuffer, it's invalid after TcpBuffer is adjusted
+struct BufferView {
+  const char* data {nullptr};
+  int32_t len {0};
 
+  std::string toString() const {
+    return data ? std::string(data, len) : std::string();
+  }
+};
+
+
+//
+// TcpBuffer is a chain of blocks, blocks come from a per-thread free list.
+// Consumed blocks are dropped without moving any byte,
+// and bytes are only copied when someone needs them contiguous (see pullUp)
+//
 class TcpBuffer {
- 
+
  public:
   typedef std::shared_ptr<TcpBuffer> ptr;
 
-  explicit TcpBuffer(int size);
-  
+  // default size of block
+  static const int BLOCK_SIZE = 4096;
+
+  TcpBuffer();
+
   ~TcpBuffer();
 
   int readAble();
 
+  // free bytes of current write block
   int writeAble();
 
-  int readIndex() const;
-
-  int writeIndex() const;
-
-  // int readFormSocket(char* buf, int size);
-
   void writeToBuffer(const char* buf, int size);
 
   void readFromBuffer(std::vector<char>& re, int size);
 
-  void resizeBuffer(int size);
-
   void clearBuffer();
 
-  int getSize();
+  std::string getBufferString();
 
-  // const char* getBuffer();
+  // readable segments, for writev
+  int getReadIovec(struct iovec* iov, int max_count);
 
-  std::vector<char> getBufferVector();
+  // writable segments which are at least size bytes (if max_count enough), for readv
+  // new blocks will be allocated if need
+  int getWriteIovec(struct iovec* iov, int max_count, int size);
 
-  std::string getBufferString();
+  // make first size readable bytes contiguous and return them, nullptr if readable bytes not enough
+  const char* pullUp(int size);
+
+  // return contiguous space of size bytes to write, call recycleWrite after write
+  char* beginWrite(int size);
 
   void recycleRead(int index);
 
+  // move read index but don't drop blocks, so BufferView of read bytes is still valid
+  void skipRead(int index);
+
   void recycleWrite(int index);
 
+  // drop consumed blocks
   void adjustBuffer();
 
  private:
+  struct Block {
+    char* data {nullptr};
+    int capacity {0};
+    int end {0};              // can't write after end
+    int read_index {0};
+    int write_index {0};
+  };
 
-  int m_read_index {0};
-  int m_write_index {0};
-  int m_size {0};
+  Block newBlock(int size);
 
- public:
-  std::vector<char> m_buffer;
+  void freeBlock(Block& block);
+
+  int writeBlockIndex();
+
+ private:
+  std::deque<Block> m_blocks;
+  int m_readable {0};
 
 };
 
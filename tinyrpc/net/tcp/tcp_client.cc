@@ -31,7 +31,7 @@ TcpClient::TcpClient(NetAddress::ptr addr, ProtocalType type /*= TinyPb_Protocal
 		m_codec = std::make_shared<TinyPbCodeC>();
 	}
 
-  m_connection = std::make_shared<TcpConnection>(this, m_reactor, m_fd, 128, m_peer_addr);
+  m_connection = std::make_shared<TcpConnection>(this, m_reactor, m_fd, m_peer_addr);
 
 }
 
@@ -45,7 +45,7 @@ TcpClient::~TcpClient() {
 
 TcpConnection* TcpClient::getConnection() {
   if (!m_connection.get()) {
-    m_connection = std::make_shared<TcpConnection>(this, m_reactor, m_fd, 128, m_peer_addr);
+    m_connection = std::make_shared<TcpConnection>(this, m_reactor, m_fd, m_peer_addr);
   }
   return m_connection.get();
 }
@@ -62,54 +62,45 @@ void TcpClient::resetFd() {
 }
 
 int TcpClient::sendAndRecvTinyPb(const std::string& msg_no, TinyPbStruct::pb_ptr& res) {
+  // every hooked io below returns ETIMEDOUT after m_max_timeout
+  ScopedDeadline deadline(m_max_timeout);
   bool is_timeout = false;
-  tinyrpc::Coroutine* cur_cor = tinyrpc::Coroutine::GetCurrentCoroutine();
-  auto timer_cb = [this, &is_timeout, cur_cor]() {
-    InfoLog << "TcpClient timer out event occur";
-    is_timeout = true;
-    this->m_connection->setOverTimeFlag(true); 
-    tinyrpc::Coroutine::Resume(cur_cor);
-  };
-  TimerEvent::ptr event = std::make_shared<TimerEvent>(m_max_timeout, false, timer_cb);
-  m_reactor->getTimer()->addTimerEvent(event);
 
-  while (!is_timeout) {
+  while (m_connection->getState() != Connected) {
     DebugLog << "begin to connect";
-    if (m_connection->getState() != Connected) {
-      int rt = connect_hook(m_fd, reinterpret_cast<sockaddr*>(m_peer_addr->getSockAddr()), m_peer_addr->getSockLen());
-      if (rt == 0) {
-        DebugLog << "connect [" << m_peer_addr->toString() << "] succ!";
-        m_connection->setUpClient();
-        break;
-      }
-      resetFd();
-      if (is_timeout) {
-        InfoLog << "connect timeout, break";
-        goto err_deal;
-      }
-      if (errno == ECONNREFUSED) {
-        std::stringstream ss;
-        ss << "connect error, peer[ " << m_peer_addr->toString() <<  " ] closed.";
-        m_err_info = ss.str();
-        m_reactor->getTimer()->delTimerEvent(event);
-        return ERROR_PEER_CLOSED;
-      }
-    } else {
+    int rt = connect_hook(m_fd, reinterpret_cast<sockaddr*>(m_peer_addr->getSockAddr()), m_peer_addr->getSockLen());
+    if (rt == 0) {
+      DebugLog << "connect [" << m_peer_addr->toString() << "] succ!";
+      m_connection->setUpClient();
       break;
     }
+    int err = errno;
+    resetFd();
+    if (err == ETIMEDOUT) {
+      InfoLog << "connect timeout, break";
+      is_timeout = true;
+      goto err_deal;
+    }
+    if (err == ECONNREFUSED) {
+      std::stringstream ss;
+      ss << "connect error, peer[ " << m_peer_addr->toString() <<  " ] closed.";
+      m_err_info = ss.str();
+      return ERROR_PEER_CLOSED;
+    }
+    errno = err;
+    break;
   }    
 
   if (m_connection->getState() != Connected) {
     std::stringstream ss;
     ss << "connect peer addr[" << m_peer_addr->toString() << "] error. sys error=" << strerror(errno);
     m_err_info = ss.str();
-    m_reactor->getTimer()->delTimerEvent(event);
     return ERROR_FAILED_CONNECT;
   }
 
   m_connection->setUpClient();
   m_connection->output();
-  if (m_connection->getOverTimerFlag()) {
+  if (deadline.isExpired()) {
     InfoLog << "send data over time";
     is_timeout = true;
     goto err_deal;
@@ -119,7 +110,7 @@ int TcpClient::sendAndRecvTinyPb(const std::string& msg_no, TinyPbStruct::pb_ptr
     DebugLog << "redo getResPackageData";
     m_connection->input();
 
-    if (m_connection->getOverTimerFlag()) {
+    if (deadline.isExpired()) {
       InfoLog << "read data over time";
       is_timeout = true;
       goto err_deal;
@@ -133,7 +124,6 @@ int TcpClient::sendAndRecvTinyPb(const std::string& msg_no, TinyPbStruct::pb_ptr
 
   }
 
-  m_reactor->getTimer()->delTimerEvent(event);
   m_err_info = "";
   return 0;
 
@@ -146,8 +136,6 @@ err_deal:
   if (is_timeout) {
     ss << "call rpc falied, over " << m_max_timeout << " ms";
     m_err_info = ss.str();
-
-    m_connection->setOverTimeFlag(false);
     return ERROR_RPC_CALL_TIMEOUT;
   } else {
     ss << "call rpc falied, peer closed [" << m_peer_addr->toString() << "]";
@@ -157,6 +145,51 @@ err_deal:
 
 }
 
+int TcpClient::connectToPeer() {
+  // connect_hook waits at most gRpcConfig->m_max_connect_timeout
+  int rt = connect_hook(m_fd, reinterpret_cast<sockaddr*>(m_peer_addr->getSockAddr()), m_peer_addr->getSockLen());
+  if (rt != 0) {
+    std::stringstream ss;
+    if (errno == ECONNREFUSED) {
+      ss << "connect error, peer[ " << m_peer_addr->toString() <<  " ] closed.";
+      m_err_info = ss.str();
+      return ERROR_PEER_CLOSED;
+    }
+    ss << "connect peer addr[" << m_peer_addr->toString() << "] error. sys error=" << strerror(errno);
+    m_err_info = ss.str();
+    return ERROR_FAILED_CONNECT;
+  }
+  DebugLog << "connect [" << m_peer_addr->toString() << "] succ!";
+  m_connect_succ = true;
+  m_connection->setUpClient();
+  m_connection->startClientLoop();
+  return 0;
+}
+
+int TcpClient::sendAndRecvTinyPbMultiplex(const std::string& msg_no, TinyPbStruct::pb_ptr& res, int timeout) {
+  if (m_connection->getState() != Connected) {
+    std::stringstream ss;
+    ss << "call rpc falied, peer closed [" << m_peer_addr->toString() << "]";
+    m_err_info = ss.str();
+    return ERROR_PEER_CLOSED;
+  }
+  m_connection->expectResPackageData(msg_no);
+  m_connection->output();
+
+  int rt = m_connection->waitResPackageData(msg_no, res, timeout);
+  if (rt != 0) {
+    std::stringstream ss;
+    if (rt == ERROR_RPC_CALL_TIMEOUT) {
+      ss << "call rpc falied, over " << timeout << " ms";
+    } else {
+      ss << "call rpc falied, peer closed [" << m_peer_addr->toString() << "]";
+    }
+    m_err_info = ss.str();
+    return rt;
+  }
+  return 0;
+}
+
 void TcpClient::stop() {
   if (!m_is_stop) {
     m_is_stop = true;
@@ -30,6 +30,11 @@ class TcpClient {
 
   int sendAndRecvTinyPb(const std::string& msg_no, TinyPbStruct::pb_ptr& res);
 
+  // used by TcpClientPool, connection will be shared by many coroutines
+  int connectToPeer();
+
+  int sendAndRecvTinyPbMultiplex(const std::string& msg_no, TinyPbStruct::pb_ptr& res, int timeout);
+
   void stop();
 
   TcpConnection* getConnection();
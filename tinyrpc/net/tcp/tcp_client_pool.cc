@@ -0,0 +1,192 @@
+#include <algorithm>
+#include "tinyrpc/comm/config.h"
+#include "tinyrpc/comm/log.h"
+#include "tinyrpc/comm/error_code.h"
+#include "tinyrpc/net/tcp/tcp_client_pool.h"
+#include "tinyrpc/net/tcp/tcp_connection.h"
+
+
+namespace tinyrpc {
+
+extern tinyrpc::Config::ptr gRpcConfig;
+
+static thread_local TcpClientPool* t_tcp_client_pool_ptr = nullptr;
+
+TcpClientPool* GetTcpClientPool() {
+  if (!t_tcp_client_pool_ptr) {
+    t_tcp_client_pool_ptr = new TcpClientPool(gRpcConfig->m_client_pool_size,
+        gRpcConfig->m_client_max_inflight, gRpcConfig->m_client_max_idle_time);
+  }
+  return t_tcp_client_pool_ptr;
+}
+
+TcpClientPool::TcpClientPool(int pool_size, int max_inflight, int max_idle_time) 
+  : m_pool_size(pool_size), m_max_inflight(max_inflight), m_max_idle_time(max_idle_time) {
+
+  m_reactor = Reactor::GetReactor();
+  m_event = std::make_shared<TimerEvent>(std::max(m_max_idle_time / 2, 1000), true, std::bind(&TcpClientPool::loopFunc, this));
+  m_reactor->getTimer()->addTimerEvent(m_event);
+}
+
+TcpClientPool::~TcpClientPool() {
+  m_reactor->getTimer()->delTimerEvent(m_event);
+}
+
+int TcpClientPool::getClient(NetAddress::ptr addr, int timeout, TcpClient::ptr& client, std::string& err_info) {
+  std::string key = addr->toString();
+  int64_t deadline = getNowMs() + timeout;
+
+  while (true) {
+    std::vector<PooledClient::ptr>& clients = m_clients[key];
+    removeClosedClients(clients);
+
+    // choose the connection which has least calls in flight
+    PooledClient::ptr best;
+    for (size_t i = 0; i < clients.size(); ++i) {
+      PooledClient::ptr& tmp = clients[i];
+      if (tmp->is_connecting || tmp->client->getConnection()->getState() != Connected) {
+        continue;
+      }
+      if (tmp->inflight >= m_max_inflight) {
+        continue;
+      }
+      if (!best || tmp->inflight < best->inflight) {
+        best = tmp;
+      }
+    }
+    if (best) {
+      best->inflight++;
+      client = best->client;
+      return 0;
+    }
+
+    if ((int)clients.size() < m_pool_size) {
+      return connectNewClient(key, addr, client, err_info);
+    }
+
+    int64_t left = deadline - getNowMs();
+    if (left <= 0 || !waitFreeClient(key, left)) {
+      std::stringstream ss;
+      ss << "call rpc falied, over " << timeout << " ms, no free connection to [" << key << "]";
+      err_info = ss.str();
+      return ERROR_RPC_CALL_TIMEOUT;
+    }
+  }
+}
+
+void TcpClientPool::returnClient(TcpClient::ptr client) {
+  std::string key = client->getPeerAddr()->toString();
+  std::vector<PooledClient::ptr>& clients = m_clients[key];
+  for (size_t i = 0; i < clients.size(); ++i) {
+    if (clients[i]->client == client) {
+      clients[i]->inflight--;
+      clients[i]->last_active_time = getNowMs();
+      break;
+    }
+  }
+  wakeupWaiter(key);
+}
+
+int TcpClientPool::connectNewClient(const std::string& key, NetAddress::ptr addr, TcpClient::ptr& client, std::string& err_info) {
+  PooledClient::ptr tmp = std::make_shared<PooledClient>();
+  tmp->client = std::make_shared<TcpClient>(addr);
+  tmp->is_connecting = true;
+  // reserved for current coroutine
+  tmp->inflight = 1;
+  m_clients[key].push_back(tmp);
+
+  int rt = tmp->client->connectToPeer();
+  tmp->is_connecting = false;
+  if (rt != 0) {
+    err_info = tmp->client->getErrInfo();
+    std::vector<PooledClient::ptr>& clients = m_clients[key];
+    clients.erase(std::find(clients.begin(), clients.end(), tmp));
+    // let other waiter try to connect again
+    wakeupWaiter(key);
+    return rt;
+  }
+
+  InfoLog << "TcpClientPool create new connection to [" << key << "]";
+  client = tmp->client;
+  return 0;
+}
+
+bool TcpClientPool::waitFreeClient(const std::string& key, int timeout) {
+  // on heap, stack of a suspended coroutine may be used by others if it runs on share stack
+  std::shared_ptr<Waiter> waiter = std::make_shared<Waiter>();
+  waiter->cor = Coroutine::GetCurrentCoroutine();
+
+  std::list<Waiter*>& waiters = m_waiters[key];
+  auto pos = waiters.insert(waiters.end(), waiter.get());
+
+  std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+  auto timer_cb = [this, &waiters, pos, waiter, is_timeout]() {
+    if (!waiter->in_queue) {
+      // already waked up
+      return;
+    }
+    waiters.erase(pos);
+    waiter->in_queue = false;
+    *is_timeout = true;
+    m_reactor->schedule(waiter->cor);
+  };
+  TimerEvent::ptr event = std::make_shared<TimerEvent>(timeout, false, timer_cb);
+  m_reactor->getTimer()->addTimerEvent(event);
+
+  Coroutine::Yield();
+
+  m_reactor->getTimer()->delTimerEvent(event);
+  return !*is_timeout;
+}
+
+void TcpClientPool::wakeupWaiter(const std::string& key) {
+  auto it = m_waiters.find(key);
+  if (it == m_waiters.end() || it->second.empty()) {
+    return;
+  }
+  Waiter* waiter = it->second.front();
+  it->second.pop_front();
+  waiter->in_queue = false;
+
+  Coroutine* cor = waiter->cor;
+  m_reactor->schedule(cor, false);
+}
+
+void TcpClientPool::removeClosedClients(std::vector<PooledClient::ptr>& clients) {
+  for (auto it = clients.begin(); it != clients.end();) {
+    PooledClient::ptr& tmp = *it;
+    if (!tmp->is_connecting && tmp->inflight == 0
+        && tmp->client->getConnection()->getState() == Closed) {
+      DebugLog << "TcpClientPool remove closed connection to [" << tmp->client->getPeerAddr()->toString() << "]";
+      it = clients.erase(it);
+      continue;
+    }
+    ++it;
+  }
+}
+
+void TcpClientPool::loopFunc() {
+  int64_t now = getNowMs();
+  for (auto it = m_clients.begin(); it != m_clients.end(); ++it) {
+    size_t size = it->second.size();
+    removeClosedClients(it->second);
+
+    for (size_t i = 0; i < it->second.size(); ++i) {
+      PooledClient::ptr& tmp = it->second[i];
+      if (tmp->is_connecting || tmp->inflight > 0) {
+        continue;
+      }
+      if (now - tmp->last_active_time >= m_max_idle_time) {
+        // read coroutine of this connection will get FIN and set it CLOSED
+        InfoLog << "TcpClientPool shutdown idle connection to [" << it->first << "]";
+        tmp->client->getConnection()->shutdownConnection();
+      }
+    }
+
+    if (it->second.size() < size) {
+      wakeupWaiter(it->first);
+    }
+  }
+}
+
+}
@@ -0,0 +1,79 @@
+#ifndef TINYRPC_NET_TCP_TCP_CLIENT_POOL_H
+#define TINYRPC_NET_TCP_TCP_CLIENT_POOL_H
+
+#include <memory>
+#include <map>
+#include <list>
+#include <vector>
+#include <string>
+#include "tinyrpc/coroutine/coroutine.h"
+#include "tinyrpc/net/net_address.h"
+#include "tinyrpc/net/reactor.h"
+#include "tinyrpc/net/timer.h"
+#include "tinyrpc/net/tcp/tcp_client.h"
+
+namespace tinyrpc {
+
+//
+// Every thread has one TcpClientPool, it keeps connections to each peer addr.
+// One connection can be used by many coroutines of this thread at the same time,
+// replies are matched by msg_req.
+// You should use TcpClientPool in a coroutine(not main coroutine)
+//
+class TcpClientPool {
+
+ public:
+  TcpClientPool(int pool_size, int max_inflight, int max_idle_time);
+
+  ~TcpClientPool();
+
+  // get a connected client of addr, current coroutine may yield to connect or to wait a free one
+  int getClient(NetAddress::ptr addr, int timeout, TcpClient::ptr& client, std::string& err_info);
+
+  void returnClient(TcpClient::ptr client);
+
+ private:
+  struct PooledClient {
+    typedef std::shared_ptr<PooledClient> ptr;
+    TcpClient::ptr client;
+    int inflight {0};
+    int64_t last_active_time {0};
+    bool is_connecting {false};
+  };
+
+  struct Waiter {
+    Coroutine* cor {nullptr};
+    bool in_queue {true};
+  };
+
+  int connectNewClient(const std::string& key, NetAddress::ptr addr, TcpClient::ptr& client, std::string& err_info);
+
+  bool waitFreeClient(const std::string& key, int timeout);
+
+  void wakeupWaiter(const std::string& key);
+
+  void removeClosedClients(std::vector<PooledClient::ptr>& clients);
+
+  void loopFunc();
+
+ private:
+  int m_pool_size {0};
+  int m_max_inflight {0};
+  int m_max_idle_time {0};    // ms
+
+  Reactor* m_reactor {nullptr};
+  TimerEvent::ptr m_event;
+
+  // peer addr -> connections
+  std::map<std::string, std::vector<PooledClient::ptr>> m_clients;
+
+  // peer addr -> coroutines waiting for free connection
+  std::map<std::string, std::list<Waiter*>> m_waiters;
+
+};
+
+TcpClientPool* GetTcpClientPool();
+
+}
+
+#endif
@@ -1,4 +1,5 @@
 #include <unistd.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/socket.h>
 #include "tinyrpc/net/tcp/tcp_connection.h"
@@ -11,19 +12,33 @@
 #include "tinyrpc/net/tcp/tcp_connection_time_wheel.h"
 #include "tinyrpc/net/tcp/abstract_slot.h"
 #include "tinyrpc/net/timer.h"
+#include "tinyrpc/comm/error_code.h"
+#include "tinyrpc/comm/config.h"
 
 namespace tinyrpc {
 
-TcpConnection::TcpConnection(tinyrpc::TcpServer* tcp_svr, tinyrpc::IOThread* io_thread, int fd, int buff_size, NetAddress::ptr peer_addr)
+extern tinyrpc::Config::ptr gRpcConfig;
+
+// overflow area of readv, data which read buffer can't hold is read here first
+static const int EXTRA_BUF_SIZE = 65536;
+static thread_local char t_extra_buf[EXTRA_BUF_SIZE];
+
+// max count of segments in one writev
+static const int MAX_WRITE_IOV = 64;
+
+TcpConnection::TcpConnection(tinyrpc::TcpServer* tcp_svr, tinyrpc::IOThread* io_thread, int fd, NetAddress::ptr peer_addr)
   : m_io_thread(io_thread), m_fd(fd), m_state(Connected), m_connection_type(ServerConnection), m_peer_addr(peer_addr) {	
   m_reactor = m_io_thread->getReactor();
 
   m_tcp_svr = tcp_svr;
 
   m_codec = m_tcp_svr->getCodec();
+  if (m_codec->getProtocalType() == TinyPb_Protocal) {
+    m_max_concurrent_requests = gRpcConfig->m_server_max_concurrent_requests;
+  }
   m_fd_event = FdEventContainer::GetFdContainer()->getFdEvent(fd);
   m_fd_event->setReactor(m_reactor);
-  initBuffer(buff_size); 
+  initBuffer(); 
 
   m_loop_cor = GetCoroutinePool()->getCoroutineInstanse();
   m_loop_cor->setCallBack(std::bind(&TcpConnection::MainServerLoopCorFunc, this));
@@ -33,7 +48,7 @@ TcpConnection::TcpConnection(tinyrpc::TcpServer* tcp_svr, tinyrpc::IOThread* io_
   
 }
 
-TcpConnection::TcpConnection(tinyrpc::TcpClient* tcp_cli, tinyrpc::Reactor* reactor, int fd, int buff_size, NetAddress::ptr peer_addr)
+TcpConnection::TcpConnection(tinyrpc::TcpClient* tcp_cli, tinyrpc::Reactor* reactor, int fd, NetAddress::ptr peer_addr)
   : m_fd(fd), m_state(NotConnected), m_connection_type(ClientConnection), m_peer_addr(peer_addr) {
   m_reactor = reactor;
 
@@ -43,7 +58,7 @@ TcpConnection::TcpConnection(tinyrpc::TcpClient* tcp_cli, tinyrpc::Reactor* reac
 
   m_fd_event = FdEventContainer::GetFdContainer()->getFdEvent(fd);
   m_fd_event->setReactor(m_reactor);
-  initBuffer(buff_size); 
+  initBuffer(); 
 
   DebugLog << "succ create tcp connection[NotConnected]";
 
@@ -64,18 +79,19 @@ void TcpConnection::setUpClient() {
 }
 
 TcpConnection::~TcpConnection() {
-  if (m_connection_type == ServerConnection) {
+  if (m_loop_cor) {
     GetCoroutinePool()->returnCoroutine(m_loop_cor);
   }
 
   DebugLog << "~TcpConnection, fd=" << m_fd;
 }
 
-void TcpConnection::initBuffer(int size) {
+void TcpConnection::initBuffer() {
 
   // 初始化缓冲区大小
-  m_write_buffer = std::make_shared<TcpBuffer>(size);
-  m_read_buffer = std::make_shared<TcpBuffer>(size);
+  m_write_buffer = std::make_shared<TcpBuffer>();
+  m_read_buffer = std::make_shared<TcpBuffer>();
+  m_pending_write_buffer = std::make_shared<TcpBuffer>();
 
 }
 
@@ -91,11 +107,53 @@ void TcpConnection::MainServerLoopCorFunc() {
   InfoLog << "this connection has already end loop";
 }
 
-void TcpConnection::input() {
-  if (m_is_over_time) {
-    InfoLog << "over timer, skip input progress";
-    return;
+void TcpConnection::startClientLoop() {
+  m_loop_cor = GetCoroutinePool()->getCoroutineInstanse();
+  m_loop_cor->setCallBack(std::bind(&TcpConnection::MainClientLoopCorFunc, this));
+  m_reactor->addCoroutine(m_loop_cor);
+}
+
+void TcpConnection::MainClientLoopCorFunc() {
+  // only this coroutine read the connection, others wait for their reply by msg_req
+  while (!m_stop) {
+    input();
+
+    execute();
+
+    wakeupReplyWaiters();
+  }
+
+  // connection closed, wake up all waiters
+  for (auto it = m_reply_waiters.begin(); it != m_reply_waiters.end(); ++it) {
+    Coroutine* cor = it->second;
+    if (cor) {
+      it->second = nullptr;
+      m_reactor->schedule(cor, false);
+    }
   }
+  InfoLog << "this client connection has already end loop";
+}
+
+void TcpConnection::wakeupReplyWaiters() {
+  for (auto it = m_reply_datas.begin(); it != m_reply_datas.end();) {
+    auto waiter = m_reply_waiters.find(it->first);
+    if (waiter == m_reply_waiters.end()) {
+      // nobody wait for it, maybe caller has timeout
+      DebugLog << it->first << "|drop reply data without waiter";
+      it = m_reply_datas.erase(it);
+      continue;
+    }
+    Coroutine* cor = waiter->second;
+    if (cor) {
+      // can't resume other coroutine in non-main coroutine, let reactor do it
+      waiter->second = nullptr;
+      m_reactor->schedule(cor, false);
+    }
+    ++it;
+  }
+}
+
+void TcpConnection::input() {
   if (m_state == Closed || m_state == NotConnected) {
     return;
   }
@@ -104,26 +162,39 @@ void TcpConnection::input() {
   int count = 0;
   while (!read_all) {
 
-    if (m_read_buffer->writeAble() == 0) {
-      m_read_buffer->resizeBuffer(2 * m_read_buffer->getSize());
+    // free space of current block, and the per-thread extra buffer for the rest
+    // so that most messages are read in one syscall and buffer only grows by bytes really read
+    struct iovec iov[2];
+    m_read_buffer->getWriteIovec(&iov[0], 1, 1);
+    int in_buffer = iov[0].iov_len;
+    int iov_count = 1;
+    // io_uring reads after this coroutine yields, when reads of other connections may be in flight too,
+    // so the shared extra buffer is only used by synchronous read
+    if (!Reactor::GetReactor()->getIoUring()) {
+      iov[1].iov_base = t_extra_buf;
+      iov[1].iov_len = EXTRA_BUF_SIZE;
+      iov_count = 2;
     }
+    int read_count = in_buffer + (iov_count == 2 ? EXTRA_BUF_SIZE : 0);
 
-    int read_count = m_read_buffer->writeAble();
-    int write_index = m_read_buffer->writeIndex();
-
-    DebugLog << "m_read_buffer size=" << m_read_buffer->getBufferVector().size() << "rd=" << m_read_buffer->readIndex() << "wd=" << m_read_buffer->writeIndex();
-    int rt = read_hook(m_fd, &(m_read_buffer->m_buffer[write_index]), read_count);
+    int rt = readv_hook(m_fd, iov, iov_count);
+    if (rt < 0 && errno == ETIMEDOUT) {
+      // deadline of current coroutine is reached, connection is still usable
+      InfoLog << "read timeout, now break read function";
+      return;
+    }
     if (rt > 0) {
-      m_read_buffer->recycleWrite(rt);
+      if (rt <= in_buffer) {
+        m_read_buffer->recycleWrite(rt);
+      } else {
+        m_read_buffer->recycleWrite(in_buffer);
+        m_read_buffer->writeToBuffer(t_extra_buf, rt - in_buffer);
+      }
     }
-    DebugLog << "m_read_buffer size=" << m_read_buffer->getBufferVector().size() << "rd=" << m_read_buffer->readIndex() << "wd=" << m_read_buffer->writeIndex();
+    DebugLog << "m_read_buffer readable=" << m_read_buffer->readAble();
 
     DebugLog << "read data back";
     count += rt;
-    if (m_is_over_time) {
-      InfoLog << "over timer, now break read function";
-      break;
-    }
     if (rt <= 0) {
       DebugLog << "rt <= 0";
       ErrorLog << "read empty while occur read event, because of peer close, sys error=" << strerror(errno) << ", now to clear tcp connection";
@@ -145,7 +216,7 @@ void TcpConnection::input() {
       }
     }
   }
-  if (close_flag || m_is_over_time) {
+  if (close_flag) {
     return;
   }
   if (!read_all) {
@@ -166,6 +237,14 @@ void TcpConnection::execute() {
 
   // it only server do this
   while(m_read_buffer->readAble() > 0) {
+    while (m_connection_type == ServerConnection && m_max_concurrent_requests > 0
+        && m_concurrent_requests >= m_max_concurrent_requests) {
+      // stop decode until one request done
+      DebugLog << "concurrent requests reach max [" << m_max_concurrent_requests << "], wait";
+      m_dispatch_waiter = Coroutine::GetCurrentCoroutine();
+      Coroutine::Yield();
+    }
+
     std::shared_ptr<AbstractData> data;
     if (m_codec->getProtocalType() == TinyPb_Protocal) {
       data = std::make_shared<TinyPbStruct>();
@@ -173,7 +252,10 @@ void TcpConnection::execute() {
       data = std::make_shared<HttpRequest>();
     }
 
+    int read_able = m_read_buffer->readAble();
     m_codec->decode(m_read_buffer.get(), data.get());
+    data->decode_time = getNowUs();
+    data->decode_len = read_able - m_read_buffer->readAble();
     // DebugLog << "parse service_name=" << pb_struct.service_full_name;
     if (!data->decode_succ) {
       DebugLog << "it parse request error";
@@ -181,6 +263,10 @@ void TcpConnection::execute() {
     }
     DebugLog << "it parse request success";
     if (m_connection_type == ServerConnection) {
+      if (m_max_concurrent_requests > 0) {
+        dispatchInCoroutine(data);
+        continue;
+      }
       DebugLog << "to dispatch this package";
       m_tcp_svr->getDispatcher()->dispatch(data.get(), this);
       DebugLog << "contine parse next package";
@@ -188,54 +274,100 @@ void TcpConnection::execute() {
       // TODO:
       std::shared_ptr<TinyPbStruct> tmp = std::dynamic_pointer_cast<TinyPbStruct>(data);
       if (tmp) {
+        // reply data is used after read buffer changed, so copy it out of buffer
+        tmp->detachBuffer();
         m_reply_datas.insert(std::make_pair(tmp->msg_req, tmp));
       }
     }
 
   }
+  // all decoded packages have been handled, now buffer can be moved
+  m_read_buffer->adjustBuffer();
 
 }
 
+void TcpConnection::dispatchInCoroutine(std::shared_ptr<AbstractData> data) {
+  // read buffer will be changed when this request is handling
+  std::shared_ptr<TinyPbStruct> tmp = std::dynamic_pointer_cast<TinyPbStruct>(data);
+  tmp->detachBuffer();
+
+  m_concurrent_requests++;
+  Coroutine::ptr cor = GetCoroutinePool()->getCoroutineInstanse();
+  TcpConnection::ptr conn = shared_from_this();
+
+  cor->setCallBack([conn, data, cor]() mutable {
+    DebugLog << "to dispatch this package in coroutine";
+    conn->m_tcp_svr->getDispatcher()->dispatch(data.get(), conn.get());
+    // reply is written as soon as request done, it's matched by msg_req in client
+    conn->output();
+
+    conn->m_concurrent_requests--;
+    if (conn->m_dispatch_waiter) {
+      Coroutine* waiter = conn->m_dispatch_waiter;
+      conn->m_dispatch_waiter = nullptr;
+      conn->m_reactor->schedule(waiter, false);
+    }
+
+    GetCoroutinePool()->returnCoroutine(cor);
+    // callback is kept by coroutine, release connection here
+    data.reset();
+    cor.reset();
+    conn.reset();
+  });
+  m_reactor->addCoroutine(cor, false);
+}
+
 void TcpConnection::output() {
-  if (m_is_over_time) {
-    InfoLog << "over timer, skip output progress";
+  if (m_is_writing) {
+    // other coroutine is writing, it will send data in m_pending_write_buffer too
     return;
   }
+  m_is_writing = true;
   while(true) {
     if (m_state != Connected) {
       break;
     }
 
     if (m_write_buffer->readAble() == 0) {
-      DebugLog << "app buffer of fd[" << m_fd << "] no data to write, to yiled this coroutine";
-      break;
+      if (m_pending_write_buffer->readAble() == 0) {
+        DebugLog << "app buffer of fd[" << m_fd << "] no data to write, to yiled this coroutine";
+        break;
+      }
+      m_write_buffer.swap(m_pending_write_buffer);
     }
     
-    int total_size = m_write_buffer->readAble();
-    int read_index = m_write_buffer->readIndex();
-    int rt = write_hook(m_fd, &(m_write_buffer->m_buffer[read_index]), total_size);
+    // all queued data, including replies appended to pending buffer, in one syscall
+    struct iovec iov[MAX_WRITE_IOV];
+    int iov_count = m_write_buffer->getReadIovec(iov, MAX_WRITE_IOV);
+    int write_size = m_write_buffer->readAble();
+    if (iov_count < MAX_WRITE_IOV) {
+      iov_count += m_pending_write_buffer->getReadIovec(iov + iov_count, MAX_WRITE_IOV - iov_count);
+    }
+    int rt = writev_hook(m_fd, iov, iov_count);
     // InfoLog << "write end";
     if (rt <= 0) {
       ErrorLog << "write empty, error=" << strerror(errno);
+      break;
     }
 
     DebugLog << "succ write " << rt << " bytes";
-    m_write_buffer->recycleRead(rt);
-    DebugLog << "recycle write index =" << m_write_buffer->writeIndex() << ", read_index =" << m_write_buffer->readIndex() << "readable = " << m_write_buffer->readAble();
+    if (rt <= write_size) {
+      m_write_buffer->recycleRead(rt);
+    } else {
+      m_write_buffer->recycleRead(write_size);
+      m_pending_write_buffer->recycleRead(rt - write_size);
+    }
+    DebugLog << "readable = " << m_write_buffer->readAble();
     InfoLog << "send[" << rt << "] bytes data to [" << m_peer_addr->toString() << "], fd [" << m_fd << "]";
-    if (m_write_buffer->readAble() <= 0) {
+    if (m_write_buffer->readAble() <= 0 && m_pending_write_buffer->readAble() <= 0) {
       // InfoLog << "send all data, now unregister write event on reactor and yield Coroutine";
       InfoLog << "send all data, now unregister write event and break";
       // m_fd_event->delListenEvents(IOEvent::WRITE);
       break;
     }
 
-    if (m_is_over_time) {
-      InfoLog << "over timer, now break write function";
-      break;
-    }
-
   }
+  m_is_writing = false;
 }
 
 
@@ -250,7 +382,10 @@ void TcpConnection::clearClient() {
   // stop read and write cor
   m_stop = true;
 
-  close(m_fd_event->getFd());
+  // fd of client connection is owned by TcpClient, it will be closed when TcpClient destroy
+  if (m_connection_type == ServerConnection) {
+    close(m_fd_event->getFd());
+  }
   m_state = Closed;
 
 }
@@ -276,6 +411,10 @@ TcpBuffer* TcpConnection::getInBuffer() {
 }
 
 TcpBuffer* TcpConnection::getOutBuffer() {
+  // m_write_buffer may be realloced while other coroutine is writing it
+  if (m_is_writing) {
+    return m_pending_write_buffer.get();
+  }
   return m_write_buffer.get();
 }
 
@@ -292,6 +431,53 @@ bool TcpConnection::getResPackageData(const std::string& msg_req, TinyPbStruct::
 
 }
 
+void TcpConnection::expectResPackageData(const std::string& msg_req) {
+  // must be called before send request, otherwise reply may be droped
+  m_reply_waiters[msg_req] = nullptr;
+}
+
+int TcpConnection::waitResPackageData(const std::string& msg_req, TinyPbStruct::pb_ptr& pb_struct, int timeout) {
+  if (getResPackageData(msg_req, pb_struct)) {
+    m_reply_waiters.erase(msg_req);
+    return 0;
+  }
+  if (m_state != Connected) {
+    m_reply_waiters.erase(msg_req);
+    return ERROR_PEER_CLOSED;
+  }
+
+  std::shared_ptr<bool> is_timeout = std::make_shared<bool>(false);
+  Coroutine* cur_cor = Coroutine::GetCurrentCoroutine();
+  m_reply_waiters[msg_req] = cur_cor;
+
+  auto timer_cb = [this, msg_req, cur_cor, is_timeout]() {
+    auto it = m_reply_waiters.find(msg_req);
+    if (it == m_reply_waiters.end() || it->second != cur_cor) {
+      // already waked up by reply
+      return;
+    }
+    InfoLog << msg_req << "|wait reply data timeout";
+    it->second = nullptr;
+    *is_timeout = true;
+    m_reactor->schedule(cur_cor);
+  };
+  TimerEvent::ptr event = std::make_shared<TimerEvent>(timeout, false, timer_cb);
+  m_reactor->getTimer()->addTimerEvent(event);
+
+  Coroutine::Yield();
+
+  m_reactor->getTimer()->delTimerEvent(event);
+  m_reply_waiters.erase(msg_req);
+
+  if (*is_timeout) {
+    return ERROR_RPC_CALL_TIMEOUT;
+  }
+  if (getResPackageData(msg_req, pb_struct)) {
+    return 0;
+  }
+  return ERROR_PEER_CLOSED;
+}
+
 
 AbstractCodeC::ptr TcpConnection::getCodec() const {
   return m_codec;
@@ -301,14 +487,5 @@ TcpConnectionState TcpConnection::getState() const {
   return m_state;
 }
 
-void TcpConnection::setOverTimeFlag(bool value) {
-  m_is_over_time = value;
-}
-
-bool TcpConnection::getOverTimerFlag() {
-  return m_is_over_time;
-}
-
-
 
 }
@@ -35,15 +35,15 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
  public:
  	typedef std::shared_ptr<TcpConnection> ptr;
 
-	TcpConnection(tinyrpc::TcpServer* tcp_svr, tinyrpc::IOThread* io_thread, int fd, int buff_size, NetAddress::ptr peer_addr);
+	TcpConnection(tinyrpc::TcpServer* tcp_svr, tinyrpc::IOThread* io_thread, int fd, NetAddress::ptr peer_addr);
 
-	TcpConnection(tinyrpc::TcpClient* tcp_cli, tinyrpc::Reactor* reactor, int fd, int buff_size, NetAddress::ptr peer_addr);
+	TcpConnection(tinyrpc::TcpClient* tcp_cli, tinyrpc::Reactor* reactor, int fd, NetAddress::ptr peer_addr);
 
   void setUpClient();
 
 	~TcpConnection();
 
-  void initBuffer(int size);
+  void initBuffer();
 
   enum ConnectionType {
     ServerConnection = 1,     // owned by tcp_server
@@ -67,23 +67,32 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
   void registerToTimeWheel();
 
+  // multiplexed client connection, shared by coroutines of the same reactor
+  void startClientLoop();
+
+  void expectResPackageData(const std::string& msg_req);
+
+  int waitResPackageData(const std::string& msg_req, TinyPbStruct::pb_ptr& pb_struct, int timeout);
+
  public:
   void MainServerLoopCorFunc();
 
+  void MainClientLoopCorFunc();
+
   void input();
 
   void execute(); 
 
 	void output();
 
-  void setOverTimeFlag(bool value);
-
-  bool getOverTimerFlag();
-
 
  private:
   void clearClient();
 
+  void wakeupReplyWaiters();
+
+  void dispatchInCoroutine(std::shared_ptr<AbstractData> data);
+
  private:
   TcpServer* m_tcp_svr {nullptr};
   TcpClient* m_tcp_cli {nullptr};
@@ -99,6 +108,8 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
 	TcpBuffer::ptr m_read_buffer;
 	TcpBuffer::ptr m_write_buffer;
+  // data appended by other coroutines while one is writing m_write_buffer
+	TcpBuffer::ptr m_pending_write_buffer;
 
   Coroutine::ptr m_loop_cor;
 
@@ -108,10 +119,19 @@ class TcpConnection : public std::enable_shared_from_this<TcpConnection> {
 
   bool m_stop {false};
 
-  bool m_is_over_time {false};
+  bool m_is_writing {false};
 
   std::map<std::string, std::shared_ptr<TinyPbStruct>> m_reply_datas;
 
+  // msg_req -> coroutine waiting for its reply, nullptr means not yield yet
+  std::map<std::string, Coroutine*> m_reply_waiters;
+
+  // server connection: requests handling in their own coroutines
+  int m_max_concurrent_requests {0};
+  int m_concurrent_requests {0};
+  // loop coroutine waiting for m_concurrent_requests less than max
+  Coroutine* m_dispatch_waiter {nullptr};
+
   std::weak_ptr<AbstractSlot<TcpConnection>> m_weak_slot;
 
 
@@ -19,7 +19,10 @@ namespace tinyrpc {
 
 extern tinyrpc::Config::ptr gRpcConfig;
 
-TcpAcceptor::TcpAcceptor(NetAddress::ptr net_addr) : m_local_addr(net_addr) {
+// accept error such as EMFILE may last for a while, retry after this (us)
+static const useconds_t ACCEPT_RETRY_INTERVAL = 100 * 1000;
+
+TcpAcceptor::TcpAcceptor(NetAddress::ptr net_addr, bool reuse_port /*= false*/) : m_reuse_port(reuse_port), m_local_addr(net_addr) {
 	
 	m_family = m_local_addr->getFamily();
 }
@@ -44,6 +47,12 @@ void TcpAcceptor::init() {
 	if (setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val)) < 0) {
 		ErrorLog << "set REUSEADDR error";
 	}
+	if (m_reuse_port) {
+		if (setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val)) < 0) {
+			ErrorLog << "start server error. set REUSEPORT error, errno=" << errno << ", error=" << strerror(errno);
+			Exit(0);
+		}
+	}
 
 	socklen_t len = m_local_addr->getSockLen();
 	int rt = bind(m_fd, m_local_addr->getSockAddr(), len);
@@ -54,7 +63,7 @@ void TcpAcceptor::init() {
   // assert(rt == 0);
 
 	DebugLog << "set REUSEADDR succ";
-	rt = listen(m_fd, 10);
+	rt = listen(m_fd, gRpcConfig->m_server_listen_backlog);
 	if (rt != 0) {
 		ErrorLog << "start server error. listen error, fd= " << m_fd << ", errno=" << errno << ", error=" << strerror(errno);
 		Exit(0);
@@ -83,7 +92,9 @@ int TcpAcceptor::toAccept() {
 		// call hook accept
 		rt = accept_hook(m_fd, reinterpret_cast<sockaddr *>(&cli_addr), &len);
 		if (rt == -1) {
-			DebugLog << "error, no new client coming, errno=" << errno << "error=" << strerror(errno);
+			int err = errno;
+			DebugLog << "error, no new client coming, errno=" << err << "error=" << strerror(err);
+			errno = err;
 			return -1;
 		}
 		InfoLog << "New client accepted succ! port:[" << cli_addr.sin_port;
@@ -95,7 +106,9 @@ int TcpAcceptor::toAccept() {
 		// call hook accept
 		rt = accept_hook(m_fd, reinterpret_cast<sockaddr *>(&cli_addr), &len);
 		if (rt == -1) {
-			DebugLog << "error, no new client coming, errno=" << errno << "error=" << strerror(errno);
+			int err = errno;
+			DebugLog << "error, no new client coming, errno=" << err << "error=" << strerror(err);
+			errno = err;
 			return -1;
 		}
 		m_peer_addr = std::make_shared<UnixDomainAddress>(cli_addr);
@@ -128,6 +141,27 @@ TcpServer::TcpServer(NetAddress::ptr addr, ProtocalType type /*= TinyPb_Protocal
 
 void TcpServer::start() {
 
+	if (isReusePort()) {
+		// every io thread accepts on its own socket, kernel spreads connections and there is no handoff
+		int size = m_io_pool->getIOThreadPoolSize();
+		m_io_acceptors.resize(size);
+		m_io_accept_cors.resize(size);
+		for (int i = 0; i < size; ++i) {
+			m_io_acceptors[i] = std::make_shared<TcpAcceptor>(m_addr, true);
+			m_io_acceptors[i]->init();
+		}
+		for (int i = 0; i < size; ++i) {
+			m_io_pool->addTaskByIndex(i, [this, i]() {
+				m_io_accept_cors[i] = GetCoroutinePool()->getCoroutineInstanse();
+				m_io_accept_cors[i]->setCallBack(std::bind(&TcpServer::IOThreadAcceptCorFunc, this, i));
+				tinyrpc::Coroutine::Resume(m_io_accept_cors[i].get());
+			});
+		}
+		InfoLog << "TcpServer accept in " << size << " io threads with SO_REUSEPORT";
+		m_main_reactor->loop();
+		return;
+	}
+
 	m_acceptor.reset(new TcpAcceptor(m_addr));
 	// m_accept_cor = std::make_shared<tinyrpc::Coroutine>(128 * 1024, std::bind(&TcpServer::MainAcceptCorFunc, this)); 
 
@@ -140,14 +174,35 @@ void TcpServer::start() {
 }
 
 TcpServer::~TcpServer() {
-	GetCoroutinePool()->returnCoroutine(m_accept_cor);
+	if (m_accept_cor) {
+		GetCoroutinePool()->returnCoroutine(m_accept_cor);
+	}
+	for (size_t i = 0; i < m_io_accept_cors.size(); ++i) {
+		if (m_io_accept_cors[i]) {
+			GetCoroutinePool()->returnCoroutine(m_io_accept_cors[i]);
+		}
+	}
   DebugLog << "~TcpServer";
 }
 
 NetAddress::ptr TcpServer::getPeerAddr() {
+	if (!m_acceptor) {
+		return nullptr;
+	}
 	return m_acceptor->getPeerAddr();
 }
 
+bool TcpServer::isReusePort() {
+	if (!gRpcConfig->m_server_reuse_port) {
+		return false;
+	}
+	if (m_addr->getFamily() != AF_INET) {
+		ErrorLog << "SO_REUSEPORT only support AF_INET address, accept in main thread";
+		return false;
+	}
+	return true;
+}
+
 void TcpServer::MainAcceptCorFunc() {
   DebugLog << "enable Hook here";
 
@@ -161,8 +216,9 @@ void TcpServer::MainAcceptCorFunc() {
       continue;
     }
     IOThread *io_thread = m_io_pool->getIOThread();
-    auto cb = [this, io_thread, fd]() {
-      io_thread->addClient(this, fd);
+    NetAddress::ptr peer_addr = m_acceptor->getPeerAddr();
+    auto cb = [this, io_thread, fd, peer_addr]() {
+      io_thread->addClient(this, fd, peer_addr);
     };
     io_thread->getReactor()->addTask(cb);
     m_tcp_counts++;
@@ -170,6 +226,30 @@ void TcpServer::MainAcceptCorFunc() {
   }
 }
 
+void TcpServer::IOThreadAcceptCorFunc(int index) {
+  TcpAcceptor::ptr acceptor = m_io_acceptors[index];
+  IOThread* io_thread = IOThread::GetCurrentIOThread();
+
+  while (!m_is_stop_accept) {
+
+    int fd = acceptor->toAccept();
+    if (fd == -1) {
+      int err = errno;
+      // kernel keeps hashing new connections to this socket, so never stop accepting
+      if (err == EINTR || err == ECONNABORTED || err == EPROTO) {
+        continue;
+      }
+      ErrorLog << "accept ret -1 error, errno=" << err << ", error=" << strerror(err) << ", retry later";
+      usleep_hook(ACCEPT_RETRY_INTERVAL);
+      continue;
+    }
+    // connection stays in the thread which accepts it
+    io_thread->addClient(this, fd, acceptor->getPeerAddr());
+    m_tcp_counts++;
+    DebugLog << "current tcp connection count is [" << m_tcp_counts << "]";
+  }
+}
+
 AbstractDispatcher::ptr TcpServer::getDispatcher() {	
 	return m_dispatcher;	
 }
@@ -2,6 +2,8 @@
 #define TINYRPC_NET_TCP_TCP_SERVER_H
 
 #include <map>
+#include <atomic>
+#include <vector>
 #include <google/protobuf/service.h>
 #include "tinyrpc/net/reactor.h"
 #include "tinyrpc/net/fd_event.h"
@@ -23,7 +25,7 @@ class TcpAcceptor {
  public:
 
   typedef std::shared_ptr<TcpAcceptor> ptr;
-  TcpAcceptor(NetAddress::ptr net_addr);
+  TcpAcceptor(NetAddress::ptr net_addr, bool reuse_port = false);
 
   void init();
 
@@ -41,7 +43,8 @@ class TcpAcceptor {
  
  private:
   int m_family;
-  int m_fd;
+  int m_fd {-1};
+  bool m_reuse_port {false};
 
   NetAddress::ptr m_local_addr;
   NetAddress::ptr m_peer_addr;
@@ -82,19 +85,28 @@ class TcpServer {
  private:
   void MainAcceptCorFunc();
 
+  // accept coroutine of io thread in reuse port mode
+  void IOThreadAcceptCorFunc(int index);
+
+  bool isReusePort();
+
  private:
   
   NetAddress::ptr m_addr;
 
   TcpAcceptor::ptr m_acceptor;
 
-  int m_tcp_counts {0};
+  std::atomic<int> m_tcp_counts {0};
 
   Reactor* m_main_reactor {nullptr};
 
   bool m_is_stop_accept {false};
 
   Coroutine::ptr m_accept_cor;
+
+  // reuse port mode, one acceptor and accept coroutine per io thread, index is same as io thread
+  std::vector<TcpAcceptor::ptr> m_io_acceptors;
+  std::vector<Coroutine::ptr> m_io_accept_cors;
   
   AbstractDispatcher::ptr m_dispatcher;
 
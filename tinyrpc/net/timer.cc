@@ -3,9 +3,7 @@
 #include <time.h>
 #include <string.h>
 #include <vector>
-#include <sys/time.h>
 #include <functional>
-#include <map>
 #include "../comm/log.h"
 #include "timer.h"
 #include "mutex.h"
@@ -18,11 +16,63 @@ extern read_fun_ptr_t g_sys_read_fun;  // sys read func
 namespace tinyrpc {
 
 
+// 0 means not cached
+static thread_local int64_t t_cached_now_ms = 0;
+
+static int64_t readClockMs(clockid_t clock_id) {
+  timespec ts;
+  clock_gettime(clock_id, &ts);
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
 int64_t getNowMs() {
-  timeval val;
-  gettimeofday(&val, nullptr);
-  int64_t re = val.tv_sec * 1000 + val.tv_usec / 1000;
-  return re;
+  if (t_cached_now_ms != 0) {
+    return t_cached_now_ms;
+  }
+  return readClockMs(CLOCK_MONOTONIC);
+}
+
+void updateCachedClock() {
+  // same clock as timerfd
+  t_cached_now_ms = readClockMs(CLOCK_MONOTONIC);
+}
+
+void resetCachedClock() {
+  t_cached_now_ms = 0;
+}
+
+int64_t getNowUs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// first set bit whose index >= start, -1 if not found
+static int findFirstBit(const uint64_t* words, int word_count, int start) {
+  int i = start >> 6;
+  uint64_t word = words[i] & (~0ULL << (start & 63));
+  while (true) {
+    if (word) {
+      return (i << 6) + __builtin_ctzll(word);
+    }
+    if (++i == word_count) {
+      return -1;
+    }
+    word = words[i];
+  }
+}
+
+// first set bit from start and wrap around, return distance to start, -1 if no bit set
+static int findNextBit(const uint64_t* words, int bit_count, int start) {
+  int word_count = (bit_count + 63) >> 6;
+  int bit = findFirstBit(words, word_count, start);
+  if (bit == -1) {
+    bit = findFirstBit(words, word_count, 0);
+    if (bit == -1) {
+      return -1;
+    }
+  }
+  return (bit - start) & (bit_count - 1);
 }
 
 Timer::Timer(Reactor* reactor) : FdEvent(reactor) {
@@ -32,6 +82,10 @@ Timer::Timer(Reactor* reactor) : FdEvent(reactor) {
   if (m_fd == -1) {
     DebugLog << "timerfd_create error";  
   }
+  memset(m_slots, 0, sizeof(m_slots));
+  memset(m_bitmap, 0, sizeof(m_bitmap));
+  m_current_tick = getNowMs();
+
   // DebugLog << "timerfd is [" << m_fd << "]";
 	m_read_callback = std::bind(&Timer::onTimer, this);
   addListenEvents(READ);
@@ -42,21 +96,149 @@ Timer::Timer(Reactor* reactor) : FdEvent(reactor) {
 Timer::~Timer() {
   unregisterFromReactor();
 	close(m_fd);
+  for (int i = 0; i < SLOT_COUNT; ++i) {
+    while (m_slots[i]) {
+      TimerEvent* event = m_slots[i];
+      unlink(event);
+      event->m_self.reset();
+    }
+  }
 }
 
+void Timer::link(TimerEvent* event) {
+  int64_t expires = event->m_arrive_time;
+  if (expires < m_current_tick) {
+    expires = m_current_tick;
+  }
+  int64_t ticks = expires - m_current_tick;
+  if (ticks >= MAX_TICKS) {
+    expires = m_current_tick + MAX_TICKS - 1;
+    ticks = MAX_TICKS - 1;
+  }
 
-void Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset /*=true*/) {
-  bool is_reset = false;
-  if (m_pending_events.empty()) {
-    is_reset = true;
+  int slot = 0;
+  if (ticks < ROOT_SIZE) {
+    slot = expires & (ROOT_SIZE - 1);
   } else {
-		auto it = m_pending_events.begin();
-    if (event->m_arrive_time < (*it).second->m_arrive_time) {
-      is_reset = true;
+    int level = 1;
+    int shift = ROOT_BITS;
+    while (ticks >= (1LL << (shift + LEVEL_BITS))) {
+      level++;
+      shift += LEVEL_BITS;
     }
+    slot = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((expires >> shift) & (LEVEL_SIZE - 1));
   }
-  m_pending_events.emplace(event->m_arrive_time, event);
-  if (is_reset && need_reset) {
+
+  event->m_slot = slot;
+  event->m_prev = nullptr;
+  event->m_next = m_slots[slot];
+  if (m_slots[slot]) {
+    m_slots[slot]->m_prev = event;
+  }
+  m_slots[slot] = event;
+  m_bitmap[slot >> 6] |= (1ULL << (slot & 63));
+  m_count++;
+}
+
+void Timer::unlink(TimerEvent* event) {
+  int slot = event->m_slot;
+  if (event->m_prev) {
+    event->m_prev->m_next = event->m_next;
+  } else {
+    m_slots[slot] = event->m_next;
+  }
+  if (event->m_next) {
+    event->m_next->m_prev = event->m_prev;
+  }
+  if (!m_slots[slot]) {
+    m_bitmap[slot >> 6] &= ~(1ULL << (slot & 63));
+  }
+  event->m_prev = nullptr;
+  event->m_next = nullptr;
+  event->m_slot = -1;
+  m_count--;
+}
+
+void Timer::cascade(int slot) {
+  TimerEvent* event = m_slots[slot];
+  while (event) {
+    TimerEvent* next = event->m_next;
+    unlink(event);
+    link(event);
+    event = next;
+  }
+}
+
+int64_t Timer::nextTick() {
+  if (m_count == 0) {
+    return -1;
+  }
+  int64_t re = -1;
+  int start = m_current_tick & (ROOT_SIZE - 1);
+  int n = findNextBit(m_bitmap, ROOT_SIZE, start);
+  if (n != -1) {
+    re = m_current_tick + n;
+  }
+
+  int shift = ROOT_BITS;
+  for (int level = 1; level < LEVEL_COUNT; ++level) {
+    // slots of this level are moved down at tick which is multiple of (1 << shift)
+    int64_t base = (m_current_tick + (1LL << shift) - 1) >> shift;
+    n = findNextBit(&m_bitmap[(ROOT_SIZE >> 6) + level - 1], LEVEL_SIZE, base & (LEVEL_SIZE - 1));
+    if (n != -1) {
+      int64_t tick = (base + n) << shift;
+      if (re == -1 || tick < re) {
+        re = tick;
+      }
+    }
+    shift += LEVEL_BITS;
+  }
+  return re;
+}
+
+void Timer::advance(int64_t now, std::vector<TimerEvent::ptr>& expired_events) {
+  while (m_current_tick <= now) {
+    int64_t next = nextTick();
+    if (next == -1 || next > now) {
+      // nothing to do between them
+      m_current_tick = now + 1;
+      break;
+    }
+    m_current_tick = next;
+
+    int index = m_current_tick & (ROOT_SIZE - 1);
+    if (index == 0) {
+      int shift = ROOT_BITS;
+      for (int level = 1; level < LEVEL_COUNT; ++level) {
+        int i = (m_current_tick >> shift) & (LEVEL_SIZE - 1);
+        cascade(ROOT_SIZE + (level - 1) * LEVEL_SIZE + i);
+        if (i != 0) {
+          break;
+        }
+        shift += LEVEL_BITS;
+      }
+    }
+
+    while (m_slots[index]) {
+      TimerEvent* event = m_slots[index];
+      unlink(event);
+      expired_events.push_back(event->m_self);
+      event->m_self.reset();
+    }
+    m_current_tick++;
+  }
+}
+
+void Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset /*=true*/) {
+  if (event->m_slot != -1) {
+    unlink(event.get());
+  }
+  event->m_is_cancled = false;
+  event->m_self = event;
+  link(event.get());
+
+  int64_t tick = event->m_arrive_time < m_current_tick ? m_current_tick : event->m_arrive_time;
+  if (need_reset && (m_armed_tick == -1 || tick < m_armed_tick)) {
     DebugLog << "need reset timer";
     resetArriveTime();
   }
@@ -65,22 +247,23 @@ void Timer::addTimerEvent(TimerEvent::ptr event, bool need_reset /*=true*/) {
 
 void Timer::delTimerEvent(TimerEvent::ptr event) {
   event->m_is_cancled = true;
+  if (event->m_slot != -1) {
+    unlink(event.get());
+    event->m_self.reset();
+  }
   // DebugLog << "del timer event succ";
 }
 
 void Timer::resetArriveTime() {
-  if (m_pending_events.size() == 0) {
+  int64_t tick = nextTick();
+  if (tick == -1) {
     DebugLog << "no timerevent pending, size = 0";
     return;
   }
 
   int64_t now = getNowMs();
-  auto it = m_pending_events.begin();
-  if ((*it).first < now) {
-    DebugLog<< "all timer events has already expire";
-    return;
-  }
-  int64_t interval = (*it).first - now;
+  // 0 means disarm timerfd, so fire as soon as possible if it has already expired
+  int64_t interval = tick > now ? tick - now : 0;
 
   itimerspec new_value;
   memset(&new_value, 0, sizeof(new_value));
@@ -89,6 +272,9 @@ void Timer::resetArriveTime() {
   memset(&ts, 0, sizeof(ts));
   ts.tv_sec = interval / 1000;
   ts.tv_nsec = (interval % 1000) * 1000000;
+  if (interval == 0) {
+    ts.tv_nsec = 1;
+  }
   new_value.it_value = ts;
 
   int rt = timerfd_settime(m_fd, 0, &new_value, nullptr);
@@ -96,7 +282,8 @@ void Timer::resetArriveTime() {
   if (rt != 0) {
     ErrorLog << "tiemr_settime error, interval=" << interval;
   } else {
-    // DebugLog << "reset timer succ, next occur time=" << (*it).first;
+    m_armed_tick = tick;
+    // DebugLog << "reset timer succ, next occur time=" << tick;
   }
 
 }
@@ -110,22 +297,18 @@ void Timer::onTimer() {
       break;
     }
   }
+  m_armed_tick = -1;
 
-  int64_t now = getNowMs();
-	auto it = m_pending_events.begin();
-	std::vector<TimerEvent::ptr> tmps;
-  std::vector<std::pair<int64_t, std::function<void()>>> tasks;
-	for (it = m_pending_events.begin(); it != m_pending_events.end(); ++it) {
-		if ((*it).first <= now && !((*it).second->m_is_cancled)) {
-			tmps.push_back((*it).second);
-      tasks.push_back(std::make_pair((*it).second->m_arrive_time, (*it).second->m_task));
-		}	else {
-			break;
-		}
-	}
+  expire(getNowMs());
+}
 
-	m_pending_events.erase(m_pending_events.begin(), it);
-	for (auto i = tmps.begin(); i != tmps.end(); ++i) {
+void Timer::expire(int64_t now) {
+  // all events expired in this tick are handled in one batch
+  std::vector<TimerEvent::ptr> events;
+  advance(now, events);
+
+	for (auto i = events.begin(); i != events.end(); ++i) {
+		m_reactor->getStats()->onTimerEvent(now - (*i)->m_arrive_time);
 		if ((*i)->m_is_repeated) {
 			(*i)->resetTime();
 			addTimerEvent(*i, false);
@@ -134,13 +317,17 @@ void Timer::onTimer() {
 
 	resetArriveTime();
 
-	// m_reactor->addTask(tasks);
-  for (auto i : tasks) {
-    // DebugLog << "excute timeevent:" << i.first;
-    i.second();
+  for (auto i : events) {
+    // task before may cancel this event
+    if (i->m_is_cancled) {
+      continue;
+    }
+    // DebugLog << "excute timeevent:" << i->m_arrive_time;
+    int64_t begin = getNowUs();
+    m_reactor->getStats()->beginRun();
+    i->m_task();
+    m_reactor->getStats()->onRun("timer event", nullptr, getNowUs() - begin);
   }
 }
 
 }
-
-
@@ -3,7 +3,8 @@
 
 #include <time.h>
 #include <memory>
-#include <map>
+#include <vector>
+#include <stdint.h>
 #include <functional>
 #include "mutex.h"
 #include "reactor.h"
@@ -13,11 +14,25 @@
 
 namespace tinyrpc {
 
+// monotonic time, ms. it's cached once every loop of reactor in this thread
 int64_t getNowMs();
 
+// read clock and cache it for this thread, called by reactor every loop
+void updateCachedClock();
+
+// stop caching, getNowMs reads clock every time
+void resetCachedClock();
+
+// monotonic time, us. it's never cached
+int64_t getNowUs();
+
+
+class Timer;
 
 class TimerEvent {
 
+ friend class Timer;
+
  public:
 
   typedef std::shared_ptr<TimerEvent> ptr;
@@ -40,10 +55,22 @@ class TimerEvent {
 	bool m_is_cancled {false};
   std::function<void()> m_task;
 
+ private:
+  // intrusive node of timing wheel, only used by Timer
+  TimerEvent* m_prev {nullptr};
+  TimerEvent* m_next {nullptr};
+  int m_slot {-1};          // -1 means not in wheel
+  ptr m_self;               // keep event alive while it's in wheel
+
 };
 
 class FdEvent;
 
+//
+// Hierarchical timing wheel, tick is 1 ms.
+// level 0 has 256 slots of 1 tick, level 1~3 have 64 slots, each slot of them covers a whole lower level.
+// add and delete are O(1), timerfd is only reset when the earliest timer changes
+//
 class Timer : public tinyrpc::FdEvent {
 
  public:
@@ -56,16 +83,48 @@ class Timer : public tinyrpc::FdEvent {
 
 	void addTimerEvent(TimerEvent::ptr event, bool need_reset = true);
 
+  // remove event from wheel at once
 	void delTimerEvent(TimerEvent::ptr event);
 
 	void resetArriveTime();
 
   void onTimer();
 
+  // expire events which arrive at or before now and excute them, onTimer calls it with current time
+  void expire(int64_t now);
+
  private:
+  static const int ROOT_BITS = 8;
+  static const int LEVEL_BITS = 6;
+  static const int LEVEL_COUNT = 4;
+  static const int ROOT_SIZE = 1 << ROOT_BITS;
+  static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+  static const int SLOT_COUNT = ROOT_SIZE + (LEVEL_COUNT - 1) * LEVEL_SIZE;
 
- 	std::multimap<int64_t, TimerEvent::ptr> m_pending_events;
+ public:
+  // max ticks the wheel can hold, later events are put at the end and moved again when their slot expires
+  static const int64_t MAX_TICKS = 1LL << (ROOT_BITS + (LEVEL_COUNT - 1) * LEVEL_BITS);
+
+ private:
+  void link(TimerEvent* event);
+
+  void unlink(TimerEvent* event);
 
+  // move events of this slot to lower level
+  void cascade(int slot);
+
+  // earliest tick which has events to expire or to cascade, -1 if wheel is empty
+  int64_t nextTick();
+
+  // move wheel to now, expired events are appended to expired_events
+  void advance(int64_t now, std::vector<TimerEvent::ptr>& expired_events);
+
+ private:
+  TimerEvent* m_slots[SLOT_COUNT];
+  uint64_t m_bitmap[SLOT_COUNT / 64];    // non-empty slots
+  int64_t m_current_tick {0};            // all ticks before it have been expired
+  int64_t m_armed_tick {-1};             // tick which timerfd will fire at, -1 if not armed
+  size_t m_count {0};
 
 };
 
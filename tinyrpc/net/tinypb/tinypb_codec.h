@@ -2,6 +2,7 @@
 #define TINYRPC_NET_TINYPB_TINYPB_CODEC_H
 
 #include <stdint.h>
+#include <google/protobuf/message.h>
 #include "tinyrpc/net/abstract_codec.h"
 #include "tinyrpc/net/abstract_data.h"
 #include "tinyrpc/net/tinypb/tinypb_data.h"
@@ -26,7 +27,12 @@ class TinyPbCodeC: public AbstractCodeC {
   // overwrite
   virtual ProtocalType getProtocalType();
 
-  const char* encodePbData(TinyPbStruct* data, int& len);
+  // if message isn't nullptr, it will be serialized to buf as pb_data directly, data->pb_data is ignored
+  void encode(TcpBuffer* buf, TinyPbStruct* data, const google::protobuf::Message* message);
+
+  // check whether buf has a full package without copy, broken bytes before PB_START will be skiped
+  // return 0 if has, otherwise return how many bytes still need
+  int32_t checkPackage(TcpBuffer* buf, int32_t& pk_len);
 
 
 };
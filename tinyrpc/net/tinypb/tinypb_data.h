@@ -6,6 +6,7 @@
 #include <string>
 #include "tinyrpc/net/abstract_data.h"
 #include "tinyrpc/comm/log.h"
+#include "tinyrpc/net/tcp/tcp_buffer.h"
 
 namespace tinyrpc {
 
@@ -14,10 +15,48 @@ class TinyPbStruct : public AbstractData {
   typedef std::shared_ptr<TinyPbStruct> pb_ptr;
   TinyPbStruct() = default;
   ~TinyPbStruct() = default;
-  TinyPbStruct(const TinyPbStruct& ) = default;
-  TinyPbStruct& operator=(const TinyPbStruct& ) = default;
-  TinyPbStruct(TinyPbStruct&&) = default;
-  TinyPbStruct& operator=(TinyPbStruct&&) = default;
+
+  // views of a detached one point to its own strings, so they are pointed to strings of new one
+  TinyPbStruct(const TinyPbStruct& other) {
+    *this = other;
+  }
+
+  TinyPbStruct& operator=(const TinyPbStruct& other) {
+    if (this != &other) {
+      AbstractData::operator=(other);
+      copyHeader(other);
+      msg_req = other.msg_req;
+      service_full_name = other.service_full_name;
+      err_info = other.err_info;
+      pb_data = other.pb_data;
+      copyViews(other);
+    }
+    return *this;
+  }
+
+  TinyPbStruct(TinyPbStruct&& other) {
+    *this = std::move(other);
+  }
+
+  TinyPbStruct& operator=(TinyPbStruct&& other) {
+    if (this != &other) {
+      AbstractData::operator=(other);
+      copyHeader(other);
+      msg_req = std::move(other.msg_req);
+      service_full_name = std::move(other.service_full_name);
+      err_info = std::move(other.err_info);
+      pb_data = std::move(other.pb_data);
+      copyViews(other);
+      // strings of other have been taken
+      if (other.is_detached) {
+        other.msg_req_view = BufferView();
+        other.service_name_view = BufferView();
+        other.pb_data_view = BufferView();
+        other.is_detached = false;
+      }
+    }
+    return *this;
+  }
 
   /*
   **  min of package is: 1 + 4 + 4 + 4 + 4 + 4 + 4 + 1 = 26 bytes
@@ -37,6 +76,50 @@ class TinyPbStruct : public AbstractData {
   int32_t check_num {-1};             // check_num of all package. to check legality of data
   // char end;                        // identify end of a TinyPb protocal data
 
+  // set by decode, point to bytes in read buffer instead of copy them to msg_req, service_full_name and pb_data
+  BufferView msg_req_view;
+  BufferView service_name_view;
+  BufferView pb_data_view;
+
+  // copy bytes of views to msg_req, service_full_name and pb_data, then views point to them.
+  // call it if data is used after read buffer changed
+  void detachBuffer() {
+    msg_req = msg_req_view.toString();
+    service_full_name = service_name_view.toString();
+    pb_data = pb_data_view.toString();
+    is_detached = true;
+    pointViewsToStrings();
+  }
+
+  bool is_detached {false};           // views point to strings of this object instead of read buffer
+
+ private:
+  void copyHeader(const TinyPbStruct& other) {
+    pk_len = other.pk_len;
+    msg_req_len = other.msg_req_len;
+    service_name_len = other.service_name_len;
+    err_code = other.err_code;
+    err_info_len = other.err_info_len;
+    check_num = other.check_num;
+  }
+
+  // called after strings are copied or moved from other
+  void copyViews(const TinyPbStruct& other) {
+    msg_req_view = other.msg_req_view;
+    service_name_view = other.service_name_view;
+    pb_data_view = other.pb_data_view;
+    is_detached = other.is_detached;
+    if (is_detached) {
+      pointViewsToStrings();
+    }
+  }
+
+  void pointViewsToStrings() {
+    msg_req_view.data = msg_req.c_str();
+    service_name_view.data = service_full_name.c_str();
+    pb_data_view.data = pb_data.c_str();
+  }
+
 };
 
 }
@@ -1,10 +1,13 @@
 #include <memory>
+#include <sstream>
 #include <google/protobuf/service.h>
 #include <google/protobuf/message.h>
 #include <google/protobuf/descriptor.h>
 #include "tinyrpc/net/net_address.h"
+#include "tinyrpc/net/timer.h"
 #include "tinyrpc/comm/error_code.h"
 #include "tinyrpc/net/tcp/tcp_client.h"
+#include "tinyrpc/net/tcp/tcp_client_pool.h"
 #include "tinyrpc/net/tinypb/tinypb_rpc_channel.h"
 #include "tinyrpc/net/tinypb/tinypb_rpc_controller.h"
 #include "tinyrpc/net/tinypb/tinypb_codec.h"
@@ -24,21 +27,45 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor* meth
     google::protobuf::Message* response, 
     google::protobuf::Closure* done) {
 
-  m_client = std::make_shared<TcpClient>(m_addr);
   TinyPbStruct pb_struct;
   TinyPbRpcController* rpc_controller = dynamic_cast<TinyPbRpcController*>(controller);
-  rpc_controller->SetLocalAddr(m_client->getLocalAddr());
-  rpc_controller->SetPeerAddr(m_client->getPeerAddr());
   
   pb_struct.service_full_name = method->full_name();
   DebugLog << "call service_name = " << pb_struct.service_full_name;
-  if (!request->SerializeToString(&(pb_struct.pb_data))) {
-    ErrorLog << "serialize send package error";
+
+  // connect and send of this call fail with ETIMEDOUT after rpc timeout
+  ScopedDeadline deadline(rpc_controller->Timeout());
+  // whole call, including waiting for a free connection, is limited by rpc timeout
+  int64_t call_deadline = getNowMs() + rpc_controller->Timeout();
+
+  // connection is shared with other coroutines of this thread
+  TcpClient::ptr client;
+  std::string err_info;
+  int rt = GetTcpClientPool()->getClient(m_addr, rpc_controller->Timeout(), client, err_info);
+  if (rt != 0) {
+    rpc_controller->SetError(rt, err_info);
+    ErrorLog << "get client from pool error, service_full_name=" << pb_struct.service_full_name << ", error_code=" 
+        << rt << ", error_info = " << err_info;
     return;
   }
-  AbstractCodeC::ptr m_codec = m_client->getConnection()->getCodec();
-  m_codec->encode(m_client->getConnection()->getOutBuffer(), &pb_struct);
+  int64_t left = call_deadline - getNowMs();
+  if (left <= 0) {
+    GetTcpClientPool()->returnClient(client);
+    std::stringstream ss;
+    ss << "call rpc falied, over " << rpc_controller->Timeout() << " ms";
+    rpc_controller->SetError(ERROR_RPC_CALL_TIMEOUT, ss.str());
+    ErrorLog << "call rpc timeout before send, service_full_name=" << pb_struct.service_full_name;
+    return;
+  }
+
+  rpc_controller->SetLocalAddr(client->getLocalAddr());
+  rpc_controller->SetPeerAddr(client->getPeerAddr());
+
+  // serialize request to out buffer directly
+  TinyPbCodeC* codec = dynamic_cast<TinyPbCodeC*>(client->getConnection()->getCodec().get());
+  codec->encode(client->getConnection()->getOutBuffer(), &pb_struct, request);
   if (!pb_struct.encode_succ) {
+    GetTcpClientPool()->returnClient(client);
     rpc_controller->SetError(ERROR_FAILED_ENCODE, "encode tinypb data error");
     return;
   }
@@ -49,16 +76,17 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor* meth
   InfoLog << pb_struct.msg_req << "|" << rpc_controller->PeerAddr()->toString() 
       << "|. Set client send request data:" << request->ShortDebugString();
   InfoLog << "============================================================";
-  m_client->setTimeout(rpc_controller->Timeout());
 
   TinyPbStruct::pb_ptr res_data;
-  int rt = m_client->sendAndRecvTinyPb(pb_struct.msg_req, res_data);
+  rt = client->sendAndRecvTinyPbMultiplex(pb_struct.msg_req, res_data, (int)left);
   if (rt != 0) {
-    rpc_controller->SetError(rt, m_client->getErrInfo());
+    rpc_controller->SetError(rt, client->getErrInfo());
     ErrorLog << pb_struct.msg_req << "|call rpc occur client error, service_full_name=" << pb_struct.service_full_name << ", error_code=" 
-        << rt << ", error_info = " << m_client->getErrInfo();
+        << rt << ", error_info = " << client->getErrInfo();
+    GetTcpClientPool()->returnClient(client);
     return;
   }
+  GetTcpClientPool()->returnClient(client);
 
   if (!response->ParseFromString(res_data->pb_data)) {
     rpc_controller->SetError(ERROR_FAILED_DESERIALIZE, "failed to deserialize data from server");
@@ -78,6 +106,7 @@ void TinyPbRpcChannel::CallMethod(const google::protobuf::MethodDescriptor* meth
   InfoLog<< "============================================================";
 
   // excute callback function
+  deadline.restore();
   if (done) {
     done->Run();
   }
@@ -10,6 +10,8 @@
 #include "tinypb_rpc_closure.h"
 #include "tinypb_codec.h"
 #include "../../comm/msg_req.h"
+#include "../../comm/metrics.h"
+#include "../timer.h"
 
 namespace tinyrpc {
 
@@ -22,34 +24,48 @@ void TinyPbRpcDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
     ErrorLog << "dynamic_cast error";
     return;
   }
-  Coroutine::GetCurrentCoroutine()->getRunTime()->m_msg_no = tmp->msg_req;
+  // decoded fields are views of read buffer, they are valid until this function return
+  TinyPbStruct reply_pk;
+  reply_pk.service_full_name = tmp->service_name_view.toString();
+  reply_pk.msg_req = tmp->msg_req_view.toString();
+
+  Coroutine::GetCurrentCoroutine()->getRunTime()->m_msg_no = reply_pk.msg_req;
   setCurrentRunTime(Coroutine::GetCurrentCoroutine()->getRunTime());
 
 
-  InfoLog << "begin to dispatch client tinypb request, msgno=" << tmp->msg_req;
+  InfoLog << "begin to dispatch client tinypb request, msgno=" << reply_pk.msg_req;
+
+  // requests failed before method is found are counted to one interface, names of bad requests may be endless
+  int64_t begin_time = getNowUs();
+  InterfaceMetrics* metrics = nullptr;
+  auto record_metrics = [&](int32_t err_code) {
+    if (!metrics) {
+      metrics = MetricsRegistry::GetInterfaceMetrics("unknown");
+      metrics->begin(begin_time - tmp->decode_time, tmp->decode_len);
+    }
+    metrics->end(getNowUs() - begin_time, err_code, reply_pk.pk_len);
+  };
 
   std::string service_name;
   std::string method_name;
 
-  TinyPbStruct reply_pk;
-  reply_pk.service_full_name = tmp->service_full_name;
-  reply_pk.msg_req = tmp->msg_req;
   if (reply_pk.msg_req.empty()) {
     reply_pk.msg_req = MsgReqUtil::genMsgNumber();
   }
 
-  if (!parseServiceFullName(tmp->service_full_name, service_name, method_name)) {
-    ErrorLog << reply_pk.msg_req << "|parse service name " << tmp->service_full_name << "error";
+  if (!parseServiceFullName(reply_pk.service_full_name, service_name, method_name)) {
+    ErrorLog << reply_pk.msg_req << "|parse service name " << reply_pk.service_full_name << "error";
 
     reply_pk.err_code = ERROR_PARSE_SERVICE_NAME;
     std::stringstream ss;
-    ss << "cannot parse service_name:[" << tmp->service_full_name << "]";
+    ss << "cannot parse service_name:[" << reply_pk.service_full_name << "]";
     reply_pk.err_info = ss.str();
     conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
+    record_metrics(reply_pk.err_code);
     return;
   }
 
-  Coroutine::GetCurrentCoroutine()->getRunTime()->m_interface_name = tmp->service_full_name;
+  Coroutine::GetCurrentCoroutine()->getRunTime()->m_interface_name = reply_pk.service_full_name;
   auto it = m_service_map.find(service_name);
   if (it == m_service_map.end() || !((*it).second)) {
     reply_pk.err_code = ERROR_SERVICE_NOT_FOUND;
@@ -59,8 +75,9 @@ void TinyPbRpcDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
     reply_pk.err_info = ss.str();
 
     conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
+    record_metrics(reply_pk.err_code);
 
-    InfoLog << "end dispatch client tinypb request, msgno=" << tmp->msg_req;
+    InfoLog << "end dispatch client tinypb request, msgno=" << reply_pk.msg_req;
     return;
 
   }
@@ -75,13 +92,17 @@ void TinyPbRpcDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
     ErrorLog << reply_pk.msg_req << "|" << ss.str();
     reply_pk.err_info = ss.str();
     conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
+    record_metrics(reply_pk.err_code);
     return;
   }
 
+  metrics = MetricsRegistry::GetInterfaceMetrics(reply_pk.service_full_name);
+  metrics->begin(begin_time - tmp->decode_time, tmp->decode_len);
+
   google::protobuf::Message* request = service->GetRequestPrototype(method).New();
   DebugLog << reply_pk.msg_req << "|request.name = " << request->GetDescriptor()->full_name();
 
-  if(!request->ParseFromString(tmp->pb_data)) {
+  if(!request->ParseFromArray(tmp->pb_data_view.data, tmp->pb_data_view.len)) {
     reply_pk.err_code = ERROR_FAILED_SERIALIZE;
     std::stringstream ss;
     ss << "faild to parse request data, request.name:[" << request->GetDescriptor()->full_name() << "]";
@@ -89,6 +110,7 @@ void TinyPbRpcDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
     ErrorLog << reply_pk.msg_req << "|" << ss.str();
     delete request;
     conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
+    record_metrics(reply_pk.err_code);
     return;
   }
 
@@ -103,33 +125,30 @@ void TinyPbRpcDispacther::dispatch(AbstractData* data, TcpConnection* conn) {
   TinyPbRpcController rpc_controller;
   rpc_controller.SetMsgReq(reply_pk.msg_req);
   rpc_controller.SetMethodName(method_name);
-  rpc_controller.SetMethodFullName(tmp->service_full_name);
+  rpc_controller.SetMethodFullName(reply_pk.service_full_name);
 
-  std::function<void()> reply_package_func = [&reply_pk, response, request]()
+  std::function<void()> reply_package_func = [&reply_pk]()
   {
-    // DebugLog << "<<<<<<<<<<<<<<<<<<<<<<<<<<<<";
     InfoLog << "Call [" << reply_pk.service_full_name << "] succ, now send reply package";
-
-    if (!(response->SerializeToString(&(reply_pk.pb_data)))) {
-      reply_pk.pb_data = "";
-      ErrorLog << reply_pk.msg_req << "|reply error! encode reply package error";
-      reply_pk.err_code = ERROR_FAILED_SERIALIZE;
-      reply_pk.err_info = "failed to serilize relpy data";
-    } else {
-      InfoLog << "============================================================";
-      InfoLog << reply_pk.msg_req << "|Set server response data:" << response->ShortDebugString();
-      InfoLog << "============================================================";
-    }
-
-    delete request;
-    delete response;
-
   };
 
   TinyPbRpcClosure closure(reply_package_func);
   service->CallMethod(method, &rpc_controller, request, response, &closure);
 
-  conn->getCodec()->encode(conn->getOutBuffer(), dynamic_cast<AbstractData*>(&reply_pk));
+  InfoLog << "============================================================";
+  InfoLog << reply_pk.msg_req << "|Set server response data:" << response->ShortDebugString();
+  InfoLog << "============================================================";
+
+  // serialize response to out buffer directly, request and response must live until now
+  TinyPbCodeC* codec = dynamic_cast<TinyPbCodeC*>(conn->getCodec().get());
+  codec->encode(conn->getOutBuffer(), &reply_pk, response);
+  if (!reply_pk.encode_succ) {
+    ErrorLog << reply_pk.msg_req << "|reply error! encode reply package error";
+  }
+  record_metrics(rpc_controller.ErrorCode());
+
+  delete request;
+  delete response;
 
 }
 